@@ -0,0 +1,222 @@
+#include "jx11.h"
+#include "engine/ParameterInfo.h"
+#include "engine/PluginState.h"
+#include "engine/Synth.h"
+#include <algorithm>
+#include <cmath>
+#include <new>
+#include <string_view>
+#include <vector>
+
+using namespace JX11::Engine;
+
+struct jx11_synth
+{
+    Synth synth;
+    Parameters params;
+
+    // Like JX11AudioProcessor::parametersChanged, but the API is not meant to
+    // be called from several threads, so it doesn't need to be atomic.
+    bool parametersChanged = true;
+
+    bool prepared = false;
+    int maxBlockSize = 0;
+
+    // For jx11_render_interleaved.
+    std::vector<float> left;
+    std::vector<float> right;
+};
+
+namespace
+{
+
+// Like JX11AudioProcessor::reset.
+void resetSynth(jx11_synth& s)
+{
+    s.synth.reset();
+    s.synth.outputLevelSmoother.setCurrentAndTargetValue(std::pow(10.0f, s.params.outputLevel * 0.05f));
+    s.parametersChanged = true;
+}
+
+// Like the start of JX11AudioProcessor::processBlock, which also comes before
+// the MIDI messages of the block.
+void applyChangedParameters(jx11_synth& s)
+{
+    if (s.parametersChanged) {
+        s.parametersChanged = false;
+        s.synth.applyParameters(s.params);
+    }
+}
+
+} // namespace
+
+extern "C" {
+
+int jx11_get_api_version(void)
+{
+    return JX11_API_VERSION;
+}
+
+jx11_synth* jx11_create(void)
+{
+    return new (std::nothrow) jx11_synth();
+}
+
+void jx11_destroy(jx11_synth* synth)
+{
+    delete synth;
+}
+
+jx11_result jx11_prepare(jx11_synth* synth, double sample_rate, int max_block_size)
+{
+    if (synth == nullptr || !(sample_rate > 0.0) || max_block_size <= 0) {
+        return JX11_INVALID_ARGUMENT;
+    }
+    try {
+        synth->left.resize(size_t(max_block_size));
+        synth->right.resize(size_t(max_block_size));
+    } catch (const std::bad_alloc&) {
+        return JX11_OUT_OF_MEMORY;
+    }
+    synth->maxBlockSize = max_block_size;
+    synth->synth.allocateResources(sample_rate, max_block_size);
+    synth->prepared = true;
+    resetSynth(*synth);
+    return JX11_OK;
+}
+
+void jx11_reset(jx11_synth* synth)
+{
+    if (synth != nullptr) {
+        resetSynth(*synth);
+    }
+}
+
+int jx11_get_parameter_count(void)
+{
+    return int(PARAMETER_COUNT);
+}
+
+const char* jx11_get_parameter_id(int index)
+{
+    return (index >= 0 && size_t(index) < PARAMETER_COUNT) ? PARAMETER_INFOS[index].id : nullptr;
+}
+
+int jx11_find_parameter(const char* id)
+{
+    if (id == nullptr) {
+        return -1;
+    }
+    const auto* info = findParameterInfo(id);
+    return (info != nullptr) ? int(info - PARAMETER_INFOS) : -1;
+}
+
+jx11_result jx11_set_parameter(jx11_synth* synth, int index, float value)
+{
+    if (synth == nullptr) {
+        return JX11_INVALID_ARGUMENT;
+    }
+    if (index < 0 || size_t(index) >= PARAMETER_COUNT) {
+        return JX11_UNKNOWN_PARAMETER;
+    }
+    PARAMETER_INFOS[index].set(synth->params, value);
+    synth->parametersChanged = true;
+    return JX11_OK;
+}
+
+jx11_result jx11_set_parameter_by_id(jx11_synth* synth, const char* id, float value)
+{
+    return jx11_set_parameter(synth, jx11_find_parameter(id), value);
+}
+
+float jx11_get_parameter(const jx11_synth* synth, int index)
+{
+    if (synth == nullptr || index < 0 || size_t(index) >= PARAMETER_COUNT) {
+        return 0.0f;
+    }
+    return PARAMETER_INFOS[index].get(synth->params);
+}
+
+jx11_result jx11_load_state(jx11_synth* synth, const void* data, size_t size)
+{
+    if (synth == nullptr || (data == nullptr && size > 0)) {
+        return JX11_INVALID_ARGUMENT;
+    }
+    // Only apply the state if all of it could be read.
+    Parameters params = synth->params;
+    const char* error = nullptr;
+    if (!readPluginState(std::string_view(static_cast<const char*>(data), size), params, error)) {
+        return JX11_INVALID_STATE;
+    }
+    synth->params = params;
+    synth->parametersChanged = true;
+    return JX11_OK;
+}
+
+size_t jx11_save_state(const jx11_synth* synth, void* buffer, size_t capacity)
+{
+    if (synth == nullptr || (buffer == nullptr && capacity > 0)) {
+        return 0;
+    }
+    return writePluginState(synth->params, buffer, capacity);
+}
+
+jx11_result jx11_send_midi(jx11_synth* synth, uint8_t status, uint8_t data1, uint8_t data2)
+{
+    if (synth == nullptr) {
+        return JX11_INVALID_ARGUMENT;
+    }
+    // The synth has no lookup tables yet, which a note or the parameters
+    // need.
+    if (!synth->prepared) {
+        return JX11_NOT_PREPARED;
+    }
+    applyChangedParameters(*synth);
+
+    // Same as JX11AudioProcessor::handleMIDI.
+    if ((status & 0xF0) == 0xB0 && data1 == 0x07) {
+        const auto* info = findParameterInfo("outputLevel");
+        info->set(synth->params, info->fromNormalized(float(data2) / 127.0f));
+        synth->parametersChanged = true;
+    }
+    synth->synth.midiMessage(status, data1, data2);
+    return JX11_OK;
+}
+
+jx11_result jx11_render(jx11_synth* synth, float* left, float* right, int frame_count)
+{
+    if (synth == nullptr || left == nullptr || frame_count < 0) {
+        return JX11_INVALID_ARGUMENT;
+    }
+    if (!synth->prepared) {
+        return JX11_NOT_PREPARED;
+    }
+    applyChangedParameters(*synth);
+    float* outputBuffers[2] = {left, right};
+    synth->synth.render(outputBuffers, frame_count);
+    return JX11_OK;
+}
+
+jx11_result jx11_render_interleaved(jx11_synth* synth, float* output, int frame_count)
+{
+    if (synth == nullptr || output == nullptr || frame_count < 0) {
+        return JX11_INVALID_ARGUMENT;
+    }
+    if (!synth->prepared) {
+        return JX11_NOT_PREPARED;
+    }
+    applyChangedParameters(*synth);
+    float* outputBuffers[2] = {synth->left.data(), synth->right.data()};
+    for (int offset = 0; offset < frame_count; offset += synth->maxBlockSize) {
+        const int frames = std::min(synth->maxBlockSize, frame_count - offset);
+        synth->synth.render(outputBuffers, frames);
+        float* out = output + 2 * size_t(offset);
+        for (int i = 0; i < frames; ++i) {
+            out[2 * i] = synth->left[size_t(i)];
+            out[2 * i + 1] = synth->right[size_t(i)];
+        }
+    }
+    return JX11_OK;
+}
+
+} // extern "C"
\ No newline at end of file
@@ -0,0 +1,132 @@
+/*
+ * libjx11: the JX11 synth engine as a shared library with a C API, for hosts
+ * that are not written in C++ or that can't load the plugin.
+ *
+ * A jx11_synth is one instance of the synth. Create it, prepare it for a
+ * sample rate, then send it MIDI and render audio into your own buffers. Only
+ * jx11_create and jx11_prepare allocate memory, so everything else can be
+ * called from a real-time thread. An instance must not be used from several
+ * threads at the same time; different instances are independent.
+ *
+ * The parameters are those of the plugin, with the same IDs (see ParamIds in
+ * src/processor/Params.h) and the same units, such as percent, semitones or
+ * decibels. Changes take effect at the next render call or MIDI message,
+ * like they do at the start of the next block in the plugin. MIDI messages
+ * take effect at once, so to play a message in the middle of a block, render
+ * up to that point, send the message, and render the rest.
+ *
+ * The state is the same data as the plugin saves in a host session, so they
+ * can load each other's states.
+ *
+ * The ABI only changes with JX11_API_VERSION. Functions may be added without
+ * changing it.
+ */
+
+#ifndef JX11_H
+#define JX11_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(JX11_BUILDING_LIBRARY)
+#define JX11_API __declspec(dllexport)
+#else
+#define JX11_API __declspec(dllimport)
+#endif
+#else
+#define JX11_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JX11_API_VERSION 1
+
+typedef struct jx11_synth jx11_synth;
+
+/* The functions that can fail return one of these. */
+typedef enum jx11_result
+{
+    JX11_OK = 0,
+    JX11_INVALID_ARGUMENT = -1,
+    JX11_NOT_PREPARED = -2,
+    JX11_UNKNOWN_PARAMETER = -3,
+    JX11_INVALID_STATE = -4,
+    JX11_OUT_OF_MEMORY = -5
+} jx11_result;
+
+/* JX11_API_VERSION of the library that is loaded. */
+JX11_API int jx11_get_api_version(void);
+
+/* Returns NULL if there is not enough memory. */
+JX11_API jx11_synth* jx11_create(void);
+JX11_API void jx11_destroy(jx11_synth* synth);
+
+/*
+ * Sets the sample rate, allocates what the synth needs to render up to
+ * max_block_size frames at a time into interleaved buffers, and resets it.
+ * Planar rendering takes any number of frames. Can be called again to change
+ * the sample rate.
+ */
+JX11_API jx11_result jx11_prepare(jx11_synth* synth, double sample_rate, int max_block_size);
+
+/* Stops all voices and clears the MIDI controllers, like a transport stop. */
+JX11_API void jx11_reset(jx11_synth* synth);
+
+/* The parameters, in the same order as in the plugin. */
+JX11_API int jx11_get_parameter_count(void);
+JX11_API const char* jx11_get_parameter_id(int index);
+
+/* Returns -1 if there is no parameter with this ID. */
+JX11_API int jx11_find_parameter(const char* id);
+
+/*
+ * Sets a parameter, in its own units. The value is clamped to the range of
+ * the parameter and snapped to its steps, like in the plugin.
+ */
+JX11_API jx11_result jx11_set_parameter(jx11_synth* synth, int index, float value);
+JX11_API jx11_result jx11_set_parameter_by_id(jx11_synth* synth, const char* id, float value);
+JX11_API float jx11_get_parameter(const jx11_synth* synth, int index);
+
+/*
+ * Loads a state saved by the plugin or by jx11_save_state. Parameters that
+ * are missing from the state keep their value.
+ */
+JX11_API jx11_result jx11_load_state(jx11_synth* synth, const void* data, size_t size);
+
+/*
+ * Saves the state into a buffer of the given capacity. Returns the size of
+ * the state. If that is more than capacity, nothing is written, so calling
+ * this with a capacity of 0 returns the size to allocate.
+ */
+JX11_API size_t jx11_save_state(const jx11_synth* synth, void* buffer, size_t capacity);
+
+/*
+ * Plays a MIDI message of up to three bytes. Unused bytes should be 0. Like
+ * in the plugin, the volume controller (CC 7) sets the Output Level
+ * parameter. Before jx11_prepare, the message is dropped and this returns
+ * JX11_NOT_PREPARED.
+ */
+JX11_API jx11_result jx11_send_midi(jx11_synth* synth, uint8_t status, uint8_t data1, uint8_t data2);
+
+/*
+ * Renders frame_count frames into separate left and right buffers. With a
+ * right buffer of NULL, renders a mono mix into left. The audio goes straight
+ * into the buffers, without a copy.
+ */
+JX11_API jx11_result jx11_render(jx11_synth* synth, float* left, float* right, int frame_count);
+
+/*
+ * Renders frame_count frames into one buffer of left and right samples in
+ * turn. The audio is rendered into the synth's own buffers and copied, at
+ * most max_block_size frames at a time.
+ */
+JX11_API jx11_result jx11_render_interleaved(jx11_synth* synth, float* output, int frame_count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JX11_H */
\ No newline at end of file
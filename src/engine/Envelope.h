@@ -1,5 +1,7 @@
 #pragma once
 
+#include "Kernels.h"
+
 namespace JX11::Engine
 {
 
@@ -62,6 +64,29 @@ public:
         multiplier = releaseMultiplier;
     }
 
+    // Starts the release with a different speed than `releaseMultiplier`.
+    void release(float fastMultiplier)
+    {
+        target = 0.0f;
+        multiplier = fastMultiplier;
+    }
+
+    // Replaces the multipliers, including the one for the stage that is in
+    // progress. Only call this on an active envelope.
+    void setMultipliers(float newAttack, float newDecay, float newRelease)
+    {
+        if (multiplier == attackMultiplier) {
+            multiplier = newAttack;
+        } else if (multiplier == decayMultiplier) {
+            multiplier = newDecay;
+        } else if (multiplier == releaseMultiplier) {
+            multiplier = newRelease;
+        }
+        attackMultiplier = newAttack;
+        decayMultiplier = newDecay;
+        releaseMultiplier = newRelease;
+    }
+
     // Parameter values for this envelope.
     float attackMultiplier;
     float decayMultiplier;
@@ -72,6 +97,10 @@ public:
     float level;
 
 private:
+    // The render kernels process the state of several voices side by side.
+    template <KernelLevel>
+    friend struct KernelImpl;
+
     float target;
     float multiplier;
 };
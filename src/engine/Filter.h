@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Kernels.h"
 #include <cmath>
 
 namespace JX11::Engine
@@ -43,7 +44,11 @@ public:
     }
 
 private:
-    const float PI = 3.1415926535897932f;
+    // The render kernels process the state of several voices side by side.
+    template <KernelLevel>
+    friend struct KernelImpl;
+
+    static constexpr float PI = 3.1415926535897932f;
 
     float g, k, a1, a2, a3; // filter coefficients
     float ic1eq, ic2eq;     // internal state
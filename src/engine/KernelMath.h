@@ -0,0 +1,97 @@
+#pragma once
+
+#include "Envelope.h"
+
+// Building blocks for the render kernels in KernelsImpl.h.
+//
+// The equations for the envelope and the filter are written once, as templates.
+// The scalar kernels run them for one lane at a time with `float`, the SIMD
+// kernels run them for all lanes at once with `Float8`, a vector of 8 floats.
+// Float8 uses the GCC / Clang vector extensions, the compiler picks the actual
+// instructions based on the target of the kernel that the code is inlined into.
+
+#if defined(__GNUC__) || defined(__clang__)
+#define JX11_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define JX11_ALWAYS_INLINE inline
+#endif
+
+// The helpers below are always inlined into a kernel that enables AVX, so the
+// warning about passing AVX vectors to functions without AVX doesn't apply.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+namespace JX11::Engine::KernelMath
+{
+
+#if defined(__GNUC__) || defined(__clang__)
+typedef float Float8 __attribute__((vector_size(32)));
+typedef int Int8 __attribute__((vector_size(32)));
+
+JX11_ALWAYS_INLINE void load(Float8& v, const float* p)
+{
+    __builtin_memcpy(&v, p, sizeof(Float8));
+}
+
+JX11_ALWAYS_INLINE void store(float* p, const Float8& v)
+{
+    __builtin_memcpy(p, &v, sizeof(Float8));
+}
+
+JX11_ALWAYS_INLINE void store(int* p, const Int8& v)
+{
+    __builtin_memcpy(p, &v, sizeof(Int8));
+}
+
+JX11_ALWAYS_INLINE Float8 select(const Int8& mask, const Float8& a, const Float8& b)
+{
+    return (Float8)(((Int8)a & mask) | ((Int8)b & ~mask));
+}
+
+// Whether the mask is set for any lane.
+JX11_ALWAYS_INLINE bool any(const Int8& mask)
+{
+    unsigned long long words[4];
+    __builtin_memcpy(words, &mask, sizeof(Int8));
+    return (words[0] | words[1] | words[2] | words[3]) != 0;
+}
+
+#endif
+
+JX11_ALWAYS_INLINE float select(bool mask, float a, float b)
+{
+    return mask ? a : b;
+}
+
+// Envelope::nextValue, except that an envelope that is no longer active
+// outputs 0 and keeps its state. `active` tells whether it was active.
+template <typename V, typename M>
+JX11_ALWAYS_INLINE V envelopeStep(V& level, V& target, V& multiplier,
+                                  const V& decayMultiplier, const V& sustainLevel, M& active)
+{
+    active = level > SILENCE;
+
+    V next = multiplier * (level - target) + target;
+    M decay = active & (next + target > 3.0f);
+
+    level = select(active, next, level);
+    multiplier = select(decay, decayMultiplier, multiplier);
+    target = select(decay, sustainLevel, target);
+
+    return select(active, next, V {});
+}
+
+// Filter::render.
+template <typename V>
+JX11_ALWAYS_INLINE V filterStep(const V& x, V& ic1eq, V& ic2eq, const V& a1, const V& a2, const V& a3)
+{
+    V v3 = x - ic2eq;
+    V v1 = a1 * ic1eq + a2 * v3;
+    V v2 = ic2eq + a2 * ic1eq + a3 * v3;
+    ic1eq = 2.0f * v1 - ic1eq;
+    ic2eq = 2.0f * v2 - ic2eq;
+    return v2;
+}
+
+} // namespace JX11::Engine::KernelMath
\ No newline at end of file
@@ -0,0 +1,140 @@
+#include "Kernels.h"
+#include "KernelMath.h"
+#include "Voice.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+// The vectorized kernels use the GCC / Clang target attribute and are only
+// built for x86. Other compilers and CPUs only get the scalar kernels.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define JX11_KERNELS_X86 1
+#else
+#define JX11_KERNELS_X86 0
+#endif
+
+#define JX11_KERNEL_NAMESPACE scalar
+#define JX11_KERNEL_LEVEL KernelLevel::scalar
+#define JX11_KERNEL_TARGET
+#define JX11_KERNEL_SIMD 0
+#include "KernelsImpl.h"
+#undef JX11_KERNEL_NAMESPACE
+#undef JX11_KERNEL_LEVEL
+#undef JX11_KERNEL_TARGET
+#undef JX11_KERNEL_SIMD
+
+#if JX11_KERNELS_X86
+
+#define JX11_KERNEL_NAMESPACE avx2
+#define JX11_KERNEL_LEVEL KernelLevel::avx2
+#define JX11_KERNEL_TARGET __attribute__((target("avx2")))
+#define JX11_KERNEL_SIMD 1
+#include "KernelsImpl.h"
+#undef JX11_KERNEL_NAMESPACE
+#undef JX11_KERNEL_LEVEL
+#undef JX11_KERNEL_TARGET
+#undef JX11_KERNEL_SIMD
+
+#define JX11_KERNEL_NAMESPACE avx512
+#define JX11_KERNEL_LEVEL KernelLevel::avx512
+#define JX11_KERNEL_TARGET __attribute__((target("avx512f,avx512vl,avx2")))
+#define JX11_KERNEL_SIMD 1
+#include "KernelsImpl.h"
+#undef JX11_KERNEL_NAMESPACE
+#undef JX11_KERNEL_LEVEL
+#undef JX11_KERNEL_TARGET
+#undef JX11_KERNEL_SIMD
+
+#endif
+
+namespace JX11::Engine
+{
+
+// Set by setKernelOverride. Uses -1 for "no override".
+static std::atomic<int> kernelOverride {-1};
+
+const char* getKernelName(KernelLevel level)
+{
+    switch (level) {
+    case KernelLevel::avx2:
+        return "avx2";
+    case KernelLevel::avx512:
+        return "avx512";
+    case KernelLevel::scalar:
+    default:
+        return "scalar";
+    }
+}
+
+KernelLevel detectKernelLevel()
+{
+#if JX11_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx2")) {
+        return KernelLevel::avx512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return KernelLevel::avx2;
+    }
+#endif
+    return KernelLevel::scalar;
+}
+
+const Kernels* getKernels(KernelLevel level)
+{
+    // The levels are ordered, so any level up to the detected one is fine.
+    if (static_cast<int>(level) > static_cast<int>(detectKernelLevel())) {
+        return nullptr;
+    }
+
+    switch (level) {
+#if JX11_KERNELS_X86
+    case KernelLevel::avx2:
+        return &avx2::kernels;
+    case KernelLevel::avx512:
+        return &avx512::kernels;
+#endif
+    case KernelLevel::scalar:
+        return &scalar::kernels;
+    default:
+        return nullptr;
+    }
+}
+
+static std::optional<KernelLevel> getKernelLevelFromEnvironment()
+{
+    const char* name = std::getenv("JX11_KERNEL");
+    if (name == nullptr) {
+        return std::nullopt;
+    }
+    for (auto level : {KernelLevel::scalar, KernelLevel::avx2, KernelLevel::avx512}) {
+        if (std::strcmp(name, getKernelName(level)) == 0) {
+            return level;
+        }
+    }
+    return std::nullopt;
+}
+
+const Kernels& selectKernels()
+{
+    std::optional<KernelLevel> requested;
+    if (int level = kernelOverride.load(); level >= 0) {
+        requested = static_cast<KernelLevel>(level);
+    } else {
+        requested = getKernelLevelFromEnvironment();
+    }
+
+    if (requested.has_value()) {
+        if (auto kernels = getKernels(*requested); kernels != nullptr) {
+            return *kernels;
+        }
+    }
+    return *getKernels(detectKernelLevel());
+}
+
+void setKernelOverride(std::optional<KernelLevel> level)
+{
+    kernelOverride.store(level.has_value() ? static_cast<int>(*level) : -1);
+}
+
+} // namespace JX11::Engine
\ No newline at end of file
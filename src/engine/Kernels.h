@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+
+namespace JX11::Engine
+{
+
+struct Voice;
+
+// Instruction sets that the render kernels are compiled for. The scalar
+// kernels are plain C++ for the baseline target and work on any CPU. There is
+// no SSE level: the 8 lanes are twice as wide as the SSE registers, and the
+// SSE code was no faster than the scalar one.
+enum class KernelLevel
+{
+    scalar,
+    avx2,
+    avx512
+};
+
+// The kernels for each instruction set are the static functions of a
+// specialization of this class, see KernelsImpl.h. Envelope and Filter make it
+// a friend so the kernels can process their state directly.
+template <KernelLevel level>
+struct KernelImpl;
+
+// The active voices for the chunk of audio that is being rendered. Each voice
+// gets a lane; the kernels process the lanes side by side so that the
+// computations for several voices can be done with one SIMD instruction.
+struct VoiceLanes
+{
+    // Max number of lanes. This is the same as Synth::MAX_VOICES.
+    static constexpr size_t SIZE = 8;
+
+    // The number of lanes in use and their voices, in voice order.
+    size_t count = 0;
+    Voice* voices[SIZE] = {};
+
+    // Panning amounts of the voices.
+    alignas(64) float panLeft[SIZE] = {};
+    alignas(64) float panRight[SIZE] = {};
+    alignas(64) float panMono[SIZE] = {};
+};
+
+// The hot loops of the synth. Synth renders the audio in chunks of at most
+// MAX_CONTROL_PERIOD samples by calling these functions. There is a version of each
+// kernel for every instruction set, and the best one for the CPU is picked
+// at runtime.
+struct Kernels
+{
+    KernelLevel level;
+
+    // Renders the voices (amplitude envelope, oscillators, noise and filter)
+    // and mixes them into the output channel(s), overwriting what was there.
+    // With a mono output, `outputRight` is not used.
+    void (*renderVoicesMono)(VoiceLanes& lanes, const float* noise,
+                             float* outputLeft, float* outputRight, int sampleCount);
+    void (*renderVoicesStereo)(VoiceLanes& lanes, const float* noise,
+                               float* outputLeft, float* outputRight, int sampleCount);
+
+    // Multiplies the output by the output level, which has one value per sample.
+    void (*applyGain)(float* buffer, const float* gain, int sampleCount);
+
+    // Runs the amplitude envelopes and the oscillators of the voices like
+    // renderVoices does, but skips the filters and produces no output. This
+    // is for Synth::advance.
+    void (*advanceVoices)(VoiceLanes& lanes, int sampleCount);
+
+    // Runs only the amplitude envelopes, so that it is known when each voice
+    // becomes silent.
+    void (*advanceEnvelopes)(VoiceLanes& lanes, int sampleCount);
+};
+
+// Name of the instruction set, as used by the JX11_KERNEL environment variable.
+const char* getKernelName(KernelLevel level);
+
+// The best instruction set that this CPU supports and that the kernels were
+// compiled for.
+KernelLevel detectKernelLevel();
+
+// Returns the kernels for the given level, or nullptr if they can't be used
+// on this CPU.
+const Kernels* getKernels(KernelLevel level);
+
+// Picks the kernels to use. This is the override if one was set, otherwise the
+// level from the JX11_KERNEL environment variable, otherwise the best level for
+// this CPU. An override that the CPU doesn't support is ignored.
+const Kernels& selectKernels();
+
+// Forces a kernel level, for testing. Pass std::nullopt to go back to detecting
+// the CPU features. Takes effect the next time kernels are selected.
+void setKernelOverride(std::optional<KernelLevel> level);
+
+} // namespace JX11::Engine
\ No newline at end of file
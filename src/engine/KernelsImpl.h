@@ -0,0 +1,394 @@
+// This file is included by Kernels.cpp once for every instruction set, so it
+// deliberately has no include guard. Before including it, define:
+//
+//   JX11_KERNEL_NAMESPACE  namespace that holds this version of the kernels
+//   JX11_KERNEL_LEVEL      the matching KernelLevel
+//   JX11_KERNEL_TARGET     function attribute that enables the instruction set
+//   JX11_KERNEL_SIMD       1 to process all lanes at once with Float8 when
+//                          there are enough voices, 0 to always process them
+//                          one at a time
+//
+// The instruction set is enabled per function rather than per file. The inline
+// functions from Voice, Oscillator, etc. are inlined into the kernels and get
+// compiled for that instruction set, while the out-of-line copies that the
+// linker may share with other code are always compiled for the baseline target.
+//
+// The envelope and filter use the equations from KernelMath.h, and the SIMD
+// kernels do the oscillators with oscillatorStep. These do the operations in
+// the same order as Envelope::nextValue, Filter::render and
+// Oscillator::nextSample. Kernels.cpp is compiled without FMA contraction, so
+// every kernel gives exactly the same output as calling those functions one
+// voice at a time.
+
+namespace JX11::Engine
+{
+
+template <>
+struct KernelImpl<JX11_KERNEL_LEVEL>
+{
+    static constexpr size_t SIZE = VoiceLanes::SIZE;
+
+    // Renders the active voices and adds them up into the output channel(s).
+    // Each voice goes through its amplitude envelope, oscillators and filter.
+    // This is done one sample at a time for all voices, rather than one stage
+    // at a time. The envelopes and filters are recursive, and this way the CPU
+    // can work on the different stages in parallel.
+    template <bool stereo>
+    JX11_KERNEL_TARGET static void renderVoices(VoiceLanes& lanes, const float* __restrict noise,
+                                                float* __restrict outputLeft, float* __restrict outputRight,
+                                                int sampleCount)
+    {
+        const size_t count = lanes.count;
+
+        // Copy the state of the envelopes and filters into the lanes. Unused
+        // lanes have an envelope level of 0, so they are never active.
+        LaneState state;
+        for (size_t lane = 0; lane < count; ++lane) {
+            const Voice& voice = *lanes.voices[lane];
+            state.level[lane] = voice.env.level;
+            state.target[lane] = voice.env.target;
+            state.multiplier[lane] = voice.env.multiplier;
+            state.decayMultiplier[lane] = voice.env.decayMultiplier;
+            state.sustainLevel[lane] = voice.env.sustainLevel;
+            state.a1[lane] = voice.filter.a1;
+            state.a2[lane] = voice.filter.a2;
+            state.a3[lane] = voice.filter.a3;
+            state.ic1eq[lane] = voice.filter.ic1eq;
+            state.ic2eq[lane] = voice.filter.ic2eq;
+        }
+
+#if JX11_KERNEL_SIMD
+        if (count >= MIN_SIMD_LANES) {
+            renderLanes<stereo>(lanes, state, noise, outputLeft, outputRight, sampleCount);
+        } else
+#endif
+        {
+            // Output of the voices for the current sample, after the envelope.
+            alignas(64) float output[SIZE] = {};
+
+            for (int sample = 0; sample < sampleCount; ++sample) {
+                for (size_t lane = 0; lane < count; ++lane) {
+                    bool active;
+                    float envelope = KernelMath::envelopeStep(state.level[lane], state.target[lane],
+                                                              state.multiplier[lane], state.decayMultiplier[lane],
+                                                              state.sustainLevel[lane], active);
+                    float x = active ? lanes.voices[lane]->renderOscillators(noise[sample]) : 0.0f;
+                    float y = KernelMath::filterStep(x, state.ic1eq[lane], state.ic2eq[lane],
+                                                     state.a1[lane], state.a2[lane], state.a3[lane]);
+                    output[lane] = y * envelope;
+                }
+
+                mix<stereo>(lanes, output, outputLeft, outputRight, sample);
+            }
+        }
+
+        for (size_t lane = 0; lane < count; ++lane) {
+            Voice& voice = *lanes.voices[lane];
+            voice.env.level = state.level[lane];
+            voice.env.target = state.target[lane];
+            voice.env.multiplier = state.multiplier[lane];
+            voice.filter.ic1eq = state.ic1eq[lane];
+            voice.filter.ic2eq = state.ic2eq[lane];
+        }
+    }
+
+    // The state of the envelopes and filters, one lane per voice.
+    struct LaneState
+    {
+        alignas(64) float level[SIZE] = {}, target[SIZE] = {}, multiplier[SIZE] = {};
+        alignas(64) float decayMultiplier[SIZE] = {}, sustainLevel[SIZE] = {};
+        alignas(64) float a1[SIZE] = {}, a2[SIZE] = {}, a3[SIZE] = {};
+        alignas(64) float ic1eq[SIZE] = {}, ic2eq[SIZE] = {};
+    };
+
+#if JX11_KERNEL_SIMD
+    // With only one or two voices, the SIMD code is slower than rendering the
+    // voices one at a time. Every sample has to wait for the results of the
+    // previous one (the envelopes, filters and sine oscillators are recursive),
+    // and with so few voices that latency is the bottleneck, not the number of
+    // operations.
+    static constexpr size_t MIN_SIMD_LANES = 3;
+
+    // renderVoices for all lanes at once, including the oscillators.
+    template <bool stereo>
+    JX11_KERNEL_TARGET static void renderLanes(VoiceLanes& lanes, LaneState& state, const float* __restrict noise,
+                                               float* __restrict outputLeft, float* __restrict outputRight,
+                                               int sampleCount)
+    {
+        using namespace KernelMath;
+        const size_t count = lanes.count;
+
+        Float8 vLevel, vTarget, vMultiplier, vDecayMultiplier, vSustainLevel;
+        Float8 vA1, vA2, vA3, vIc1eq, vIc2eq;
+        load(vLevel, state.level);
+        load(vTarget, state.target);
+        load(vMultiplier, state.multiplier);
+        load(vDecayMultiplier, state.decayMultiplier);
+        load(vSustainLevel, state.sustainLevel);
+        load(vA1, state.a1);
+        load(vA2, state.a2);
+        load(vA3, state.a3);
+        load(vIc1eq, state.ic1eq);
+        load(vIc2eq, state.ic2eq);
+
+        alignas(64) float saw[SIZE] = {};
+        OscillatorLanes oscillators1 {}, oscillators2 {};
+        for (size_t lane = 0; lane < count; ++lane) {
+            saw[lane] = lanes.voices[lane]->saw;
+            loadLane(oscillators1, lane, lanes.voices[lane]->osc1);
+            loadLane(oscillators2, lane, lanes.voices[lane]->osc2);
+        }
+
+        Float8 vSaw;
+        load(vSaw, saw);
+
+        // Output of the voices for the current sample, after the envelope.
+        alignas(64) float output[SIZE];
+        OscillatorLanes osc1 = oscillators1, osc2 = oscillators2;
+
+        for (int sample = 0; sample < sampleCount; ++sample) {
+            Int8 active;
+            Float8 envelope = envelopeStep(vLevel, vTarget, vMultiplier, vDecayMultiplier, vSustainLevel, active);
+
+            // Voice::renderOscillators. A voice whose envelope is no longer
+            // active is not rendered and keeps its state.
+            Float8 sample1 = oscillatorStep<&Voice::osc1>(osc1, active, lanes);
+            Float8 sample2 = oscillatorStep<&Voice::osc2>(osc2, active, lanes);
+            vSaw = select(active, vSaw * 0.997f + sample1 - sample2, vSaw);
+
+            // Voices that stopped during the chunk keep filtering silence.
+            // That's harmless, as their filter is reset at the end of the block.
+            Float8 x = select(active, vSaw + noise[sample], Float8 {});
+            store(output, filterStep(x, vIc1eq, vIc2eq, vA1, vA2, vA3) * envelope);
+
+            mix<stereo>(lanes, output, outputLeft, outputRight, sample);
+        }
+
+        store(saw, vSaw);
+        oscillators1 = osc1;
+        oscillators2 = osc2;
+        for (size_t lane = 0; lane < count; ++lane) {
+            lanes.voices[lane]->saw = saw[lane];
+            storeLane(oscillators1, lane, lanes.voices[lane]->osc1);
+            storeLane(oscillators2, lane, lanes.voices[lane]->osc2);
+        }
+
+        store(state.level, vLevel);
+        store(state.target, vTarget);
+        store(state.multiplier, vMultiplier);
+        store(state.ic1eq, vIc1eq);
+        store(state.ic2eq, vIc2eq);
+    }
+
+    // advanceVoices for all lanes at once. This is renderLanes without the
+    // filters and the mixing.
+    JX11_KERNEL_TARGET static void advanceLanes(VoiceLanes& lanes, int sampleCount)
+    {
+        using namespace KernelMath;
+        const size_t count = lanes.count;
+
+        LaneState state;
+        alignas(64) float saw[SIZE] = {};
+        OscillatorLanes osc1 {}, osc2 {};
+        for (size_t lane = 0; lane < count; ++lane) {
+            const Voice& voice = *lanes.voices[lane];
+            state.level[lane] = voice.env.level;
+            state.target[lane] = voice.env.target;
+            state.multiplier[lane] = voice.env.multiplier;
+            state.decayMultiplier[lane] = voice.env.decayMultiplier;
+            state.sustainLevel[lane] = voice.env.sustainLevel;
+            saw[lane] = voice.saw;
+            loadLane(osc1, lane, voice.osc1);
+            loadLane(osc2, lane, voice.osc2);
+        }
+
+        Float8 vLevel, vTarget, vMultiplier, vDecayMultiplier, vSustainLevel, vSaw;
+        load(vLevel, state.level);
+        load(vTarget, state.target);
+        load(vMultiplier, state.multiplier);
+        load(vDecayMultiplier, state.decayMultiplier);
+        load(vSustainLevel, state.sustainLevel);
+        load(vSaw, saw);
+
+        for (int sample = 0; sample < sampleCount; ++sample) {
+            Int8 active;
+            envelopeStep(vLevel, vTarget, vMultiplier, vDecayMultiplier, vSustainLevel, active);
+            Float8 sample1 = oscillatorStep<&Voice::osc1>(osc1, active, lanes);
+            Float8 sample2 = oscillatorStep<&Voice::osc2>(osc2, active, lanes);
+            vSaw = select(active, vSaw * 0.997f + sample1 - sample2, vSaw);
+        }
+
+        store(state.level, vLevel);
+        store(state.target, vTarget);
+        store(state.multiplier, vMultiplier);
+        store(saw, vSaw);
+        for (size_t lane = 0; lane < count; ++lane) {
+            Voice& voice = *lanes.voices[lane];
+            voice.env.level = state.level[lane];
+            voice.env.target = state.target[lane];
+            voice.env.multiplier = state.multiplier[lane];
+            voice.saw = saw[lane];
+            storeLane(osc1, lane, voice.osc1);
+            storeLane(osc2, lane, voice.osc2);
+        }
+    }
+
+    // The state of one of the two oscillators, for all lanes.
+    struct OscillatorLanes
+    {
+        KernelMath::Float8 phase, phaseMax, inc, sin0, sin1, dsin, dc;
+    };
+
+    JX11_KERNEL_TARGET static void loadLane(OscillatorLanes& lanes, size_t lane, const Oscillator& osc)
+    {
+        lanes.phase[lane] = osc.phase;
+        lanes.phaseMax[lane] = osc.phaseMax;
+        lanes.inc[lane] = osc.inc;
+        lanes.sin0[lane] = osc.sin0;
+        lanes.sin1[lane] = osc.sin1;
+        lanes.dsin[lane] = osc.dsin;
+        lanes.dc[lane] = osc.dc;
+    }
+
+    JX11_KERNEL_TARGET static void storeLane(const OscillatorLanes& lanes, size_t lane, Oscillator& osc)
+    {
+        osc.phase = lanes.phase[lane];
+        osc.phaseMax = lanes.phaseMax[lane];
+        osc.inc = lanes.inc[lane];
+        osc.sin0 = lanes.sin0[lane];
+        osc.sin1 = lanes.sin1[lane];
+        osc.dsin = lanes.dsin[lane];
+        osc.dc = lanes.dc[lane];
+    }
+
+    // Oscillator::nextSample for the active lanes. Starting a new cycle needs
+    // std::sin and std::cos, but that only happens once per period. Those lanes
+    // copy their state back into the Oscillator and call nextSample on it.
+    template <Oscillator Voice::*member>
+    JX11_KERNEL_TARGET JX11_ALWAYS_INLINE static KernelMath::Float8 oscillatorStep(
+        OscillatorLanes& osc, const KernelMath::Int8& active, VoiceLanes& lanes)
+    {
+        using namespace KernelMath;
+
+        Float8 phase = osc.phase + osc.inc;
+        Int8 start = active & (phase <= PI_OVER_4);
+        Int8 update = active & ~start;
+
+        // Crossed the halfway point? Then count backwards to the next peak.
+        Int8 halfway = phase > osc.phaseMax;
+        phase = select(halfway, osc.phaseMax + osc.phaseMax - phase, phase);
+        Float8 inc = select(halfway, -osc.inc, osc.inc);
+
+        Float8 sinp = osc.dsin * osc.sin0 - osc.sin1;
+        Float8 output = sinp / phase - osc.dc;
+
+        osc.phase = select(update, phase, osc.phase);
+        osc.inc = select(update, inc, osc.inc);
+        osc.sin1 = select(update, osc.sin0, osc.sin1);
+        osc.sin0 = select(update, sinp, osc.sin0);
+
+        if (any(start)) {
+            // Work on a copy, so that the compiler can keep `osc` in registers.
+            OscillatorLanes copy = osc;
+            alignas(64) int starting[SIZE];
+            alignas(64) float outputs[SIZE];
+            store(starting, start);
+            store(outputs, output);
+            for (size_t lane = 0; lane < lanes.count; ++lane) {
+                if (starting[lane]) {
+                    Oscillator& oscillator = lanes.voices[lane]->*member;
+                    storeLane(copy, lane, oscillator);
+                    outputs[lane] = oscillator.nextSample();
+                    loadLane(copy, lane, oscillator);
+                }
+            }
+            osc = copy;
+            load(output, outputs);
+        }
+        return output;
+    }
+#endif
+
+    // Adds up the voices with their panning gains. This is done in voice order
+    // so the result does not depend on the instruction set.
+    template <bool stereo>
+    JX11_KERNEL_TARGET static void mix(const VoiceLanes& lanes, const float* __restrict output,
+                                       float* __restrict outputLeft, float* __restrict outputRight,
+                                       int sample)
+    {
+        const size_t count = lanes.count;
+        if constexpr (stereo) {
+            float sumLeft = 0.0f;
+            float sumRight = 0.0f;
+            for (size_t lane = 0; lane < count; ++lane) {
+                sumLeft += output[lane] * lanes.panLeft[lane];
+                sumRight += output[lane] * lanes.panRight[lane];
+            }
+            outputLeft[sample] = sumLeft;
+            outputRight[sample] = sumRight;
+        } else {
+            // With a mono output, each voice has a single gain that folds both
+            // panning amounts into one.
+            float sum = 0.0f;
+            for (size_t lane = 0; lane < count; ++lane) {
+                sum += output[lane] * lanes.panMono[lane];
+            }
+            outputLeft[sample] = sum;
+        }
+    }
+
+    // The envelopes and oscillators of renderVoices, without the filters and
+    // the output. A voice whose envelope is no longer active stays inactive
+    // for the rest of the chunk, so it can stop early.
+    JX11_KERNEL_TARGET static void advanceVoices(VoiceLanes& lanes, int sampleCount)
+    {
+#if JX11_KERNEL_SIMD
+        if (lanes.count >= MIN_SIMD_LANES) {
+            advanceLanes(lanes, sampleCount);
+            return;
+        }
+#endif
+        for (size_t lane = 0; lane < lanes.count; ++lane) {
+            Voice& voice = *lanes.voices[lane];
+            for (int sample = 0; sample < sampleCount && voice.env.isActive(); ++sample) {
+                voice.env.nextValue();
+                voice.renderOscillators(0.0f);
+            }
+        }
+    }
+
+    JX11_KERNEL_TARGET static void advanceEnvelopes(VoiceLanes& lanes, int sampleCount)
+    {
+        for (size_t lane = 0; lane < lanes.count; ++lane) {
+            Envelope& env = lanes.voices[lane]->env;
+            for (int sample = 0; sample < sampleCount && env.isActive(); ++sample) {
+                env.nextValue();
+            }
+        }
+    }
+
+    JX11_KERNEL_TARGET static void applyGain(float* __restrict buffer, const float* __restrict gain, int sampleCount)
+    {
+        for (int sample = 0; sample < sampleCount; ++sample) {
+            buffer[sample] *= gain[sample];
+        }
+    }
+};
+
+namespace JX11_KERNEL_NAMESPACE
+{
+
+using Impl = KernelImpl<JX11_KERNEL_LEVEL>;
+
+static const Kernels kernels {
+    JX11_KERNEL_LEVEL,
+    &Impl::renderVoices<false>,
+    &Impl::renderVoices<true>,
+    &Impl::applyGain,
+    &Impl::advanceVoices,
+    &Impl::advanceEnvelopes,
+};
+
+} // namespace JX11_KERNEL_NAMESPACE
+
+} // namespace JX11::Engine
\ No newline at end of file
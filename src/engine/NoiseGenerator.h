@@ -12,6 +12,11 @@ public:
         noiseSeed = 22222;
     }
 
+    void reset(unsigned int seed)
+    {
+        noiseSeed = seed;
+    }
+
     float nextValue()
     {
         // Generate the next integer pseudorandom number.
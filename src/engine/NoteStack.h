@@ -0,0 +1,160 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace JX11::Engine
+{
+
+// Decides which of the held keys the monophonic voice plays.
+enum class NotePriority
+{
+    last, // the most recently pressed key
+    low,  // the lowest held key
+    high  // the highest held key
+};
+
+// Keeps track of the keys that are held down in monophonic mode.
+//
+// There are only 128 MIDI notes and every key can be held only once, so the
+// stack has a fixed capacity and never allocates. The held notes form a
+// doubly-linked list in the order they were pressed, which makes push, pop and
+// removing any note O(1). A bitmask of the held notes is used to find the
+// lowest and highest note, also in O(1).
+class NoteStack
+{
+public:
+    static constexpr size_t CAPACITY = 128;
+
+    void reset()
+    {
+        held = {0, 0};
+        oldest = NONE;
+        newest = NONE;
+        count = 0;
+    }
+
+    bool isEmpty() const
+    {
+        return count == 0;
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    bool contains(size_t note) const
+    {
+        return note < CAPACITY && (held[note >> 6] & bit(note)) != 0;
+    }
+
+    // Adds a key that was pressed. If the key is already held (a duplicate
+    // note on), it is moved to the top of the stack.
+    void push(size_t note)
+    {
+        if (note >= CAPACITY) {
+            return;
+        }
+        remove(note);
+
+        auto n = static_cast<uint8_t>(note);
+        prev[n] = newest;
+        next[n] = NONE;
+        if (newest != NONE) {
+            next[newest] = n;
+        } else {
+            oldest = n;
+        }
+        newest = n;
+
+        held[n >> 6] |= bit(n);
+        ++count;
+    }
+
+    // Removes a key that was released. Does nothing if it was not held.
+    void remove(size_t note)
+    {
+        if (!contains(note)) {
+            return;
+        }
+
+        auto n = static_cast<uint8_t>(note);
+        if (prev[n] != NONE) {
+            next[prev[n]] = next[n];
+        } else {
+            oldest = next[n];
+        }
+        if (next[n] != NONE) {
+            prev[next[n]] = prev[n];
+        } else {
+            newest = prev[n];
+        }
+
+        held[n >> 6] &= ~bit(n);
+        --count;
+    }
+
+    // Removes and returns the most recently pressed key.
+    std::optional<size_t> pop()
+    {
+        if (count == 0) {
+            return std::nullopt;
+        }
+        size_t note = newest;
+        remove(note);
+        return note;
+    }
+
+    // The key that should be playing, or nothing if no keys are held.
+    std::optional<size_t> top(NotePriority priority) const
+    {
+        if (count == 0) {
+            return std::nullopt;
+        }
+
+        switch (priority) {
+        case NotePriority::low:
+            if (held[0] != 0) {
+                return static_cast<size_t>(std::countr_zero(held[0]));
+            }
+            return 64 + static_cast<size_t>(std::countr_zero(held[1]));
+
+        case NotePriority::high:
+            if (held[1] != 0) {
+                return 127 - static_cast<size_t>(std::countl_zero(held[1]));
+            }
+            return 63 - static_cast<size_t>(std::countl_zero(held[0]));
+
+        case NotePriority::last:
+        default:
+            return newest;
+        }
+    }
+
+private:
+    static constexpr uint8_t NONE = 0xFF;
+
+    static constexpr uint64_t bit(size_t note)
+    {
+        return uint64_t(1) << (note & 63);
+    }
+
+    // Links to the previous (older) and next (newer) held keys.
+    std::array<uint8_t, CAPACITY> prev {};
+    std::array<uint8_t, CAPACITY> next {};
+
+    // One bit for every MIDI note, set while the key is held.
+    std::array<uint64_t, 2> held {0, 0};
+
+    // Both ends of the list.
+    uint8_t oldest = NONE;
+    uint8_t newest = NONE;
+
+    size_t count = 0;
+};
+
+} // namespace JX11::Engine
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Kernels.h"
 #include <cmath>
 
 namespace JX11::Engine
@@ -32,6 +33,18 @@ public:
         dc = 0.0f;
     }
 
+    // Resets the oscillator so that its first pulse comes after `delay`
+    // samples. Until then the output is zero.
+    void reset(float delay)
+    {
+        reset();
+
+        // Count down to the peak, like in the second half of a cycle.
+        phase = PI * delay;
+        phaseMax = phase;
+        inc = -PI;
+    }
+
     // Creates a sinc pulse every `period` samples.
     float nextSample()
     {
@@ -133,6 +146,10 @@ public:
     }
 
 private:
+    // The render kernels process the state of several voices side by side.
+    template <KernelLevel>
+    friend struct KernelImpl;
+
     // Current phase, in samples times PI.
     float phase;
 
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "Parameters.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+
+namespace JX11::Engine
+{
+
+// Describes a plugin parameter without depending on JUCE, so that tools that
+// only link the engine can read and write the plugin's state.
+//
+// The ranges are those of the JUCE parameters in src/processor/Params.h, and
+// the conversions below work like juce::NormalisableRange and
+// juce::RangedAudioParameter. Keep the two in sync.
+struct ParameterInfo
+{
+    // The parameter ID, which is also the attribute name in the saved state.
+    const char* id;
+
+    // The field in Parameters. Choice parameters are stored in an int.
+    float Parameters::*floatField;
+    int Parameters::*intField;
+
+    float start;
+    float end;
+    float interval;      // 0 = continuous
+    float skew = 1.0f;   // 1 = linear
+    bool symmetricSkew = false;
+
+    // Turns a value in the range 0 to 1, as stored by the host, into a value
+    // between start and end, snapped to the interval.
+    float fromNormalized(float normalized) const
+    {
+        float proportion = std::clamp(normalized, 0.0f, 1.0f);
+        float value;
+        if (!symmetricSkew) {
+            if (skew != 1.0f && proportion > 0.0f) {
+                proportion = std::exp(std::log(proportion) / skew);
+            }
+            value = start + (end - start) * proportion;
+        } else {
+            float distanceFromMiddle = 2.0f * proportion - 1.0f;
+            if (skew != 1.0f && distanceFromMiddle != 0.0f) {
+                distanceFromMiddle = std::exp(std::log(std::abs(distanceFromMiddle)) / skew) *
+                                     (distanceFromMiddle < 0.0f ? -1.0f : 1.0f);
+            }
+            value = start + (end - start) / 2.0f * (1.0f + distanceFromMiddle);
+        }
+        return snap(value);
+    }
+
+    // The inverse of fromNormalized.
+    float toNormalized(float value) const
+    {
+        float proportion = std::clamp((snap(value) - start) / (end - start), 0.0f, 1.0f);
+        if (skew == 1.0f) {
+            return proportion;
+        }
+        if (!symmetricSkew) {
+            return std::pow(proportion, skew);
+        }
+        float distanceFromMiddle = 2.0f * proportion - 1.0f;
+        return (1.0f + std::pow(std::abs(distanceFromMiddle), skew) * (distanceFromMiddle < 0.0f ? -1.0f : 1.0f)) /
+               2.0f;
+    }
+
+    float snap(float value) const
+    {
+        if (interval > 0.0f) {
+            value = start + interval * std::floor((value - start) / interval + 0.5f);
+        }
+        return std::clamp(value, start, end);
+    }
+
+    float get(const Parameters& params) const
+    {
+        return (floatField != nullptr) ? params.*floatField : static_cast<float>(params.*intField);
+    }
+
+    void set(Parameters& params, float value) const
+    {
+        if (floatField != nullptr) {
+            params.*floatField = snap(value);
+        } else {
+            params.*intField = static_cast<int>(std::lround(snap(value)));
+        }
+    }
+};
+
+// All the plugin parameters, in the same order as in Params.h.
+inline const ParameterInfo PARAMETER_INFOS[] = {
+    {"oscMix", &Parameters::oscMix, nullptr, 0.0f, 100.0f, 0.0f},
+    {"oscTune", &Parameters::oscTune, nullptr, -24.0f, 24.0f, 1.0f},
+    {"oscFine", &Parameters::oscFine, nullptr, -50.0f, 50.0f, 0.1f, 0.3f, true},
+    {"glideMode", nullptr, &Parameters::glideMode, 0.0f, 2.0f, 1.0f},
+    {"glideRate", &Parameters::glideRate, nullptr, 0.0f, 100.0f, 1.0f},
+    {"glideBend", &Parameters::glideBend, nullptr, -36.0f, 36.0f, 0.01f, 0.4f, true},
+    {"filterFreq", &Parameters::filterFreq, nullptr, 0.0f, 100.0f, 0.1f},
+    {"filterReso", &Parameters::filterReso, nullptr, 0.0f, 100.0f, 1.0f},
+    {"filterEnv", &Parameters::filterEnv, nullptr, -100.0f, 100.0f, 0.1f},
+    {"filterLFO", &Parameters::filterLFO, nullptr, 0.0f, 100.0f, 1.0f},
+    {"filterVelocity", &Parameters::filterVelocity, nullptr, -100.0f, 100.0f, 1.0f},
+    {"filterAttack", &Parameters::filterAttack, nullptr, 0.0f, 100.0f, 1.0f},
+    {"filterDecay", &Parameters::filterDecay, nullptr, 0.0f, 100.0f, 1.0f},
+    {"filterSustain", &Parameters::filterSustain, nullptr, 0.0f, 100.0f, 1.0f},
+    {"filterRelease", &Parameters::filterRelease, nullptr, 0.0f, 100.0f, 1.0f},
+    {"envAttack", &Parameters::envAttack, nullptr, 0.0f, 100.0f, 1.0f},
+    {"envDecay", &Parameters::envDecay, nullptr, 0.0f, 100.0f, 1.0f},
+    {"envSustain", &Parameters::envSustain, nullptr, 0.0f, 100.0f, 1.0f},
+    {"envRelease", &Parameters::envRelease, nullptr, 0.0f, 100.0f, 1.0f},
+    {"lfoRate", &Parameters::lfoRate, nullptr, 0.0f, 1.0f, 0.0f},
+    {"vibrato", &Parameters::vibrato, nullptr, -100.0f, 100.0f, 0.1f},
+    {"noise", &Parameters::noise, nullptr, 0.0f, 100.0f, 1.0f},
+    {"octave", &Parameters::octave, nullptr, -2.0f, 2.0f, 1.0f},
+    {"tuning", &Parameters::tuning, nullptr, -100.0f, 100.0f, 0.1f},
+    {"polyMode", nullptr, &Parameters::polyMode, 0.0f, 1.0f, 1.0f},
+    {"outputLevel", &Parameters::outputLevel, nullptr, -24.0f, 6.0f, 0.1f},
+};
+
+inline constexpr size_t PARAMETER_COUNT = std::size(PARAMETER_INFOS);
+
+// Returns nullptr if there is no parameter with this ID.
+inline const ParameterInfo* findParameterInfo(std::string_view id)
+{
+    for (const auto& info : PARAMETER_INFOS) {
+        if (id == info.id) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace JX11::Engine
\ No newline at end of file
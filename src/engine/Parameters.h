@@ -0,0 +1,44 @@
+#pragma once
+
+namespace JX11::Engine
+{
+
+// The values of the plugin parameters, in the same units as the parameters
+// themselves (percentages, semitones, decibels, ...). The defaults are the
+// same as those of the plugin. Synth::applyParameters turns these into the
+// values that the engine uses for rendering.
+struct Parameters
+{
+    float oscMix = 0.0f;  // 0 to 100 %
+    float oscTune = -12.0f; // -24 to +24 semitones
+    float oscFine = 0.0f; // -50 to +50 cents
+
+    int glideMode = 0;       // 0 = off, 1 = legato, 2 = always
+    float glideRate = 35.0f; // 0 to 100 %
+    float glideBend = 0.0f;  // -36 to +36 semitones
+
+    float filterFreq = 100.0f;   // 0 to 100 %
+    float filterReso = 15.0f;    // 0 to 100 %
+    float filterEnv = 50.0f;     // -100 to +100 %
+    float filterLFO = 0.0f;      // 0 to 100 %
+    float filterVelocity = 0.0f; // -100 to +100 %, below -90 is off
+    float filterAttack = 0.0f;   // 0 to 100 %
+    float filterDecay = 30.0f;   // 0 to 100 %
+    float filterSustain = 0.0f;  // 0 to 100 %
+    float filterRelease = 25.0f; // 0 to 100 %
+
+    float envAttack = 0.0f;   // 0 to 100 %
+    float envDecay = 50.0f;   // 0 to 100 %
+    float envSustain = 100.0f; // 0 to 100 %
+    float envRelease = 30.0f; // 0 to 100 %
+
+    float lfoRate = 0.81f;   // 0 to 1
+    float vibrato = 0.0f;    // -100 to +100 %, negative is PWM
+    float noise = 0.0f;      // 0 to 100 %
+    float octave = 0.0f;     // -2 to +2
+    float tuning = 0.0f;     // -100 to +100 cents
+    int polyMode = 1;        // 0 = mono, 1 = poly
+    float outputLevel = 0.0f; // -24 to +6 dB
+};
+
+} // namespace JX11::Engine
\ No newline at end of file
@@ -0,0 +1,239 @@
+#pragma once
+
+#include "ParameterInfo.h"
+#include "Parameters.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+
+namespace JX11::Engine
+{
+
+// Reads and writes the plugin state without JUCE, for the plugin, the tools
+// and the C API. None of this allocates, so it can be used on a thread that
+// must not.
+//
+// BaseProcessor::getStateInformation saves the state in a compact binary
+// format. All numbers are little-endian:
+//
+//     offset 0   "JX11"
+//     offset 4   uint16 version, STATE_VERSION
+//     offset 6   uint16 number of values
+//     offset 8   float32 values
+//
+// The values are the normalized values of the parameters, in the order of
+// PARAMETER_INFOS. New parameters are only ever added at the end, so a state
+// from an older version has fewer values, and the parameters after them keep
+// their current value. The values past the ones that a version knows are
+// ignored. The version goes up when the meaning of the values changes.
+//
+// Older versions saved a <PluginState> element with the normalized value of
+// every parameter as an attribute, wrapped by
+// juce::AudioProcessor::copyXmlToBinary in an 8-byte header. That header is
+// the magic number 0x21324356 and the length of the text, both as
+// little-endian 32-bit integers, and the text is followed by a zero byte.
+// Those states are still read, with or without the header.
+
+inline constexpr uint16_t STATE_VERSION = 1;
+inline constexpr size_t STATE_HEADER_SIZE = 8;
+inline constexpr size_t STATE_SIZE = STATE_HEADER_SIZE + 4 * PARAMETER_COUNT;
+
+// The normalized values of all parameters, in the order of PARAMETER_INFOS.
+using StateValues = std::array<float, PARAMETER_COUNT>;
+
+namespace PluginStateDetail
+{
+
+inline uint32_t readUint32(const char* p)
+{
+    return uint8_t(p[0]) | uint8_t(p[1]) << 8 | uint8_t(p[2]) << 16 | uint32_t(uint8_t(p[3])) << 24;
+}
+
+inline void writeUint32(uint8_t* p, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) {
+        p[i] = uint8_t(value >> (8 * i));
+    }
+}
+
+// Stores a normalized value from a state, in either format. A value that is
+// not a finite number fails the state, and the others are clamped, so that a
+// damaged state can't put a parameter out of its range.
+inline bool storeValue(StateValues& values, size_t index, float value, const char*& error)
+{
+    if (!std::isfinite(value)) {
+        error = "invalid value";
+        return false;
+    }
+    values[index] = std::clamp(value, 0.0f, 1.0f);
+    return true;
+}
+
+inline bool readBinaryState(std::string_view data, StateValues& values, const char*& error)
+{
+    if (data.size() < STATE_HEADER_SIZE) {
+        error = "truncated state";
+        return false;
+    }
+    const uint32_t versionAndCount = readUint32(data.data() + 4);
+    const auto version = uint16_t(versionAndCount);
+    const size_t count = versionAndCount >> 16;
+    // Version 0 was never written, so the data is damaged.
+    if (version == 0) {
+        error = "damaged state";
+        return false;
+    }
+    if (version > STATE_VERSION) {
+        error = "state from a newer version";
+        return false;
+    }
+    if (data.size() < STATE_HEADER_SIZE + 4 * count) {
+        error = "truncated state";
+        return false;
+    }
+
+    const size_t known = std::min(count, PARAMETER_COUNT);
+    for (size_t i = 0; i < known; ++i) {
+        const uint32_t bits = readUint32(data.data() + STATE_HEADER_SIZE + 4 * i);
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        if (!storeValue(values, i, value, error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline bool readXmlState(std::string_view data, StateValues& values, const char*& error)
+{
+    if (data.size() >= 8 && data.substr(0, 4) == "VC2!") {
+        data = data.substr(8, readUint32(data.data() + 4));
+    }
+
+    size_t position = data.find("<PluginState");
+    if (position == std::string_view::npos) {
+        error = "no <PluginState> element";
+        return false;
+    }
+    position += std::strlen("<PluginState");
+
+    // The attributes are name="value" pairs up to the end of the tag. The
+    // values are numbers, so there are no entities to decode.
+    while (true) {
+        position = data.find_first_not_of(" \t\r\n", position);
+        if (position == std::string_view::npos) {
+            error = "unterminated <PluginState> element";
+            return false;
+        }
+        if (data[position] == '/' || data[position] == '>') {
+            return true;
+        }
+
+        size_t equals = data.find('=', position);
+        if (equals == std::string_view::npos || equals + 1 >= data.size()) {
+            error = "malformed attribute";
+            return false;
+        }
+        std::string_view name = data.substr(position, equals - position);
+        while (!name.empty() && (name.back() == ' ' || name.back() == '\t')) {
+            name.remove_suffix(1);
+        }
+
+        size_t open = data.find_first_of("\"'", equals + 1);
+        size_t close = (open == std::string_view::npos) ? open : data.find(data[open], open + 1);
+        if (close == std::string_view::npos) {
+            error = "malformed attribute";
+            return false;
+        }
+
+        if (const auto* info = findParameterInfo(name)) {
+            // strtof needs a terminated string. Longer values than this are
+            // not numbers that JUCE writes.
+            char value[64];
+            const size_t length = std::min(close - open - 1, sizeof(value) - 1);
+            std::memcpy(value, data.data() + open + 1, length);
+            value[length] = '\0';
+            char* end;
+            float number = std::strtof(value, &end);
+            if (end == value) {
+                number = NAN;
+            }
+            if (!storeValue(values, size_t(info - PARAMETER_INFOS), number, error)) {
+                return false;
+            }
+        }
+        position = close + 1;
+    }
+}
+
+} // namespace PluginStateDetail
+
+// The normalized values of the plain parameter values.
+inline StateValues getStateValues(const Parameters& params)
+{
+    StateValues values;
+    for (size_t i = 0; i < PARAMETER_COUNT; ++i) {
+        values[i] = PARAMETER_INFOS[i].toNormalized(PARAMETER_INFOS[i].get(params));
+    }
+    return values;
+}
+
+// Reads a state in either format into values. Parameters that are missing
+// from the state keep the value they have in values. On failure, error
+// points to a static message and values may have been partly changed.
+inline bool readStateValues(std::string_view data, StateValues& values, const char*& error)
+{
+    if (data.size() >= 4 && data.substr(0, 4) == "JX11") {
+        return PluginStateDetail::readBinaryState(data, values, error);
+    }
+    return PluginStateDetail::readXmlState(data, values, error);
+}
+
+// Same as readStateValues, but for the plain parameter values.
+inline bool readPluginState(std::string_view data, Parameters& params, const char*& error)
+{
+    StateValues values = getStateValues(params);
+    const StateValues before = values;
+    if (!readStateValues(data, values, error)) {
+        return false;
+    }
+    // Only touch the parameters that are in the state, so that the others
+    // don't go through a round trip of normalizing.
+    for (size_t i = 0; i < PARAMETER_COUNT; ++i) {
+        if (values[i] != before[i]) {
+            PARAMETER_INFOS[i].set(params, PARAMETER_INFOS[i].fromNormalized(values[i]));
+        }
+    }
+    return true;
+}
+
+// Writes the state in the binary format. Returns STATE_SIZE. If that is more
+// than capacity, nothing is written.
+inline size_t writeStateValues(const StateValues& values, void* buffer, size_t capacity)
+{
+    if (STATE_SIZE > capacity) {
+        return STATE_SIZE;
+    }
+    auto* out = static_cast<uint8_t*>(buffer);
+    std::memcpy(out, "JX11", 4);
+    PluginStateDetail::writeUint32(out + 4, STATE_VERSION | uint32_t(PARAMETER_COUNT) << 16);
+    for (size_t i = 0; i < PARAMETER_COUNT; ++i) {
+        uint32_t bits;
+        std::memcpy(&bits, &values[i], sizeof(bits));
+        PluginStateDetail::writeUint32(out + STATE_HEADER_SIZE + 4 * i, bits);
+    }
+    return STATE_SIZE;
+}
+
+// Same as writeStateValues, for the plain parameter values.
+inline size_t writePluginState(const Parameters& params, void* buffer, size_t capacity)
+{
+    return writeStateValues(getStateValues(params), buffer, capacity);
+}
+
+} // namespace JX11::Engine
\ No newline at end of file
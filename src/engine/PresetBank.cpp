@@ -0,0 +1,14 @@
+#include "PresetBank.h"
+
+namespace JX11::Engine
+{
+
+PresetBank::PresetBank(const Synth& synth, const std::vector<Entry>& entries)
+{
+    presets.reserve(entries.size());
+    for (const auto& entry : entries) {
+        presets.push_back({entry.name, entry.params, synth.computeCoefficientSets(entry.params)});
+    }
+}
+
+} // namespace JX11::Engine
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "Synth.h"
+#include <string>
+#include <vector>
+
+namespace JX11::Engine
+{
+
+// A list of presets, decoded up front for one synth: the parameters and the
+// coefficients that Synth::applyCoefficients needs, for every quality level.
+// Switching the synth to a preset of the bank, or morphing between two of
+// them with Synth::setMorph, doesn't calculate or allocate anything, so it can
+// be done on the audio thread, like for a MIDI program change.
+//
+// The bank doesn't change once it has been built. The coefficients depend on
+// the sample rate, so build a new bank when that changes.
+class PresetBank
+{
+public:
+    struct Entry
+    {
+        std::string name;
+        Parameters params;
+    };
+
+    struct Preset
+    {
+        std::string name;
+        Parameters params;
+        Synth::CoefficientSets coefficients;
+    };
+
+    // Decodes the presets for the sample rate that the synth has now.
+    // Allocates, so don't build a bank on the audio thread.
+    PresetBank(const Synth& synth, const std::vector<Entry>& entries);
+
+    size_t size() const { return presets.size(); }
+    const Preset& operator[](size_t index) const { return presets[index]; }
+    size_t indexOf(const Preset& preset) const { return size_t(&preset - presets.data()); }
+
+private:
+    std::vector<Preset> presets;
+};
+
+} // namespace JX11::Engine
\ No newline at end of file
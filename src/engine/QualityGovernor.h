@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iterator>
+
+namespace JX11::Engine
+{
+
+// What the synth gives up at each quality level, see Synth::setQualityLevel.
+// Level 0 is full quality; every next level is cheaper than the one before.
+struct QualitySettings
+{
+    // Max number of voices in polyphonic mode.
+    size_t maxVoices;
+
+    // Released voices whose envelope is below this level are faded out in a
+    // few milliseconds instead of finishing their release. 0 = never.
+    float fastReleaseBelow;
+
+    // How often the LFO and the other modulations are updated, in samples.
+    int controlPeriod;
+};
+
+inline constexpr QualitySettings QUALITY_LEVELS[] = {
+    {8, 0.0f, 32},  // full quality
+    {8, 0.01f, 32}, // cut the tails of released voices below -40 dB
+    {8, 0.05f, 64}, // below -26 dB, and update the modulations half as often
+    {6, 0.1f, 64},  // 6 voices
+    {4, 1.0f, 128}, // 4 voices, no release tails at all
+};
+
+inline constexpr int QUALITY_LEVEL_COUNT = static_cast<int>(std::size(QUALITY_LEVELS));
+
+// Picks the quality level when the CPU can't keep up with the audio.
+//
+// After every block, the caller reports how long rendering took and how long
+// the block lasts. The governor tracks the load, the ratio of the two, with a
+// smoothing filter. When the load stays high, it goes one level down in
+// quality at a time, giving each step some time to take effect. Once the load
+// has been low for a while, it goes back up one level at a time. The gap
+// between the two thresholds and the hold times keep it from flipping back
+// and forth.
+class QualityGovernor
+{
+public:
+    // Load above which the quality is reduced.
+    float highLoad = 0.75f;
+
+    // Load below which the quality is restored.
+    float lowLoad = 0.4f;
+
+    // Time to wait after changing the level before reducing it further.
+    float reduceHoldSeconds = 0.05f;
+
+    // How long the load must stay low before the quality goes back up.
+    float restoreHoldSeconds = 1.0f;
+
+    void reset()
+    {
+        level = 0;
+        load = 0.0f;
+        secondsSinceChange = 0.0f;
+        secondsBelowLow = 0.0f;
+    }
+
+    // Call after every block. Returns the level to use from the next block on.
+    int update(double renderSeconds, double blockSeconds)
+    {
+        if (blockSeconds <= 0.0) {
+            return level;
+        }
+
+        const auto duration = static_cast<float>(blockSeconds);
+        const auto blockLoad = static_cast<float>(renderSeconds / blockSeconds);
+
+        // One-pole filter with a time constant of about 100 ms.
+        const float coefficient = 1.0f - std::exp(-duration / 0.1f);
+        load += coefficient * (blockLoad - load);
+
+        secondsSinceChange += duration;
+        secondsBelowLow = (load < lowLoad) ? secondsBelowLow + duration : 0.0f;
+
+        // A block that missed its deadline is a dropout, so don't wait for
+        // the smoothed load to catch up.
+        const bool overloaded = load > highLoad || blockLoad > 1.0f;
+
+        if (overloaded && level < QUALITY_LEVEL_COUNT - 1 && secondsSinceChange >= reduceHoldSeconds) {
+            ++level;
+            secondsSinceChange = 0.0f;
+            secondsBelowLow = 0.0f;
+        } else if (!overloaded && level > 0 && secondsBelowLow >= restoreHoldSeconds) {
+            --level;
+            secondsSinceChange = 0.0f;
+            secondsBelowLow = 0.0f;
+        }
+        return level;
+    }
+
+    int getLevel() const { return level; }
+
+    // The smoothed ratio of render time to real time.
+    float getLoad() const { return load; }
+
+private:
+    int level = 0;
+    float load = 0.0f;
+    float secondsSinceChange = 0.0f;
+    float secondsBelowLow = 0.0f;
+};
+
+} // namespace JX11::Engine
\ No newline at end of file
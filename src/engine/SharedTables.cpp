@@ -0,0 +1,53 @@
+#include "SharedTables.h"
+#include <map>
+#include <mutex>
+
+namespace JX11::Engine
+{
+
+namespace
+{
+
+std::mutex storeMutex;
+
+// The tables in use, by sample rate. An entry whose tables have been freed
+// is replaced the next time that sample rate is asked for.
+std::map<float, std::weak_ptr<const SharedTables>> store;
+
+} // namespace
+
+std::shared_ptr<const SharedTables> SharedTables::get(float sampleRate)
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
+    auto& entry = store[sampleRate];
+    auto tables = entry.lock();
+    if (tables == nullptr) {
+        tables = std::make_shared<const SharedTables>(sampleRate);
+        entry = tables;
+    }
+    return tables;
+}
+
+size_t SharedTables::getLiveCount()
+{
+    std::lock_guard<std::mutex> lock(storeMutex);
+    size_t count = 0;
+    for (const auto& [sampleRate, entry] : store) {
+        count += entry.expired() ? 0 : 1;
+    }
+    return count;
+}
+
+SharedTables::SharedTables(float sampleRate_) : sampleRate(sampleRate_), inverseSampleRate(1.0f / sampleRate_)
+{
+    for (size_t i = 0; i < ENVELOPE_STEPS; ++i) {
+        envelopeMultipliers[i] = computeEnvelopeMultiplier(inverseSampleRate, float(i));
+    }
+    for (size_t note = 0; note < NOTES; ++note) {
+        for (size_t voice = 0; voice < VOICES; ++voice) {
+            notePitches[note][voice] = computeNotePitch(float(note), float(voice));
+        }
+    }
+}
+
+} // namespace JX11::Engine
\ No newline at end of file
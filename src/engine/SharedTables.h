@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+
+namespace JX11::Engine
+{
+
+// Oscillator drift, in semitones per voice.
+inline constexpr float ANALOG = 0.002f;
+
+// The coefficient of the one-pole filter of an envelope stage, for a
+// parameter value from 0 to 100. For the amplitude envelope, inverseRate is
+// one over the sample rate.
+inline float computeEnvelopeMultiplier(float inverseRate, float value)
+{
+    return std::exp(-inverseRate * std::exp(5.5f - 0.075f * value));
+}
+
+// The period of a note relative to the master tuning, with the analog drift
+// added.
+inline float computeNotePitch(float note, float drift)
+{
+    return std::exp(-0.05776226505f * (note + ANALOG * drift));
+}
+
+// Lookup tables that depend only on the sample rate. They are read-only once
+// built, so every synth at the same sample rate shares one copy: with
+// hundreds of instances in a process, that's one copy in the cache instead of
+// one per instance.
+//
+// The tables are built on first use by get(), and freed when the last synth
+// that uses them lets go. The values are computed with the same functions as
+// above, so a lookup gives exactly the same result as the calculation.
+class SharedTables
+{
+public:
+    // Returns the tables for this sample rate, and builds them if no synth is
+    // using them yet. Thread-safe, but it locks and may allocate, so don't
+    // call it on the audio thread.
+    static std::shared_ptr<const SharedTables> get(float sampleRate);
+
+    // Number of sets of tables that are in use, over all sample rates.
+    static size_t getLiveCount();
+
+    explicit SharedTables(float sampleRate);
+
+    float getSampleRate() const { return sampleRate; }
+
+    // Same as computeEnvelopeMultiplier(1 / sampleRate, value). The parameter
+    // steps are whole numbers, so this is a lookup unless the value was set
+    // some other way than through the plugin.
+    float getEnvelopeMultiplier(float value) const
+    {
+        if (value >= 0.0f && value <= float(ENVELOPE_STEPS - 1) && value == std::floor(value)) {
+            return envelopeMultipliers[size_t(value)];
+        }
+        return computeEnvelopeMultiplier(inverseSampleRate, value);
+    }
+
+    // Same as computeNotePitch(note, voice), for the drift of a voice outside
+    // deterministic mode.
+    float getNotePitch(size_t note, size_t voice) const { return notePitches[note][voice]; }
+
+    static constexpr size_t NOTES = 128;
+    static constexpr size_t VOICES = 8;
+    static constexpr size_t ENVELOPE_STEPS = 101;
+
+private:
+    float sampleRate;
+    float inverseSampleRate;
+    std::array<float, ENVELOPE_STEPS> envelopeMultipliers;
+    std::array<std::array<float, VOICES>, NOTES> notePitches;
+};
+
+} // namespace JX11::Engine
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+namespace JX11::Engine
+{
+
+// Linear ramp towards a target value, to avoid zipper noise when a parameter
+// changes. This behaves the same as juce::LinearSmoothedValue, so the engine
+// doesn't need JUCE.
+class LinearSmoother
+{
+public:
+    // Sets the length of the ramp. Stops any ramp in progress.
+    void reset(double sampleRate, double rampLengthInSeconds)
+    {
+        stepsToTarget = static_cast<int>(rampLengthInSeconds * sampleRate);
+        setCurrentAndTargetValue(target);
+    }
+
+    // Jumps to the new value without a ramp.
+    void setCurrentAndTargetValue(float newValue)
+    {
+        target = currentValue = newValue;
+        countdown = 0;
+    }
+
+    // Starts a ramp from the current value to the new value.
+    void setTargetValue(float newValue)
+    {
+        if (newValue == target) {
+            return;
+        }
+        if (stepsToTarget <= 0) {
+            setCurrentAndTargetValue(newValue);
+            return;
+        }
+        target = newValue;
+        countdown = stepsToTarget;
+        step = (target - currentValue) / static_cast<float>(countdown);
+    }
+
+    float getNextValue()
+    {
+        if (!isSmoothing()) {
+            return target;
+        }
+        --countdown;
+        if (isSmoothing()) {
+            currentValue += step;
+        } else {
+            currentValue = target;
+        }
+        return currentValue;
+    }
+
+    bool isSmoothing() const { return countdown > 0; }
+    float getCurrentValue() const { return currentValue; }
+    float getTargetValue() const { return target; }
+
+private:
+    float currentValue = 0.0f;
+    float target = 0.0f;
+    float step = 0.0f;
+    int countdown = 0;
+    int stepsToTarget = 0;
+};
+
+} // namespace JX11::Engine
\ No newline at end of file
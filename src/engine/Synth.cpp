@@ -1,19 +1,48 @@
 #include "Synth.h"
+#include "Trace.h"
+#include <cmath>
 #include <limits>
 
 namespace JX11::Engine
 {
 
-static const float ANALOG = 0.002f; // oscillator drift
-
 // Special "note number" that says this voice is now kept alive by the sustain
 // pedal being pressed down. As soon as the pedal is released, this voice will
 // fade out.
 static const size_t SUSTAIN = std::numeric_limits<size_t>::max();
 
+// Mixes up the bits of x. This is the finalizer of MurmurHash3.
+static uint32_t hash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x85EBCA6Bu;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35u;
+    x ^= x >> 16;
+    return x;
+}
+
+// Same as juce::Decibels::decibelsToGain.
+static float decibelsToGain(float decibels)
+{
+    return decibels > -100.0f ? std::pow(10.0f, decibels * 0.05f) : 0.0f;
+}
+
 void Synth::allocateResources(double sampleRate_, int /*samplesPerBlock*/)
 {
     sampleRate = static_cast<float>(sampleRate_);
+    kernels = &selectKernels();
+
+    // The instruction set in the trace: a counter with the KernelLevel, 0 =
+    // scalar, 1 = avx2, 2 = avx512, and the rest of this as a span named
+    // after it.
+    JX11_TRACE_COUNTER("kernel level", int(kernels->level));
+    JX11_TRACE_SPAN(getKernelName(kernels->level));
+
+    tables = SharedTables::get(sampleRate);
+
+    // Time constant of 3 ms.
+    fastReleaseMultiplier = std::exp(-1.0f / (0.003f * sampleRate));
 
     for (auto& voice : voices) {
         voice.filter.sampleRate = sampleRate;
@@ -22,7 +51,7 @@ void Synth::allocateResources(double sampleRate_, int /*samplesPerBlock*/)
 
 void Synth::deallocateResources()
 {
-    // do nothing
+    tables.reset();
 }
 
 void Synth::reset()
@@ -32,7 +61,13 @@ void Synth::reset()
         voice.reset();
     }
 
-    noiseGen.reset();
+    if (seed.has_value()) {
+        noiseGen.reset(hash(*seed));
+    } else {
+        noiseGen.reset();
+    }
+    heldNotes.reset();
+    noteCount = 0;
 
     // These variables are changed by MIDI CC, reset to defaults.
     pitchBend = 1.0f;
@@ -51,10 +86,345 @@ void Synth::reset()
     outputLevelSmoother.reset(sampleRate, 0.05);
 }
 
-void Synth::render(float** outputBuffers, int sampleCount)
+void Synth::applyParameters(const Parameters& params)
 {
-    float* outputBufferLeft = outputBuffers[0];
-    float* outputBufferRight = outputBuffers[1];
+    // The plugin calls this from the audio callback whenever any of the
+    // parameters have changed. Here, we simply recalculate everything when
+    // this happens. This function is called at most once per audio block.
+    // It could be optimized to recalculate only the things that have changed,
+    // but doing the bookkeeping for that also has a cost. Still, it might be
+    // worth it for parameters that are heavily automated.
+    applyCoefficients(computeCoefficients(params));
+}
+
+Synth::Coefficients Synth::computeCoefficients(const Parameters& params) const
+{
+    return computeCoefficients(params, controlPeriod);
+}
+
+Synth::CoefficientSets Synth::computeCoefficientSets(const Parameters& params) const
+{
+    CoefficientSets sets;
+    for (size_t level = 0; level < sets.size(); ++level) {
+        sets[level] = computeCoefficients(params, QUALITY_LEVELS[level].controlPeriod);
+    }
+    return sets;
+}
+
+Synth::Coefficients Synth::computeCoefficients(const Parameters& params, int period) const
+{
+    Coefficients c;
+    c.params = params;
+    c.controlPeriod = period;
+
+    float inverseSampleRate = 1.0f / sampleRate;
+
+    // The envelope is implemented using a simple one-pole filter, which creates
+    // an analog-style exponential curve. The formulas below calculate the filter
+    // coefficients for the attack, decay, and release stages.
+    c.envAttack = tables->getEnvelopeMultiplier(params.envAttack);
+    c.envDecay = tables->getEnvelopeMultiplier(params.envDecay);
+
+    c.envSustain = params.envSustain / 100.0f;
+
+    if (params.envRelease < 1.0f) {
+        c.envRelease = 0.75f; // extra fast release
+    } else {
+        c.envRelease = tables->getEnvelopeMultiplier(params.envRelease);
+    }
+
+    // How much noise to mix into the signal. This is a parabolic curve,
+    // similar to creating a parameter with skew = 0.5.
+    float noiseAmount = params.noise / 100.0f;
+    c.noiseMix = noiseAmount * noiseAmount * 0.06f;
+
+    // How much to mix osc2 into the output. This is a value between 0 and 1.
+    c.oscMix = params.oscMix / 100.0f;
+
+    // Calculate the multiplication factor for detuning oscillator 2. This is
+    // the same as 2^(N/12) where N is the number of (fractional) semitones.
+    // This value will be multiplied with the oscillator period, which is why
+    // detuning down is greater than 1, as lowering the pitch means the period
+    // becomes longer. Vice versa for going up in pitch.
+    float semi = params.oscTune;
+    float cent = params.oscFine;
+    c.detune = std::pow(1.059463094359f, -semi - 0.01f * cent);
+
+    // Master tuning. See the book for a full explanation of what happens here.
+    float octave = params.octave; // -2 to +2
+    float tuning = params.tuning; // -100 to +100
+    float tuneInSemi = -36.3763f - 12.0f * octave - tuning / 100.0f;
+    c.tune = sampleRate * std::exp(0.05776226505f * tuneInSemi);
+
+    // Mono or poly?
+    c.numVoices = (params.polyMode == 0) ? 1 : MAX_VOICES;
+
+    // Convert decibels to gain. Use a smoother for this parameter.
+    c.outputLevel = decibelsToGain(params.outputLevel);
+
+    // Filter velocity sensitivity, a value between -0.05 and +0.05.
+    // If disabled, the velocity is completely ignored.
+    float filterVelocity = params.filterVelocity;
+    if (filterVelocity < -90.0f) {
+        c.velocitySensitivity = 0.0f; // turn off velocity
+        c.ignoreVelocity = true;
+    } else {
+        c.velocitySensitivity = 0.0005f * filterVelocity;
+        c.ignoreVelocity = false;
+    }
+
+    // Use a lower update rate for the glide and filter envelope, 32 times
+    // (= LFO_MAX) slower than the sample rate. This is slower still at the
+    // lower quality levels.
+    const float inverseUpdateRate = inverseSampleRate * static_cast<float>(period);
+
+    // The LFO rate is an exponentional curve that maps the 0 - 1 parameter
+    // value to 0.018 Hz - 20.09 Hz. Use this to calculate the phase increment
+    // for a sine wave running at 1/32th the sample rate.
+    float lfoRate = std::exp(7.0f * params.lfoRate - 4.0f);
+    c.lfoInc = lfoRate * inverseUpdateRate * TWO_PI;
+
+    // The vibrato parameter is a parabolic curve going from 0.0 for 0% up to
+    // 0.05 for 100%. You can choose between PWM mode (to the left) and vibrato
+    // mode (to the right). These values are used as the amplitude of the LFO
+    // sine wave that modulates the oscillator periods.
+    float vibratoAmount = params.vibrato / 200.0f;
+    c.vibrato = 0.2f * vibratoAmount * vibratoAmount;
+    c.pwmDepth = c.vibrato;
+    if (vibratoAmount < 0.0f) {
+        c.vibrato = 0.0f;
+    }
+
+    // Need to glide?
+    c.glideMode = params.glideMode;
+
+    // Just like the envelope, glide is implemented using a one-pole filter
+    // that is updated every 32 samples. Here we set the filter coefficient.
+    // A smaller coefficient means the glide takes longer.
+    if (params.glideRate < 2.0f) {
+        c.glideRate = 1.0f; // no glide
+    } else {
+        c.glideRate = 1.0f - std::exp(-inverseUpdateRate * std::exp(6.0f - 0.07f * params.glideRate));
+    }
+
+    // Glide bend goes from -36 semitones to +36 semitones.
+    c.glideBend = params.glideBend;
+
+    // The filter's cutoff is set using the note's pitch and velocity. This
+    // parameter shifts that cutoff up or down. Values are from -1.5 to 6.5.
+    c.filterKeyTracking = 0.08f * params.filterFreq - 1.5f;
+
+    // Filter Q. Starts at 1 and goes up to 20, approximately.
+    float filterReso = params.filterReso / 100.0f;
+    c.filterQ = std::exp(3.0f * filterReso);
+
+    // Self-oscillation:
+    // synth.filterQ = 1.0f / ((1.0f - filterReso + 1e-9) * (1.0f - filterReso + 1e-9));
+
+    // When using both oscillators, and/or noise or large filter resonance,
+    // the overall gain increases. This variable tries to compensate for that.
+    // There is also a manual output level control, as the total volume also
+    // depends on how many notes are playing, their envelopes, velocities, etc.
+    c.volumeTrim = 0.0008f * (3.2f - c.oscMix - 25.0f * c.noiseMix) * (1.5f - 0.5f * filterReso);
+
+    // Filter LFO intensity. Parabolic curve from 0 to 2.5.
+    float filterLFO = params.filterLFO / 100.0f;
+    c.filterLFODepth = 2.5f * filterLFO * filterLFO;
+
+    // The filter envelope uses the same formulas as the amplitude envelope
+    // but runs 32 times slower, at the same update rate as the LFO.
+    c.filterAttack = computeEnvelopeMultiplier(inverseUpdateRate, params.filterAttack);
+    c.filterDecay = computeEnvelopeMultiplier(inverseUpdateRate, params.filterDecay);
+
+    float filterSustainAmount = params.filterSustain / 100.0f;
+    c.filterSustain = filterSustainAmount * filterSustainAmount;
+
+    c.filterRelease = computeEnvelopeMultiplier(inverseUpdateRate, params.filterRelease);
+
+    // Filter envelope intensity. Linear curve from -6.0 to +6.0.
+    c.filterEnvDepth = 0.06f * params.filterEnv;
+
+    return c;
+}
+
+void Synth::applyCoefficients(const Coefficients& c)
+{
+    morphing = false;
+
+    // The coefficients for the glide, LFO and filter envelope depend on the
+    // control period, which may have changed since they were calculated.
+    if (c.controlPeriod != controlPeriod) {
+        setCoefficients(computeCoefficients(c.params));
+    } else {
+        setCoefficients(c);
+    }
+}
+
+void Synth::applyCoefficients(const CoefficientSets& sets)
+{
+    morphing = false;
+    setCoefficients(sets[size_t(qualityLevel)]);
+}
+
+void Synth::setCoefficients(const Coefficients& c)
+{
+    coefficients = c;
+    noiseMix = c.noiseMix;
+    envAttack = c.envAttack;
+    envDecay = c.envDecay;
+    envSustain = c.envSustain;
+    envRelease = c.envRelease;
+    oscMix = c.oscMix;
+    detune = c.detune;
+    tune = c.tune;
+
+    // Switching to mono: from now on only voice 0 plays, and the note-on and
+    // note-off code no longer looks at the others. Fade them out once here,
+    // including the notes held by the sustain pedal, or they would keep
+    // ringing forever.
+    if (c.numVoices == 1 && numVoices > 1) {
+        for (size_t v = 1; v < MAX_VOICES; ++v) {
+            voices[v].release();
+            voices[v].note = std::nullopt;
+        }
+    }
+    numVoices = c.numVoices;
+    outputLevelSmoother.setTargetValue(c.outputLevel);
+    velocitySensitivity = c.velocitySensitivity;
+    ignoreVelocity = c.ignoreVelocity;
+    lfoInc = c.lfoInc;
+    vibrato = c.vibrato;
+    pwmDepth = c.pwmDepth;
+    glideMode = c.glideMode;
+    glideRate = c.glideRate;
+    glideBend = c.glideBend;
+    filterKeyTracking = c.filterKeyTracking;
+    filterQ = c.filterQ;
+    volumeTrim = c.volumeTrim;
+    filterLFODepth = c.filterLFODepth;
+    filterAttack = c.filterAttack;
+    filterDecay = c.filterDecay;
+    filterSustain = c.filterSustain;
+    filterRelease = c.filterRelease;
+    filterEnvDepth = c.filterEnvDepth;
+}
+
+void Synth::setMorph(const CoefficientSets& from, const CoefficientSets& to, float amount)
+{
+    morphFrom = from;
+    morphTo = to;
+    morphing = true;
+    morphTarget = std::clamp(amount, 0.0f, 1.0f);
+    morphAmount = morphTarget;
+    updateMorph();
+}
+
+void Synth::setMorphAmount(float amount)
+{
+    morphTarget = std::clamp(amount, 0.0f, 1.0f);
+}
+
+// Mixes two values for a morph: a straight line for the continuous ones,
+// the nearest of the two for the others.
+static float mix(float a, float b, float amount)
+{
+    return a + (b - a) * amount;
+}
+
+template <typename T>
+static T nearest(T a, T b, float amount)
+{
+    return amount < 0.5f ? a : b;
+}
+
+void Synth::updateMorph()
+{
+    // The sets for the quality level, so they are for this control period.
+    const Coefficients& a = morphFrom[size_t(qualityLevel)];
+    const Coefficients& b = morphTo[size_t(qualityLevel)];
+    const float t = morphAmount;
+
+    // At the ends, use the sets themselves, so that the synth sounds exactly
+    // like either preset, without the rounding of the mix.
+    if (t == 0.0f) {
+        setCoefficients(a);
+        return;
+    }
+    if (t == 1.0f) {
+        setCoefficients(b);
+        return;
+    }
+
+    Coefficients c;
+    c.params.oscMix = mix(a.params.oscMix, b.params.oscMix, t);
+    c.params.oscTune = mix(a.params.oscTune, b.params.oscTune, t);
+    c.params.oscFine = mix(a.params.oscFine, b.params.oscFine, t);
+    c.params.glideMode = nearest(a.params.glideMode, b.params.glideMode, t);
+    c.params.glideRate = mix(a.params.glideRate, b.params.glideRate, t);
+    c.params.glideBend = mix(a.params.glideBend, b.params.glideBend, t);
+    c.params.filterFreq = mix(a.params.filterFreq, b.params.filterFreq, t);
+    c.params.filterReso = mix(a.params.filterReso, b.params.filterReso, t);
+    c.params.filterEnv = mix(a.params.filterEnv, b.params.filterEnv, t);
+    c.params.filterLFO = mix(a.params.filterLFO, b.params.filterLFO, t);
+    c.params.filterVelocity = mix(a.params.filterVelocity, b.params.filterVelocity, t);
+    c.params.filterAttack = mix(a.params.filterAttack, b.params.filterAttack, t);
+    c.params.filterDecay = mix(a.params.filterDecay, b.params.filterDecay, t);
+    c.params.filterSustain = mix(a.params.filterSustain, b.params.filterSustain, t);
+    c.params.filterRelease = mix(a.params.filterRelease, b.params.filterRelease, t);
+    c.params.envAttack = mix(a.params.envAttack, b.params.envAttack, t);
+    c.params.envDecay = mix(a.params.envDecay, b.params.envDecay, t);
+    c.params.envSustain = mix(a.params.envSustain, b.params.envSustain, t);
+    c.params.envRelease = mix(a.params.envRelease, b.params.envRelease, t);
+    c.params.lfoRate = mix(a.params.lfoRate, b.params.lfoRate, t);
+    c.params.vibrato = mix(a.params.vibrato, b.params.vibrato, t);
+    c.params.noise = mix(a.params.noise, b.params.noise, t);
+    c.params.octave = nearest(a.params.octave, b.params.octave, t);
+    c.params.tuning = mix(a.params.tuning, b.params.tuning, t);
+    c.params.polyMode = nearest(a.params.polyMode, b.params.polyMode, t);
+    c.params.outputLevel = mix(a.params.outputLevel, b.params.outputLevel, t);
+
+    c.controlPeriod = a.controlPeriod;
+    c.noiseMix = mix(a.noiseMix, b.noiseMix, t);
+    c.envAttack = mix(a.envAttack, b.envAttack, t);
+    c.envDecay = mix(a.envDecay, b.envDecay, t);
+    c.envSustain = mix(a.envSustain, b.envSustain, t);
+    c.envRelease = mix(a.envRelease, b.envRelease, t);
+    c.oscMix = mix(a.oscMix, b.oscMix, t);
+    c.detune = mix(a.detune, b.detune, t);
+    c.tune = mix(a.tune, b.tune, t);
+    c.numVoices = nearest(a.numVoices, b.numVoices, t);
+    c.outputLevel = mix(a.outputLevel, b.outputLevel, t);
+    c.velocitySensitivity = mix(a.velocitySensitivity, b.velocitySensitivity, t);
+    c.ignoreVelocity = nearest(a.ignoreVelocity, b.ignoreVelocity, t);
+    c.lfoInc = mix(a.lfoInc, b.lfoInc, t);
+    c.vibrato = mix(a.vibrato, b.vibrato, t);
+    c.pwmDepth = mix(a.pwmDepth, b.pwmDepth, t);
+    c.glideMode = nearest(a.glideMode, b.glideMode, t);
+    c.glideRate = mix(a.glideRate, b.glideRate, t);
+    c.glideBend = mix(a.glideBend, b.glideBend, t);
+    c.filterKeyTracking = mix(a.filterKeyTracking, b.filterKeyTracking, t);
+    c.filterQ = mix(a.filterQ, b.filterQ, t);
+    c.volumeTrim = mix(a.volumeTrim, b.volumeTrim, t);
+    c.filterLFODepth = mix(a.filterLFODepth, b.filterLFODepth, t);
+    c.filterAttack = mix(a.filterAttack, b.filterAttack, t);
+    c.filterDecay = mix(a.filterDecay, b.filterDecay, t);
+    c.filterSustain = mix(a.filterSustain, b.filterSustain, t);
+    c.filterRelease = mix(a.filterRelease, b.filterRelease, t);
+    c.filterEnvDepth = mix(a.filterEnvDepth, b.filterEnvDepth, t);
+    setCoefficients(c);
+}
+
+void Synth::beginBlock()
+{
+    // At the lower quality levels, cut off the tails of released voices once
+    // they are quiet enough.
+    if (float threshold = QUALITY_LEVELS[qualityLevel].fastReleaseBelow; threshold > 0.0f) {
+        for (auto& voice : voices) {
+            if (!voice.note.has_value() && voice.env.isActive() && voice.env.level < threshold) {
+                voice.env.release(fastReleaseMultiplier);
+            }
+        }
+    }
 
     // The voices need to have access to some of the synth's parameters and
     // MIDI controller values. We copy these values into the active voices
@@ -68,56 +438,146 @@ void Synth::render(float** outputBuffers, int sampleCount)
             voice.filterEnvDepth = filterEnvDepth;
         }
     }
+}
+
+void Synth::endBlock()
+{
+    // Turn off voices whose envelope has dropped below the minimum level.
+    for (auto& voice : voices) {
+        if (!voice.env.isActive()) {
+            voice.env.reset();
+            voice.filter.reset();
+        }
+    }
+}
+
+void Synth::render(float** outputBuffers, int sampleCount)
+{
+    float* outputBufferLeft = outputBuffers[0];
+    float* outputBufferRight = outputBuffers[1];
+
+    beginBlock();
+
+    // Number of voices that were active in the block, for tracing.
+    JX11_TRACE_ONLY(size_t activeVoices = 0;)
 
-    for (int sample = 0; sample < sampleCount; ++sample) {
+    int offset = 0;
+    while (offset < sampleCount) {
 
         // The LFO and any things it modulates are updated every 32 samples.
         // It's also guaranteed to be called the very first time.
         updateLFO();
 
-        // Noise oscillator.
-        float noise = noiseGen.nextValue() * noiseMix;
+        // Nothing is modulated until the next LFO update, so everything up to
+        // that point can be rendered in one go.
+        int chunkSize = std::min(lfoStep, sampleCount - offset);
+        lfoStep -= chunkSize - 1;
 
-        // These variables add up the output values of all the active voices.
-        float outputLeft = 0.0f;
-        float outputRight = 0.0f;
+        float* outputLeft = outputBufferLeft + offset;
+        float* outputRight = (outputBufferRight != nullptr) ? outputBufferRight + offset : nullptr;
 
-        // Render the voices that have an active envelope.
-        for (auto& voice : voices) {
-            if (voice.env.isActive()) {
-                float output = voice.render(noise);
-                outputLeft += output * voice.panLeft;
-                outputRight += output * voice.panRight;
+        {
+            JX11_TRACE_SPAN("voice render");
+
+            // Noise oscillator. This is shared by all voices.
+            for (int sample = 0; sample < chunkSize; ++sample) {
+                noiseBuffer[size_t(sample)] = noiseGen.nextValue() * noiseMix;
+            }
+
+            // Render the voices that have an active envelope.
+            lanes.count = 0;
+            for (auto& voice : voices) {
+                if (voice.env.isActive()) {
+                    size_t lane = lanes.count++;
+                    lanes.voices[lane] = &voice;
+                    lanes.panLeft[lane] = voice.panLeft;
+                    lanes.panRight[lane] = voice.panRight;
+                    lanes.panMono[lane] = voice.panMono;
+                }
+            }
+            JX11_TRACE_ONLY(activeVoices = std::max(activeVoices, lanes.count);)
+
+            // Add up the voices into the output buffer. The host may give us a
+            // mono bus, in which case there is no buffer for the right channel.
+            if (outputRight != nullptr) {
+                kernels->renderVoicesStereo(lanes, noiseBuffer.data(), outputLeft, outputRight, chunkSize);
+            } else {
+                kernels->renderVoicesMono(lanes, noiseBuffer.data(), outputLeft, nullptr, chunkSize);
             }
         }
 
-        // Apply additional gain.
-        float outputLevel = outputLevelSmoother.getNextValue();
-        outputLeft *= outputLevel;
-        outputRight *= outputLevel;
+        {
+            JX11_TRACE_SPAN("output stage");
 
-        // Write the result into the output buffer.
-        if (outputBufferRight != nullptr) {
-            outputBufferLeft[sample] = outputLeft;
-            outputBufferRight[sample] = outputRight;
-        } else {
-            outputBufferLeft[sample] = (outputLeft + outputRight) * 0.5f;
+            // Apply additional gain.
+            for (int sample = 0; sample < chunkSize; ++sample) {
+                gainBuffer[size_t(sample)] = outputLevelSmoother.getNextValue();
+            }
+            kernels->applyGain(outputLeft, gainBuffer.data(), chunkSize);
+            if (outputRight != nullptr) {
+                kernels->applyGain(outputRight, gainBuffer.data(), chunkSize);
+            }
         }
+
+        offset += chunkSize;
     }
 
-    // Turn off voices whose envelope has dropped below the minimum level.
-    for (auto& voice : voices) {
-        if (!voice.env.isActive()) {
-            voice.env.reset();
-            voice.filter.reset();
+    JX11_TRACE_COUNTER("active voices", activeVoices);
+
+    endBlock();
+}
+
+void Synth::advance(int sampleCount)
+{
+    beginBlock();
+
+    // The same steps as render, minus the audio. The noise generator and the
+    // output level smoother still have to take a step for every sample.
+    int offset = 0;
+    while (offset < sampleCount) {
+        updateLFO();
+
+        int chunkSize = std::min(lfoStep, sampleCount - offset);
+        lfoStep -= chunkSize - 1;
+
+        for (int sample = 0; sample < chunkSize; ++sample) {
+            noiseGen.nextValue();
+            outputLevelSmoother.getNextValue();
         }
+
+        lanes.count = 0;
+        for (auto& voice : voices) {
+            if (voice.env.isActive()) {
+                lanes.voices[lanes.count++] = &voice;
+            }
+        }
+        if (seed.has_value()) {
+            kernels->advanceEnvelopes(lanes, chunkSize);
+        } else {
+            kernels->advanceVoices(lanes, chunkSize);
+        }
+
+        offset += chunkSize;
     }
+
+    endBlock();
 }
 
 void Synth::updateLFO()
 {
     if (--lfoStep <= 0) {
-        lfoStep = LFO_MAX; // reset the counter
+        JX11_TRACE_SPAN("control-rate update");
+        lfoStep = controlPeriod; // reset the counter
+
+        // Move a morph towards its target amount, smoothed like filterZip
+        // below, so that the sound doesn't jump.
+        if (morphing && morphAmount != morphTarget) {
+            morphAmount += 0.05f * (morphTarget - morphAmount);
+            if (std::abs(morphTarget - morphAmount) < 0.0001f) {
+                morphAmount = morphTarget;
+            }
+            updateMorph();
+        }
 
         lfo += lfoInc;
         if (lfo > PI) {
@@ -241,6 +701,7 @@ void Synth::controlChange(uint8_t data1, uint8_t data2)
             for (auto& voice : voices) {
                 voice.reset();
             }
+            heldNotes.reset();
             sustainPedalPressed = false;
         }
         break;
@@ -256,14 +717,25 @@ void Synth::noteOn(size_t note, int velocity)
     size_t v = 0; // index of the voice to use (0 = mono voice)
 
     if (numVoices == 1) { // monophonic
+        // Remember the key even if it doesn't get to play right away, so it
+        // can be restored when the other keys are released.
+        heldNotes.push(note);
+        note = *heldNotes.top(notePriority);
+
         auto& voice = voices.front();
         if (voice.note.has_value() && voice.note != SUSTAIN) { // legato-style playing
-            shiftQueuedNotes();
-            restartMonoVoice(note, velocity);
+            // With low or high note priority, the new key may not replace
+            // the note that is already playing.
+            if (note != *voice.note) {
+                restartMonoVoice(note, velocity);
+            }
             return;
         }
     } else { // polyphonic
         v = findFreeVoice();
+        if (voices[v].env.isActive()) {
+            ++stolenVoices;
+        }
     }
 
     startVoice(v, note, velocity);
@@ -271,12 +743,18 @@ void Synth::noteOn(size_t note, int velocity)
 
 void Synth::noteOff(size_t note)
 {
+    // The key is no longer held. This is done in poly mode too, in case the
+    // key was pressed before switching from mono to poly.
+    heldNotes.remove(note);
+
     // In monophonic mode and the currently playing note is released?
     if ((numVoices == 1) && (voices[0].note == note)) {
-        // Did we find an older note whose key is still held down?
-        if (auto queuedNote = nextQueuedNote(); queuedNote) {
-            // Put this note into voice 0 and restart it.
-            restartMonoVoice(*queuedNote, -1);
+        // Is another key still held down? Then put that note into voice 0
+        // and restart it. Note that keys that were released while the sustain
+        // pedal is pressed are no longer on the stack, so notes kept alive
+        // only by the sustain pedal are not restored.
+        if (auto heldNote = heldNotes.top(notePriority); heldNote) {
+            restartMonoVoice(*heldNote, -1);
         }
     }
 
@@ -302,6 +780,7 @@ void Synth::noteOff(size_t note)
 
 void Synth::startVoice(size_t v, size_t note, int velocity)
 {
+    JX11_TRACE_SPAN("note-on setup");
     float period = calcPeriod(v, note);
 
     // Set the period as the target that we'll glide to (if glide enabled).
@@ -354,6 +833,16 @@ void Synth::startVoice(size_t v, size_t note, int velocity)
     // voice.osc1.reset();
     // voice.osc2.reset();
 
+    // In deterministic mode, a voice that was silent starts from scratch. The
+    // oscillators start somewhere in their first cycle.
+    ++noteCount;
+    if (seed.has_value() && !voice.env.isActive()) {
+        voice.saw = 0.0f;
+        voice.filterEnv.reset();
+        voice.osc1.reset(random(uint32_t(note), 2 * noteCount) * voice.period);
+        voice.osc2.reset(random(uint32_t(note), 2 * noteCount + 1) * voice.period * detune);
+    }
+
     // In PWM mode, change the starting phase of the second oscillator so that
     // it combines with the first oscillator into a square wave.
     if (vibrato == 0.0f && pwmDepth > 0.0f) {
@@ -378,6 +867,7 @@ void Synth::startVoice(size_t v, size_t note, int velocity)
 
 void Synth::restartMonoVoice(size_t note, int velocity)
 {
+    JX11_TRACE_SPAN("note-on setup");
     // This is a simplified version of startVoice, used only in mono mode when
     // playing legato-style or when activating a queued note after a key up.
 
@@ -412,7 +902,14 @@ float Synth::calcPeriod(size_t v, size_t note) const
     // is explained in detail in the book.
     // The ANALOG term adds a small amount of detuning based on the current
     // voice number. For moar analog!
-    float period = tune * std::exp(-0.05776226505f * (float(note) + ANALOG * float(v)));
+    // In deterministic mode, the drift is the same for every voice but
+    // different for every key.
+    float period;
+    if (seed.has_value()) {
+        period = tune * computeNotePitch(float(note), 8.0f * random(uint32_t(note), 0));
+    } else {
+        period = tune * tables->getNotePitch(note, size_t(v));
+    }
 
     // Make sure the period does not become too small. This lowers the pitch an
     // octave at a time until `period` is at least six samples long.
@@ -423,12 +920,23 @@ float Synth::calcPeriod(size_t v, size_t note) const
     return period;
 }
 
+float Synth::random(uint32_t a, uint32_t b) const
+{
+    uint32_t x = hash(hash(*seed ^ hash(a)) + b);
+
+    // Use the top 24 bits, which a float holds exactly.
+    return float(x >> 8) / 16777216.0f;
+}
+
 size_t Synth::findFreeVoice() const
 {
     size_t v = 0;
     float l = 100.0f; // louder than any envelope!
 
-    for (size_t i = 0; i < MAX_VOICES; ++i) {
+    // Voices above the polyphony limit of the quality level are not used.
+    const size_t maxVoices = QUALITY_LEVELS[qualityLevel].maxVoices;
+
+    for (size_t i = 0; i < maxVoices; ++i) {
         // Replace quietest voice not in attack. This will first use any voices
         // that are not playing (with env level = 0.0). If all are in use, pick
         // the voice with the lowest envelope value.
@@ -440,44 +948,122 @@ size_t Synth::findFreeVoice() const
     return v;
 }
 
-void Synth::shiftQueuedNotes()
+void Synth::setQualityLevel(int level)
 {
-    // Queue any held notes. This puts the previous note numbers into the other
-    // Voice objects, but it won't actually play these voices. Used during the
-    // next Note Off event to determine which note to restore.
-    for (size_t tmp = MAX_VOICES - 1; tmp > 0; tmp--) {
-        voices[tmp].note = voices[tmp - 1].note;
-
-        // Edge case: the user is playing multiple notes in polyphonic mode
-        // and switches to monophonic mode. We then need to fade out all the
-        // other voices or they would keep ringing forever.
-        voices[tmp].release();
+    level = std::clamp(level, 0, QUALITY_LEVEL_COUNT - 1);
+    if (level == qualityLevel) {
+        return;
     }
-}
+    qualityLevel = level;
+    JX11_TRACE_COUNTER("quality level", level);
 
-std::optional<size_t> Synth::nextQueuedNote()
-{
-    // Are there any older notes queued? Note that some of these may have
-    // been released in the mean time, in which case `voice.note` was set
-    // to 0 or SUSTAIN (in the loop from the else clause below). This means
-    // notes kept alive only by the sustain pedal are not restored.
-    size_t held = 0;
-    for (size_t v = MAX_VOICES - 1; v > 0; v--) {
-        auto& note = voices[v].note;
-        if (note.has_value() && note != SUSTAIN) {
-            held = v;
+    const QualitySettings& quality = QUALITY_LEVELS[level];
+
+    // Fade out the voices above the polyphony limit.
+    for (size_t v = quality.maxVoices; v < MAX_VOICES; ++v) {
+        if (voices[v].env.isActive()) {
+            voices[v].env.release(fastReleaseMultiplier);
+            voices[v].note = std::nullopt;
         }
     }
 
-    // Remove this older note from the queue.
-    if (held > 0) {
-        auto note = voices[held].note;
-        voices[held].note = std::nullopt;
-        return note;
+    // The coefficients for the glide, LFO and filter envelope depend on how
+    // often they are updated, so recalculate them. A morph has them for every
+    // quality level already. The filter envelopes of the playing voices also
+    // need their new multipliers.
+    if (quality.controlPeriod != controlPeriod) {
+        controlPeriod = quality.controlPeriod;
+        if (morphing) {
+            updateMorph();
+        } else {
+            applyCoefficients(computeCoefficients(coefficients.params));
+        }
+        for (auto& voice : voices) {
+            if (voice.env.isActive()) {
+                voice.filterEnv.setMultipliers(filterAttack, filterDecay, filterRelease);
+            }
+        }
+        lfoStep = std::min(lfoStep, controlPeriod);
     }
+}
+
+static_assert(SharedTables::VOICES == Synth::MAX_VOICES);
+
+void Synth::saveSnapshot(Snapshot& snapshot) const
+{
+    snapshot.coefficients = coefficients;
+    snapshot.qualityLevel = qualityLevel;
+    snapshot.notePriority = notePriority;
+    snapshot.seed = seed;
+
+    snapshot.morphFrom = morphFrom;
+    snapshot.morphTo = morphTo;
+    snapshot.morphing = morphing;
+    snapshot.morphAmount = morphAmount;
+    snapshot.morphTarget = morphTarget;
+
+    snapshot.voices = voices;
+    snapshot.outputLevelSmoother = outputLevelSmoother;
+    snapshot.noiseGen = noiseGen;
+    snapshot.lastNote = lastNote;
+    snapshot.heldNotes = heldNotes;
+    snapshot.stolenVoices = stolenVoices;
+    snapshot.noteCount = noteCount;
+
+    snapshot.lfoStep = lfoStep;
+    snapshot.lfo = lfo;
+    snapshot.filterZip = filterZip;
+
+    snapshot.pitchBend = pitchBend;
+    snapshot.sustainPedalPressed = sustainPedalPressed;
+    snapshot.modWheel = modWheel;
+    snapshot.resonanceCtl = resonanceCtl;
+    snapshot.pressure = pressure;
+    snapshot.filterCtl = filterCtl;
+}
 
-    // No notes in the queue.
-    return std::nullopt;
+void Synth::restoreSnapshot(const Snapshot& snapshot)
+{
+    // The coefficients go first: they were calculated for this control
+    // period, so this is a copy, and the voices and the output level
+    // smoother that they touch are overwritten below.
+    qualityLevel = snapshot.qualityLevel;
+    controlPeriod = snapshot.coefficients.controlPeriod;
+    applyCoefficients(snapshot.coefficients);
+    notePriority = snapshot.notePriority;
+    seed = snapshot.seed;
+
+    morphFrom = snapshot.morphFrom;
+    morphTo = snapshot.morphTo;
+    morphing = snapshot.morphing;
+    morphAmount = snapshot.morphAmount;
+    morphTarget = snapshot.morphTarget;
+
+    voices = snapshot.voices;
+    outputLevelSmoother = snapshot.outputLevelSmoother;
+    noiseGen = snapshot.noiseGen;
+    lastNote = snapshot.lastNote;
+    heldNotes = snapshot.heldNotes;
+    stolenVoices = snapshot.stolenVoices;
+    noteCount = snapshot.noteCount;
+
+    lfoStep = snapshot.lfoStep;
+    lfo = snapshot.lfo;
+    filterZip = snapshot.filterZip;
+
+    pitchBend = snapshot.pitchBend;
+    sustainPedalPressed = snapshot.sustainPedalPressed;
+    modWheel = snapshot.modWheel;
+    resonanceCtl = snapshot.resonanceCtl;
+    pressure = snapshot.pressure;
+    filterCtl = snapshot.filterCtl;
+}
+
+size_t Synth::getActiveVoiceCount() const
+{
+    return static_cast<size_t>(std::count_if(voices.begin(), voices.end(), [](const Voice& voice) {
+        return voice.env.isActive();
+    }));
 }
 
 bool Synth::isPlayingLegatoStyle() const
@@ -1,8 +1,16 @@
 #pragma once
 
+#include "Kernels.h"
 #include "NoiseGenerator.h"
+#include "NoteStack.h"
+#include "Parameters.h"
+#include "QualityGovernor.h"
+#include "SharedTables.h"
+#include "Smoother.h"
 #include "Voice.h"
-#include <juce_audio_basics/juce_audio_basics.h>
+#include <array>
+#include <cstdint>
+#include <memory>
 
 namespace JX11::Engine
 {
@@ -17,8 +25,118 @@ public:
     void deallocateResources();
     void reset();
     void render(float** outputBuffers, int sampleCount);
+
+    // Updates the synth as if sampleCount samples were rendered, without
+    // computing the audio. The filters of the voices are not run, so this
+    // leaves the synth in the same state as render only once all voices are
+    // silent, as render resets their filters then. Offline renderers use it
+    // to find the state at the silent points of a performance quickly. With
+    // a seed, silent voices start from scratch anyway, so it also skips the
+    // oscillators, which makes it much faster.
+    void advance(int sampleCount);
     void midiMessage(uint8_t data0, uint8_t data1, uint8_t data2);
 
+    // Calculates the parameter values below from the plugin parameters.
+    // Call this after allocateResources, as it depends on the sample rate.
+    void applyParameters(const Parameters& params);
+
+    // What applyParameters calculates, for the sample rate and the control
+    // period at the time. Calculating them takes a few dozen calls to exp and
+    // pow, but applying them is a copy, so a preset bank can calculate them
+    // for every preset up front and switch between them on the audio thread.
+    struct Coefficients
+    {
+        Parameters params;
+        int controlPeriod;
+        float noiseMix;
+        float envAttack, envDecay, envSustain, envRelease;
+        float oscMix;
+        float detune;
+        float tune;
+        size_t numVoices;
+        float outputLevel;
+        float velocitySensitivity;
+        bool ignoreVelocity;
+        float lfoInc;
+        float vibrato, pwmDepth;
+        int glideMode;
+        float glideRate, glideBend;
+        float filterKeyTracking;
+        float filterQ;
+        float volumeTrim;
+        float filterLFODepth;
+        float filterAttack, filterDecay, filterSustain, filterRelease;
+        float filterEnvDepth;
+    };
+
+    // applyParameters in two steps. If the control period has changed since
+    // the coefficients were calculated, applyCoefficients calculates them
+    // again, which is as slow as applyParameters.
+    Coefficients computeCoefficients(const Parameters& params) const;
+    void applyCoefficients(const Coefficients& coefficients);
+
+    // The coefficients for the control period of every quality level. The
+    // synth picks the one for its quality level, so applying them is always
+    // a copy, even after the quality level has changed.
+    using CoefficientSets = std::array<Coefficients, QUALITY_LEVEL_COUNT>;
+    CoefficientSets computeCoefficientSets(const Parameters& params) const;
+    void applyCoefficients(const CoefficientSets& sets);
+
+    // Morphs between two presets: at every control-rate update, the synth
+    // uses a mix of their coefficients, from 0 = all of from to 1 = all of to.
+    // setMorphAmount changes the mix, and the synth glides to it over a few
+    // updates. The sets are copied, so this never calculates or allocates
+    // anything. The morph ends at the next call to applyParameters or
+    // applyCoefficients. The continuous values are mixed, the others
+    // (mono/poly, glide mode, octave) switch halfway. At 0 and 1, the synth
+    // plays exactly like with applyCoefficients.
+    void setMorph(const CoefficientSets& from, const CoefficientSets& to, float amount);
+    void setMorphAmount(float amount);
+    bool isMorphing() const { return morphing; }
+
+    // The instruction set of the render kernels. These are picked in
+    // allocateResources, based on the CPU features.
+    KernelLevel getKernelLevel() const { return kernels->level; }
+
+    // Trades sound quality for speed when the CPU can't keep up, see
+    // QUALITY_LEVELS. Level 0 is full quality. Call this between blocks.
+    void setQualityLevel(int level);
+    int getQualityLevel() const { return qualityLevel; }
+
+    // Makes the output depend only on the seed and the MIDI events, so that
+    // rendering the same events twice gives the same audio. The noise starts
+    // from the seed, the analog drift of a note's pitch comes from the seed
+    // and the note number instead of the voice, and a note that starts on a
+    // silent voice clears what the voice's oscillators and filter envelope
+    // were doing and starts the oscillators at a pseudo random phase.
+    // Without a seed, the default, a new note carries on where the voice left
+    // off, like in the original JX11. Takes effect on the next reset.
+    void setSeed(std::optional<uint32_t> newSeed) { seed = newSeed; }
+    std::optional<uint32_t> getSeed() const { return seed; }
+
+    // Everything about the synth that changes while it plays: the voices with
+    // their envelopes, oscillators and filters, the LFO, the noise generator,
+    // the output level smoother, the MIDI controllers and the parameters.
+    // Not the lookup tables, the render kernels or the scratch buffers, which
+    // stay with the synth.
+    class Snapshot;
+
+    // Copies the state into a snapshot, or back from one. This is a plain
+    // copy of a few kilobytes that never allocates or frees, so it can be
+    // done on the audio thread. The snapshot may also be restored into
+    // another synth that was prepared for the same sample rate. That way, a
+    // renderer can play a shared beginning once and then fork it into several
+    // continuations.
+    void saveSnapshot(Snapshot& snapshot) const;
+    void restoreSnapshot(const Snapshot& snapshot);
+
+    // Number of voices that are currently playing.
+    size_t getActiveVoiceCount() const;
+
+    // How many times a voice that was still playing had to be taken over for
+    // a new note. Keeps counting up for the lifetime of the synth.
+    uint64_t getStolenVoiceCount() const { return stolenVoices; }
+
     // === Parameter values ===
 
     // Gain for mixing noise into the output.
@@ -45,11 +163,14 @@ public:
     // Mono (= 1 voice) / poly mode.
     size_t numVoices;
 
+    // Which of the held keys to play in mono mode.
+    NotePriority notePriority = NotePriority::last;
+
     // Used to keep the output gain constant after changing parameters.
     float volumeTrim;
 
     // Output gain.
-    juce::LinearSmoothedValue<float> outputLevelSmoother;
+    LinearSmoother outputLevelSmoother;
 
     // Used to set the low-pass filter's cutoff frequency based on the note's
     // velocity. There is no velocity sensitivity for the amplitude envelope,
@@ -59,8 +180,10 @@ public:
     // If this is set, all notes will be played with the same velocity.
     bool ignoreVelocity;
 
-    // How often the LFO and other modulations are updated, in samples.
-    const int LFO_MAX = 32;
+    // How often the LFO and other modulations are updated, in samples. The
+    // lower quality levels use a longer period, up to MAX_CONTROL_PERIOD.
+    static constexpr int LFO_MAX = 32;
+    static constexpr int MAX_CONTROL_PERIOD = 128;
 
     // Phase increment for the LFO.
     float lfoInc;
@@ -100,6 +223,10 @@ private:
     // Performs the LFO update very 32 samples.
     void updateLFO();
 
+    // The work at the start and the end of render and advance.
+    void beginBlock();
+    void endBlock();
+
     // Handles a MIDI CC event.
     void controlChange(uint8_t data1, uint8_t data2);
 
@@ -113,16 +240,25 @@ private:
     void startVoice(size_t v, size_t note, int velocity);
     void restartMonoVoice(size_t note, int velocity);
 
+    // computeCoefficients for another control period.
+    Coefficients computeCoefficients(const Parameters& params, int period) const;
+
+    // Applies coefficients without ending a morph.
+    void setCoefficients(const Coefficients& coefficients);
+
+    // Applies the mix of the morph at morphAmount.
+    void updateMorph();
+
     // Calculate the oscillator period based on the MIDI note number.
     float calcPeriod(size_t v, size_t note) const;
 
+    // A pseudo random number between 0 and 1 for deterministic mode, that
+    // depends only on the seed and the two values.
+    float random(uint32_t a, uint32_t b) const;
+
     // Find a voice to use in polyphonic mode.
     size_t findFreeVoice() const;
 
-    // For note queuing in monophonic mode.
-    void shiftQueuedNotes();
-    std::optional<size_t> nextQueuedNote();
-
     inline void updatePeriod(Voice& voice)
     {
         voice.osc1.period = voice.period * pitchBend;
@@ -138,12 +274,65 @@ private:
     // List of the active voices.
     std::array<Voice, MAX_VOICES> voices;
 
+    // The render kernels for the instruction set of this CPU.
+    const Kernels* kernels = getKernels(KernelLevel::scalar);
+
+    // The lookup tables for the sample rate, shared with the other synths.
+    // Set by allocateResources.
+    std::shared_ptr<const SharedTables> tables;
+
+    // Scratch buffers for rendering a chunk of audio. A chunk never goes past
+    // the next LFO update, so it's at most MAX_CONTROL_PERIOD samples long.
+    VoiceLanes lanes;
+    alignas(64) std::array<float, MAX_CONTROL_PERIOD> noiseBuffer;
+    alignas(64) std::array<float, MAX_CONTROL_PERIOD> gainBuffer;
+
+    // The coefficients from the last call to applyParameters or
+    // applyCoefficients. Their parameters are applied again when the control
+    // period changes.
+    Coefficients coefficients;
+
+    // See setQualityLevel.
+    int qualityLevel = 0;
+
+    // The current control period, LFO_MAX at full quality.
+    int controlPeriod = LFO_MAX;
+
+    // Envelope multiplier for fading out voices in a few milliseconds.
+    float fastReleaseMultiplier = 0.0f;
+
+    static_assert(VoiceLanes::SIZE == MAX_VOICES);
+    static_assert(std::all_of(std::begin(QUALITY_LEVELS), std::end(QUALITY_LEVELS),
+                              [](const QualitySettings& q) {
+                                  return q.controlPeriod <= MAX_CONTROL_PERIOD && q.maxVoices <= MAX_VOICES;
+                              }));
+
     // Pseudo random noise generator.
     NoiseGenerator noiseGen;
 
     // Most recent note that was played. Used for gliding.
     std::optional<size_t> lastNote;
 
+    // The keys that are held down in monophonic mode.
+    NoteStack heldNotes;
+
+    // See getStolenVoiceCount.
+    uint64_t stolenVoices = 0;
+
+    // See setMorph.
+    CoefficientSets morphFrom;
+    CoefficientSets morphTo;
+    bool morphing = false;
+    float morphAmount = 0.0f;
+    float morphTarget = 0.0f;
+
+    // See setSeed.
+    std::optional<uint32_t> seed;
+
+    // Number of notes started since reset. In deterministic mode, this makes
+    // the oscillator phases different every time a key is played.
+    uint32_t noteCount = 0;
+
     // === Modulation ===
 
     // The LFO only updates every 32 samples. This counter keeps track of when
@@ -177,4 +366,42 @@ private:
     float filterCtl;
 };
 
+class Synth::Snapshot
+{
+private:
+    friend class Synth;
+
+    // The values applyCoefficients sets, and the quality level they were
+    // calculated for.
+    Coefficients coefficients;
+    int qualityLevel;
+    NotePriority notePriority;
+
+    CoefficientSets morphFrom;
+    CoefficientSets morphTo;
+    bool morphing;
+    float morphAmount;
+    float morphTarget;
+    std::optional<uint32_t> seed;
+
+    std::array<Voice, MAX_VOICES> voices;
+    LinearSmoother outputLevelSmoother;
+    NoiseGenerator noiseGen;
+    std::optional<size_t> lastNote;
+    NoteStack heldNotes;
+    uint64_t stolenVoices;
+    uint32_t noteCount;
+
+    int lfoStep;
+    float lfo;
+    float filterZip;
+
+    float pitchBend;
+    bool sustainPedalPressed;
+    float modWheel;
+    float resonanceCtl;
+    float pressure;
+    float filterCtl;
+};
+
 } // namespace JX11::Engine
\ No newline at end of file
@@ -0,0 +1,101 @@
+#pragma once
+
+// Trace points inside the engine.
+//
+// The engine doesn't depend on JUCE or Perfetto. Instead, the trace points
+// forward to a TraceSink, which the plugin connects to Perfetto in PERFETTO
+// builds (see PluginProcessor.cpp). Without a sink, the trace points do
+// nothing.
+//
+// The trace points are only compiled in when JX11_ENGINE_TRACING is 1, which
+// CMake does for PERFETTO builds. Otherwise the macros expand to nothing, so
+// they cost nothing at all.
+//
+// Spans are only placed around work that happens at most once per chunk of
+// LFO_MAX samples, never inside the per-sample loops. Things that happen per
+// sample or per voice are counted, and reported once per block as a counter.
+
+#ifndef JX11_ENGINE_TRACING
+#define JX11_ENGINE_TRACING 0
+#endif
+
+#if JX11_ENGINE_TRACING
+
+#include <atomic>
+
+namespace JX11::Engine
+{
+
+// Receives the trace events. `name` is always a string literal.
+class TraceSink
+{
+public:
+    virtual ~TraceSink() = default;
+
+    virtual void beginSpan(const char* name) = 0;
+    virtual void endSpan() = 0;
+    virtual void counter(const char* name, double value) = 0;
+};
+
+// The sink that receives the events from all synth instances, or nullptr.
+inline std::atomic<TraceSink*> traceSink {nullptr};
+
+inline void setTraceSink(TraceSink* sink)
+{
+    traceSink.store(sink, std::memory_order_release);
+}
+
+// Marks the duration of the enclosing scope.
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char* name)
+        : sink(traceSink.load(std::memory_order_acquire))
+    {
+        if (sink != nullptr) {
+            sink->beginSpan(name);
+        }
+    }
+
+    ~TraceSpan()
+    {
+        if (sink != nullptr) {
+            sink->endSpan();
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    TraceSink* sink;
+};
+
+inline void traceCounter(const char* name, double value)
+{
+    if (auto sink = traceSink.load(std::memory_order_acquire); sink != nullptr) {
+        sink->counter(name, value);
+    }
+}
+
+} // namespace JX11::Engine
+
+#define JX11_TRACE_CONCAT_INNER(a, b) a##b
+#define JX11_TRACE_CONCAT(a, b) JX11_TRACE_CONCAT_INNER(a, b)
+
+// Traces the rest of the current scope as a span called `name`.
+#define JX11_TRACE_SPAN(name) ::JX11::Engine::TraceSpan JX11_TRACE_CONCAT(jx11TraceSpan, __LINE__)(name)
+
+// Sets the counter track called `name` to `value`.
+#define JX11_TRACE_COUNTER(name, value) ::JX11::Engine::traceCounter(name, static_cast<double>(value))
+
+// Code that only exists to compute the value of a counter.
+#define JX11_TRACE_ONLY(...) __VA_ARGS__
+
+#else
+
+#define JX11_TRACE_SPAN(name)
+#define JX11_TRACE_COUNTER(name, value)
+#define JX11_TRACE_ONLY(...)
+
+#endif
\ No newline at end of file
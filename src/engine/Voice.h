@@ -56,6 +56,10 @@ struct Voice
     // Panning amounts for left and right channels.
     float panLeft, panRight;
 
+    // Gain for a mono output. This is the average of both panning amounts,
+    // so it gives the same result as mixing the left and right channels.
+    float panMono;
+
     void reset()
     {
         note = std::nullopt;
@@ -69,9 +73,12 @@ struct Voice
 
         panLeft = 0.707f;
         panRight = 0.707f;
+        panMono = 0.707f;
     }
 
-    float render(float input)
+    // Renders the next sample from the oscillators. The filter and the
+    // amplitude envelope are applied by the render kernels, see Kernels.h.
+    float renderOscillators(float input)
     {
         // The two oscillators output a bandlimited impulse train, which
         // consists of a sinc pulse every `period` samples.
@@ -90,18 +97,10 @@ struct Voice
         // reused for a new note, and so the phase difference between osc1
         // and osc2 is never the same -- which is part of the fun.
 
-        // Combine the output from the oscillators with the noise.
-        float output = saw + input;
-
-        // Apply the resonant low-pass filter.
-        output = filter.render(output);
-
-        // Amplitude envelope.
-        float envelope = env.nextValue();
-
-        // The output for this voice is the amplitude envelope times the
-        // output from the filter.
-        return output * envelope;
+        // Combine the output from the oscillators with the noise. This then
+        // goes through the resonant low-pass filter, and is multiplied by the
+        // amplitude envelope.
+        return saw + input;
     }
 
     void updatePanning()
@@ -114,6 +113,7 @@ struct Voice
         // Use constant power panning formula.
         panLeft = std::sin(PI_OVER_4 * (1.0f - panning));
         panRight = std::sin(PI_OVER_4 * (1.0f + panning));
+        panMono = 0.5f * (panLeft + panRight);
     }
 
     void updateLFO()
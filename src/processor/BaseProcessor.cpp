@@ -4,6 +4,48 @@
 namespace JX11::Processor
 {
 
+// The generic editor only hears about new values through the parameter
+// listeners, which setParameterValues doesn't call. This one builds it again
+// when the state generation changes, so it never shows a loaded state's old
+// values.
+class StateEditor final : public juce::AudioProcessorEditor, private juce::Timer
+{
+public:
+    explicit StateEditor(BaseProcessor& owner_) : AudioProcessorEditor(owner_), owner(owner_)
+    {
+        rebuild();
+        startTimerHz(10);
+    }
+
+    void resized() override
+    {
+        if (editor != nullptr) {
+            editor->setBounds(getLocalBounds());
+        }
+    }
+
+private:
+    void rebuild()
+    {
+        shownGeneration = owner.getStateGeneration();
+        editor = std::make_unique<juce::GenericAudioProcessorEditor>(owner);
+        addAndMakeVisible(*editor);
+        setSize(editor->getWidth(), editor->getHeight());
+        resized();
+    }
+
+    void timerCallback() override
+    {
+        if (owner.getStateGeneration() != shownGeneration) {
+            rebuild();
+        }
+    }
+
+    BaseProcessor& owner;
+    uint32_t shownGeneration = 0;
+    std::unique_ptr<juce::GenericAudioProcessorEditor> editor;
+};
+
 //==============================================================================
 BaseProcessor::BaseProcessor()
     : AudioProcessor(
@@ -105,30 +147,67 @@ bool BaseProcessor::hasEditor() const
 
 juce::AudioProcessorEditor* BaseProcessor::createEditor()
 {
-    return new juce::GenericAudioProcessorEditor(*this);
+    return new StateEditor(*this);
 }
 
 //==============================================================================
-void BaseProcessor::getStateInformation(juce::MemoryBlock& destData)
+void BaseProcessor::mapStateParameters()
 {
-    juce::XmlElement xml("PluginState");
+    // The index of the engine's description of a parameter in
+    // Engine::PARAMETER_INFOS is also its position in the state.
     for (const auto& param : getParameters()) {
-        xml.setAttribute(getParamID(param), param->getValue());
+        if (const auto* info = Engine::findParameterInfo(getParamID(param).toRawUTF8())) {
+            stateParameters[static_cast<size_t>(info - Engine::PARAMETER_INFOS)] = param;
+        }
+    }
+}
+
+Engine::StateValues BaseProcessor::getParameterValues() const
+{
+    Engine::StateValues values {};
+    for (size_t i = 0; i < Engine::PARAMETER_COUNT; ++i) {
+        if (stateParameters[i] != nullptr) {
+            values[i] = stateParameters[i]->getValue();
+        }
     }
-    copyXmlToBinary(xml, destData);
+    return values;
+}
+
+void BaseProcessor::setParameterValues(const Engine::StateValues& values)
+{
+    for (size_t i = 0; i < Engine::PARAMETER_COUNT; ++i) {
+        if (stateParameters[i] != nullptr) {
+            stateParameters[i]->setValue(values[i]);
+        }
+    }
+    stateGeneration.fetch_add(1);
+}
+
+void BaseProcessor::getStateInformation(juce::MemoryBlock& destData)
+{
+    destData.setSize(Engine::STATE_SIZE);
+    Engine::writeStateValues(getParameterValues(), destData.getData(), destData.getSize());
 }
 
 void BaseProcessor::setStateInformation(const void* data, int sizeInBytes)
 {
-    auto xml = getXmlFromBinary(data, sizeInBytes);
-    if (!xml) {
+    // Parameters that are missing from the state keep their value.
+    Engine::StateValues values = getParameterValues();
+
+    const char* error = nullptr;
+    std::string_view state(static_cast<const char*>(data), static_cast<size_t>(std::max(sizeInBytes, 0)));
+    if (!Engine::readStateValues(state, values, error)) {
+        DBG("Cannot read the state: " << error);
         return;
     }
-    for (auto& param : getParameters()) {
-        param->setValueNotifyingHost(static_cast<float>(
-            xml->getDoubleAttribute(getParamID(param), param->getValue())));
-    }
+
+    // Set all the values without telling anyone, and then tell the synth, the
+    // editor and the host once. setValueNotifyingHost would call every
+    // listener for every parameter, which adds up when a session loads many
+    // instances.
+    setParameterValues(values);
     parametersChanged.store(true);
+    updateHostDisplay(juce::AudioProcessorListener::ChangeDetails().withParameterInfoChanged(true));
 }
 
 } // namespace JX11::Processor
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "engine/PluginState.h"
 #include <juce_audio_processors/juce_audio_processors.h>
 
 namespace JX11::Processor
@@ -39,9 +40,30 @@ public:
     void getStateInformation(juce::MemoryBlock& destData) override;
     void setStateInformation(const void* data, int sizeInBytes) override;
 
+    // Goes up every time setParameterValues sets all the parameters at once,
+    // for instance when a state is loaded. Their listeners don't hear about
+    // that, so an editor polls this and reads all the values again when it
+    // changes.
+    uint32_t getStateGeneration() const noexcept { return stateGeneration.load(); }
+
 protected:
+    // Finds the parameter for every entry of Engine::PARAMETER_INFOS. Call it
+    // in the constructor, once the parameters have been added.
+    void mapStateParameters();
+
+    // The normalized values of the parameters, in the order of the state.
+    Engine::StateValues getParameterValues() const;
+
+    // Sets the values without telling the listeners or the host, then moves
+    // the state generation on once for the editor.
+    void setParameterValues(const Engine::StateValues& values);
+
     std::atomic<bool> parametersChanged {false};
 
+private:
+    std::array<juce::AudioProcessorParameter*, Engine::PARAMETER_COUNT> stateParameters {};
+    std::atomic<uint32_t> stateGeneration {0};
+
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BaseProcessor)
 };
@@ -1,25 +1,96 @@
 #include "PluginProcessor.h"
 #include "Utils.h"
+#include "engine/Trace.h"
+#include <cstdlib>
+#include <cstring>
 
 namespace JX11::Processor
 {
 
+static bool isGovernorEnabled()
+{
+    const char* value = std::getenv("JX11_GOVERNOR");
+    return value != nullptr && std::strcmp(value, "1") == 0;
+}
+
+// Reads every state file in the directory that JX11_PRESETS names, in the
+// order of the file names. Without any, there is one program with the
+// default parameters.
+static std::vector<Engine::PresetBank::Entry> loadPresets()
+{
+    std::vector<Engine::PresetBank::Entry> presets;
+    if (const char* directory = std::getenv("JX11_PRESETS")) {
+        auto files = juce::File(directory).findChildFiles(juce::File::findFiles, false);
+        files.sort();
+        for (const auto& file : files) {
+            juce::MemoryBlock data;
+            Engine::Parameters params;
+            const char* error = nullptr;
+            if (!file.loadFileAsData(data) ||
+                !Engine::readPluginState({static_cast<const char*>(data.getData()), data.getSize()}, params, error)) {
+                DBG("Cannot read the preset " << file.getFullPathName() << ": " << (error ? error : "read error"));
+                continue;
+            }
+            presets.push_back({file.getFileNameWithoutExtension().toStdString(), params});
+        }
+    }
+    if (presets.empty()) {
+        presets.push_back({"Init", Engine::Parameters {}});
+    }
+    return presets;
+}
+
+#if JX11_ENGINE_TRACING
+// Sends the trace points from inside the engine to Perfetto, next to the
+// TRACE_DSP slices of the processor.
+class PerfettoTraceSink final : public Engine::TraceSink
+{
+public:
+    void beginSpan(const char* name) final
+    {
+        TRACE_EVENT_BEGIN("dsp", perfetto::StaticString {name});
+    }
+
+    void endSpan() final
+    {
+        TRACE_EVENT_END("dsp");
+    }
+
+    void counter(const char* name, double value) final
+    {
+        TRACE_COUNTER("dsp", perfetto::CounterTrack(name), value);
+    }
+};
+
+static PerfettoTraceSink perfettoTraceSink;
+#endif
+
 JX11AudioProcessor::JX11AudioProcessor()
     : mParams(*this)
+    , mPresets(loadPresets())
+    , mGovernorEnabled(isGovernorEnabled())
+    , mTelemetry(TelemetryExporter::connect())
 {
 #if PERFETTO
     MelatoninPerfetto::get().beginSession();
+#endif
+#if JX11_ENGINE_TRACING
+    Engine::setTraceSink(&perfettoTraceSink);
 #endif
     for (auto& param : getParameters()) {
         param->addListener(this);
     }
+    mapStateParameters();
+    startTimerHz(30);
 }
 
 JX11AudioProcessor::~JX11AudioProcessor()
 {
+    stopTimer();
     for (auto& param : getParameters()) {
         param->removeListener(this);
     }
+    TelemetryExporter::disconnect(mTelemetry);
 #if PERFETTO
     MelatoninPerfetto::get().endSession();
 #endif
@@ -29,6 +100,15 @@ JX11AudioProcessor::~JX11AudioProcessor()
 void JX11AudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
     mSynth.allocateResources(sampleRate, samplesPerBlock);
+
+    // The audio thread is stopped, so the bank can be replaced. A program
+    // that was still pending is taken from the new bank.
+    const bool programPending = mPendingProgram.exchange(nullptr) != nullptr;
+    mBank = std::make_unique<const Engine::PresetBank>(mSynth, mPresets);
+    if (programPending) {
+        mPendingProgram.store(&(*mBank)[static_cast<size_t>(mCurrentProgram.load())]);
+    }
+    mProgram = static_cast<size_t>(mCurrentProgram.load());
     parametersChanged.store(true);
     reset();
 }
@@ -41,6 +121,8 @@ void JX11AudioProcessor::releaseResources()
 void JX11AudioProcessor::reset()
 {
     mSynth.reset();
+    mGovernor.reset();
+    mSynth.setQualityLevel(0);
     mSynth.outputLevelSmoother.setCurrentAndTargetValue(juce::Decibels::decibelsToGain(mParams.outputLevelParam->get()));
 }
 
@@ -48,6 +130,7 @@ void JX11AudioProcessor::processBlock(juce::AudioBuffer<float>& buffer,
                                       [[maybe_unused]] juce::MidiBuffer& midiMessages)
 {
     TRACE_DSP();
+    const auto startTime = std::chrono::steady_clock::now();
     juce::ScopedNoDenormals noDenormals;
     const auto totalNumInputChannels = getTotalNumInputChannels();
     const auto totalNumOutputChannels = getTotalNumOutputChannels();
@@ -57,12 +140,20 @@ void JX11AudioProcessor::processBlock(juce::AudioBuffer<float>& buffer,
         buffer.clear(i, 0, buffer.getNumSamples());
     }
 
-    // Only recalculate when a parameter has changed.
+    applyPendingProgram();
+
+    // Only recalculate when a parameter has changed. Not while the parameters
+    // still have their values from before a program change, or update()
+    // would switch the synth back. Offline, not while morphing either, or
+    // every block would end the morph.
     bool expected = true;
-    if (isNonRealtime() || parametersChanged.compare_exchange_strong(expected, false)) {
+    if (mAppliedProgram.load() < 0 && ((isNonRealtime() && !mSynth.isMorphing()) ||
+                                       parametersChanged.compare_exchange_strong(expected, false))) {
         update();
     }
 
+    // splitBufferByEvents clears the MIDI buffer.
+    const int eventCount = midiMessages.getNumEvents();
     splitBufferByEvents(buffer, midiMessages);
 
 #ifdef JUCE_DEBUG
@@ -70,12 +161,57 @@ void JX11AudioProcessor::processBlock(juce::AudioBuffer<float>& buffer,
         JX11::Utils::protectYourEars(buffer.getWritePointer(channel), buffer.getNumSamples());
     }
 #endif
+
+    const auto renderTime =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime);
+    adaptQuality(renderTime, buffer.getNumSamples());
+    publishTelemetry(buffer, eventCount, renderTime);
+}
+
+void JX11AudioProcessor::adaptQuality(std::chrono::nanoseconds renderTime, int sampleCount)
+{
+    // When rendering offline there is no deadline, so always use full quality.
+    if (!mGovernorEnabled || isNonRealtime()) {
+        mSynth.setQualityLevel(0);
+        return;
+    }
+
+    const double renderSeconds = std::chrono::duration<double>(renderTime).count();
+    const double blockSeconds = sampleCount / getSampleRate();
+    mSynth.setQualityLevel(mGovernor.update(renderSeconds, blockSeconds));
+}
+
+void JX11AudioProcessor::publishTelemetry(const juce::AudioBuffer<float>& buffer, int eventCount,
+                                          std::chrono::nanoseconds renderTime)
+{
+    // This runs on the audio thread: it only pushes the stats into a
+    // wait-free ring.
+    const auto nanoseconds = renderTime.count();
+
+    BlockStats stats;
+    stats.renderNanoseconds = static_cast<uint32_t>(std::clamp<int64_t>(nanoseconds, 0, UINT32_MAX));
+    stats.sampleCount = static_cast<uint32_t>(buffer.getNumSamples());
+    stats.sampleRate = static_cast<float>(getSampleRate());
+    stats.activeVoices = static_cast<uint32_t>(mSynth.getActiveVoiceCount());
+    stats.eventCount = static_cast<uint32_t>(eventCount);
+    stats.qualityLevel = static_cast<uint32_t>(mSynth.getQualityLevel());
+
+    const uint64_t stolenVoiceCount = mSynth.getStolenVoiceCount();
+    stats.stolenVoices = static_cast<uint32_t>(stolenVoiceCount - mStolenVoiceCount);
+    mStolenVoiceCount = stolenVoiceCount;
+
+    for (int channel = 0; channel < buffer.getNumChannels(); ++channel) {
+        stats.peakLevel = std::max(stats.peakLevel, buffer.getMagnitude(channel, 0, buffer.getNumSamples()));
+    }
+
+    mTelemetry->publish(stats);
 }
 
 void JX11AudioProcessor::splitBufferByEvents(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
     TRACE_DSP();
     int bufferOffset = 0;
+    JX11_TRACE_ONLY(int eventCount = 0; int segmentCount = 0;)
 
     // Loop through the MIDI messages, which are sorted by samplePosition,
     // the relative timestamp inside the current audio buffer.
@@ -86,6 +222,7 @@ void JX11AudioProcessor::splitBufferByEvents(juce::AudioBuffer<float>& buffer, j
         if (samplesThisSegment > 0) {
             render(buffer, samplesThisSegment, bufferOffset);
             bufferOffset += samplesThisSegment;
+            JX11_TRACE_ONLY(++segmentCount;)
         }
 
         // Handle the event. Ignore MIDI messages such as sysex.
@@ -93,6 +230,7 @@ void JX11AudioProcessor::splitBufferByEvents(juce::AudioBuffer<float>& buffer, j
             uint8_t data1 = (metadata.numBytes >= 2) ? metadata.data[1] : 0;
             uint8_t data2 = (metadata.numBytes == 3) ? metadata.data[2] : 0;
             handleMIDI(metadata.data[0], data1, data2);
+            JX11_TRACE_ONLY(++eventCount;)
         }
     }
 
@@ -101,8 +239,12 @@ void JX11AudioProcessor::splitBufferByEvents(juce::AudioBuffer<float>& buffer, j
     int samplesLastSegment = buffer.getNumSamples() - bufferOffset;
     if (samplesLastSegment > 0) {
         render(buffer, samplesLastSegment, bufferOffset);
+        JX11_TRACE_ONLY(++segmentCount;)
     }
 
+    JX11_TRACE_COUNTER("events per block", eventCount);
+    JX11_TRACE_COUNTER("segments per block", segmentCount);
+
     midiMessages.clear();
 }
 
@@ -130,15 +272,29 @@ void JX11AudioProcessor::handleMIDI(uint8_t data0, uint8_t data1, uint8_t data2)
             mParams.outputLevelParam->beginChangeGesture();
             mParams.outputLevelParam->setValueNotifyingHost(volumeCtl);
             mParams.outputLevelParam->endChangeGesture();
+        } else if (data1 == MORPH_PROGRAM_CC) {
+            if (mBank != nullptr && data2 < mBank->size()) {
+                mMorphProgram = data2;
+                startMorph();
+            }
+        } else if (data1 == MORPH_AMOUNT_CC) {
+            mMorphAmount = float(data2) / 127.0f;
+            if (mSynth.isMorphing()) {
+                mSynth.setMorphAmount(mMorphAmount);
+            } else {
+                startMorph();
+            }
         }
     }
 
-    // Program Change
-    // if ((data0 & 0xF0) == 0xC0) {
-    //     if (data1 < presets.size()) {
-    //         setCurrentProgram(data1);
-    //     }
-    // }
+    // Program Change. Goes the same way as one from the host, but takes
+    // effect right away, at the position of the message in the block.
+    if ((data0 & 0xF0) == 0xC0) {
+        if (mBank != nullptr && data1 < mBank->size()) {
+            mPendingProgram.store(&(*mBank)[data1]);
+            applyPendingProgram();
+        }
+    }
 
     mSynth.midiMessage(data0, data1, data2);
 }
@@ -155,145 +311,120 @@ void JX11AudioProcessor::render(juce::AudioBuffer<float>& buffer, int sampleCoun
     mSynth.render(outputBuffers, sampleCount);
 }
 
-void JX11AudioProcessor::update()
+int JX11AudioProcessor::getNumPrograms() { return static_cast<int>(mPresets.size()); }
+
+int JX11AudioProcessor::getCurrentProgram() { return mCurrentProgram.load(); }
+
+void JX11AudioProcessor::setCurrentProgram(int index)
 {
-    TRACE_DSP();
-    // This function is called from the audio callback whenever any of the
-    // parameters have changed. Here, we simply recalculate everything when
-    // this happens. This function is called at most once per audio block.
-    // It could be optimized to recalculate only the things that have changed,
-    // but doing the bookkeeping for that also has a cost. Still, it might be
-    // worth it for parameters that are heavily automated.
-
-    float sampleRate = float(getSampleRate());
-    float inverseSampleRate = 1.0f / sampleRate;
-
-    // The envelope is implemented using a simple one-pole filter, which creates
-    // an analog-style exponential curve. The formulas below calculate the filter
-    // coefficients for the attack, decay, and release stages.
-    mSynth.envAttack = std::exp(-inverseSampleRate * std::exp(5.5f - 0.075f * mParams.envAttackParam->get()));
-    mSynth.envDecay = std::exp(-inverseSampleRate * std::exp(5.5f - 0.075f * mParams.envDecayParam->get()));
-
-    mSynth.envSustain = mParams.envSustainParam->get() / 100.0f;
-
-    float envRelease = mParams.envReleaseParam->get();
-    if (envRelease < 1.0f) {
-        mSynth.envRelease = 0.75f; // extra fast release
-    } else {
-        mSynth.envRelease = std::exp(-inverseSampleRate * std::exp(5.5f - 0.075f * envRelease));
+    if (index < 0 || static_cast<size_t>(index) >= mPresets.size()) {
+        return;
     }
+    mCurrentProgram.store(index);
 
-    // How much noise to mix into the signal. This is a parabolic curve,
-    // similar to creating a parameter with skew = 0.5.
-    float noiseMix = mParams.noiseParam->get() / 100.0f;
-    noiseMix *= noiseMix;
-    mSynth.noiseMix = noiseMix * 0.06f;
-
-    // How much to mix osc2 into the output. This is a value between 0 and 1.
-    mSynth.oscMix = mParams.oscMixParam->get() / 100.0f;
-
-    // Calculate the multiplication factor for detuning oscillator 2. This is
-    // the same as 2^(N/12) where N is the number of (fractional) semitones.
-    // This value will be multiplied with the oscillator period, which is why
-    // detuning down is greater than 1, as lowering the pitch means the period
-    // becomes longer. Vice versa for going up in pitch.
-    float semi = mParams.oscTuneParam->get();
-    float cent = mParams.oscFineParam->get();
-    mSynth.detune = std::pow(1.059463094359f, -semi - 0.01f * cent);
-
-    // Master tuning. See the book for a full explanation of what happens here.
-    float octave = mParams.octaveParam->get(); // -2 to +2
-    float tuning = mParams.tuningParam->get(); // -100 to +100
-    float tuneInSemi = -36.3763f - 12.0f * octave - tuning / 100.0f;
-    mSynth.tune = sampleRate * std::exp(0.05776226505f * tuneInSemi);
-
-    // Mono or poly?
-    mSynth.numVoices = (mParams.polyModeParam->getIndex() == 0) ? 1 : Engine::Synth::MAX_VOICES;
-
-    // Convert decibels to gain. Use a smoother for this parameter.
-    mSynth.outputLevelSmoother.setTargetValue(juce::Decibels::decibelsToGain(mParams.outputLevelParam->get()));
-
-    // Filter velocity sensitivity, a value between -0.05 and +0.05.
-    // If disabled, the velocity is completely ignored.
-    float filterVelocity = mParams.filterVelocityParam->get();
-    if (filterVelocity < -90.0f) {
-        mSynth.velocitySensitivity = 0.0f; // turn off velocity
-        mSynth.ignoreVelocity = true;
+    // Once playing, the audio thread switches over at the start of the next
+    // block. Before that, there is nothing to race with.
+    if (mBank != nullptr) {
+        mPendingProgram.store(&(*mBank)[static_cast<size_t>(index)]);
     } else {
-        mSynth.velocitySensitivity = 0.0005f * filterVelocity;
-        mSynth.ignoreVelocity = false;
+        setParameterValues(Engine::getStateValues(mPresets[static_cast<size_t>(index)].params));
+        parametersChanged.store(true);
+        updateHostDisplay(juce::AudioProcessorListener::ChangeDetails().withProgramChanged(true).withParameterInfoChanged(true));
     }
+}
 
-    // Use a lower update rate for the glide and filter envelope, 32 times
-    // (= LFO_MAX) slower than the sample rate.
-    const float inverseUpdateRate = inverseSampleRate * static_cast<float>(mSynth.LFO_MAX);
-
-    // The LFO rate is an exponentional curve that maps the 0 - 1 parameter
-    // value to 0.018 Hz - 20.09 Hz. Use this to calculate the phase increment
-    // for a sine wave running at 1/32th the sample rate.
-    float lfoRate = std::exp(7.0f * mParams.lfoRateParam->get() - 4.0f);
-    mSynth.lfoInc = lfoRate * inverseUpdateRate * float(Engine::TWO_PI);
-
-    // The vibrato parameter is a parabolic curve going from 0.0 for 0% up to
-    // 0.05 for 100%. You can choose between PWM mode (to the left) and vibrato
-    // mode (to the right). These values are used as the amplitude of the LFO
-    // sine wave that modulates the oscillator periods.
-    float vibrato = mParams.vibratoParam->get() / 200.0f;
-    mSynth.vibrato = 0.2f * vibrato * vibrato;
-    mSynth.pwmDepth = mSynth.vibrato;
-    if (vibrato < 0.0f) {
-        mSynth.vibrato = 0.0f;
+const juce::String JX11AudioProcessor::getProgramName(int index)
+{
+    if (index < 0 || static_cast<size_t>(index) >= mPresets.size()) {
+        return {};
     }
+    return mPresets[static_cast<size_t>(index)].name;
+}
 
-    // Need to glide?
-    mSynth.glideMode = mParams.glideModeParam->getIndex();
-
-    // Just like the envelope, glide is implemented using a one-pole filter
-    // that is updated every 32 samples. Here we set the filter coefficient.
-    // A smaller coefficient means the glide takes longer.
-    float glideRate = mParams.glideRateParam->get();
-    if (glideRate < 2.0f) {
-        mSynth.glideRate = 1.0f; // no glide
-    } else {
-        mSynth.glideRate = 1.0f - std::exp(-inverseUpdateRate * std::exp(6.0f - 0.07f * glideRate));
+void JX11AudioProcessor::applyPendingProgram()
+{
+    // Everything was calculated when the bank was built, so this only copies.
+    // The parameters, the editor and the host follow on the message thread.
+    if (const auto* preset = mPendingProgram.exchange(nullptr)) {
+        TRACE_DSP();
+        mSynth.applyCoefficients(preset->coefficients);
+        mProgram = mBank->indexOf(*preset);
+        mAppliedProgram.store(static_cast<int>(mProgram));
     }
+}
 
-    // Glide bend goes from -36 semitones to +36 semitones.
-    mSynth.glideBend = mParams.glideBendParam->get();
-
-    // The filter's cutoff is set using the note's pitch and velocity. This
-    // parameter shifts that cutoff up or down. Values are from -1.5 to 6.5.
-    mSynth.filterKeyTracking = 0.08f * mParams.filterFreqParam->get() - 1.5f;
-
-    // Filter Q. Starts at 1 and goes up to 20, approximately.
-    float filterReso = mParams.filterResoParam->get() / 100.0f;
-    mSynth.filterQ = std::exp(3.0f * filterReso);
-
-    // Self-oscillation:
-    // synth.filterQ = 1.0f / ((1.0f - filterReso + 1e-9) * (1.0f - filterReso + 1e-9));
-
-    // When using both oscillators, and/or noise or large filter resonance,
-    // the overall gain increases. This variable tries to compensate for that.
-    // There is also a manual output level control, as the total volume also
-    // depends on how many notes are playing, their envelopes, velocities, etc.
-    mSynth.volumeTrim = 0.0008f * (3.2f - mSynth.oscMix - 25.0f * mSynth.noiseMix) * (1.5f - 0.5f * filterReso);
-
-    // Filter LFO intensity. Parabolic curve from 0 to 2.5.
-    float filterLFO = mParams.filterLFOParam->get() / 100.0f;
-    mSynth.filterLFODepth = 2.5f * filterLFO * filterLFO;
+void JX11AudioProcessor::startMorph()
+{
+    if (mBank == nullptr || mMorphProgram < 0) {
+        return;
+    }
 
-    // The filter envelope uses the same formulas as the amplitude envelope
-    // but runs 32 times slower, at the same update rate as the LFO.
-    mSynth.filterAttack = std::exp(-inverseUpdateRate * std::exp(5.5f - 0.075f * mParams.filterAttackParam->get()));
-    mSynth.filterDecay = std::exp(-inverseUpdateRate * std::exp(5.5f - 0.075f * mParams.filterDecayParam->get()));
+    // The bank has the coefficients of both programs for every quality
+    // level, so the synth only copies them. A new morph starts from the
+    // current program and glides to the amount. A new second program takes
+    // over at the morph amount.
+    TRACE_DSP();
+    const float amount = mSynth.isMorphing() ? mMorphAmount : 0.0f;
+    mSynth.setMorph((*mBank)[mProgram].coefficients, (*mBank)[static_cast<size_t>(mMorphProgram)].coefficients,
+                    amount);
+    mSynth.setMorphAmount(mMorphAmount);
+}
 
-    float filterSustain = mParams.filterSustainParam->get() / 100.0f;
-    mSynth.filterSustain = filterSustain * filterSustain;
+void JX11AudioProcessor::timerCallback()
+{
+    const int index = mAppliedProgram.load();
+    if (index < 0) {
+        return;
+    }
 
-    mSynth.filterRelease = std::exp(-inverseUpdateRate * std::exp(5.5f - 0.075f * mParams.filterReleaseParam->get()));
+    // The values come from mPresets rather than the bank, which prepareToPlay
+    // may replace at any time. The parameters are set without telling their
+    // listeners, or update() would calculate it all again.
+    setParameterValues(Engine::getStateValues(mPresets[static_cast<size_t>(index)].params));
+    mCurrentProgram.store(index);
+
+    // If the audio thread has switched again in the meantime, the next tick
+    // takes care of that program.
+    int expected = index;
+    mAppliedProgram.compare_exchange_strong(expected, -1);
+    updateHostDisplay(juce::AudioProcessorListener::ChangeDetails().withProgramChanged(true).withParameterInfoChanged(true));
+}
 
-    // Filter envelope intensity. Linear curve from -6.0 to +6.0.
-    mSynth.filterEnvDepth = 0.06f * mParams.filterEnvParam->get();
+void JX11AudioProcessor::update()
+{
+    TRACE_DSP();
+    // This function is called from the audio callback whenever any of the
+    // parameters have changed. The synth recalculates everything from the
+    // current parameter values.
+    Engine::Parameters params;
+    params.oscMix = mParams.oscMixParam->get();
+    params.oscTune = mParams.oscTuneParam->get();
+    params.oscFine = mParams.oscFineParam->get();
+    params.glideMode = mParams.glideModeParam->getIndex();
+    params.glideRate = mParams.glideRateParam->get();
+    params.glideBend = mParams.glideBendParam->get();
+    params.filterFreq = mParams.filterFreqParam->get();
+    params.filterReso = mParams.filterResoParam->get();
+    params.filterEnv = mParams.filterEnvParam->get();
+    params.filterLFO = mParams.filterLFOParam->get();
+    params.filterVelocity = mParams.filterVelocityParam->get();
+    params.filterAttack = mParams.filterAttackParam->get();
+    params.filterDecay = mParams.filterDecayParam->get();
+    params.filterSustain = mParams.filterSustainParam->get();
+    params.filterRelease = mParams.filterReleaseParam->get();
+    params.envAttack = mParams.envAttackParam->get();
+    params.envDecay = mParams.envDecayParam->get();
+    params.envSustain = mParams.envSustainParam->get();
+    params.envRelease = mParams.envReleaseParam->get();
+    params.lfoRate = mParams.lfoRateParam->get();
+    params.vibrato = mParams.vibratoParam->get();
+    params.noise = mParams.noiseParam->get();
+    params.octave = mParams.octaveParam->get();
+    params.tuning = mParams.tuningParam->get();
+    params.polyMode = mParams.polyModeParam->getIndex();
+    params.outputLevel = mParams.outputLevelParam->get();
+
+    mSynth.applyParameters(params);
 }
 
 } // namespace JX11::Processor
@@ -303,4 +434,4 @@ void JX11AudioProcessor::update()
 juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
 {
     return new JX11::Processor::JX11AudioProcessor();
-}
+}
\ No newline at end of file
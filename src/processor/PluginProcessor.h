@@ -2,7 +2,10 @@
 
 #include "BaseProcessor.h"
 #include "Params.h"
+#include "Telemetry.h"
+#include "engine/PresetBank.h"
 #include "engine/Synth.h"
+#include <chrono>
 #include <juce_audio_processors/juce_audio_processors.h>
 #include <melatonin_perfetto/melatonin_perfetto.h>
 
@@ -10,7 +13,9 @@ namespace JX11::Processor
 {
 
 //==============================================================================
-class JX11AudioProcessor final : public BaseProcessor, public juce::AudioProcessorParameter::Listener
+class JX11AudioProcessor final : public BaseProcessor,
+                                  public juce::AudioProcessorParameter::Listener,
+                                  private juce::Timer
 {
 public:
     JX11AudioProcessor();
@@ -28,18 +33,72 @@ public:
 
     juce::AudioProcessorEditor* createEditor() final;
 
+    int getNumPrograms() final;
+    int getCurrentProgram() final;
+    void setCurrentProgram(int index) final;
+    const juce::String getProgramName(int index) final;
+
 private:
     void update();
 
+    // Switches the synth to the program in mPendingProgram, if any, on the
+    // audio thread.
+    void applyPendingProgram();
+
+    // Starts a morph from mProgram to mMorphProgram on the audio thread.
+    void startMorph();
+
+    // Sets the parameters to the program that the audio thread switched to,
+    // and tells the editor and the host, on the message thread.
+    void timerCallback() final;
+
     void splitBufferByEvents(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages);
     void handleMIDI(uint8_t data0, uint8_t data1, uint8_t data2);
     void render(juce::AudioBuffer<float>& buffer, int sampleCount, int bufferOffset);
+    void adaptQuality(std::chrono::nanoseconds renderTime, int sampleCount);
+    void publishTelemetry(const juce::AudioBuffer<float>& buffer, int eventCount,
+                          std::chrono::nanoseconds renderTime);
 
     //==============================================================================
     Params mParams;
 
     Engine::Synth mSynth;
 
+    // The presets, from the directory in the environment variable
+    // JX11_PRESETS, or only the default parameters. The bank has them decoded
+    // for the current sample rate, and is rebuilt by prepareToPlay.
+    std::vector<Engine::PresetBank::Entry> mPresets;
+    std::unique_ptr<const Engine::PresetBank> mBank;
+
+    // A program that the host has selected, for the audio thread to switch to
+    // at the start of the next block.
+    std::atomic<const Engine::PresetBank::Preset*> mPendingProgram {nullptr};
+    std::atomic<int> mCurrentProgram {0};
+
+    // The program that the audio thread has switched the synth to, while the
+    // parameters still have their old values, or -1.
+    std::atomic<int> mAppliedProgram {-1};
+
+    // A morph from the program that the synth was last switched to, to a
+    // second program of the bank. MIDI CC 12 picks the second program and
+    // CC 13 sets the amount. Changing a parameter or the program ends the
+    // morph. Only the audio thread uses these, mMorphProgram is -1 until the
+    // second program has been picked.
+    static constexpr uint8_t MORPH_PROGRAM_CC = 0x0C;
+    static constexpr uint8_t MORPH_AMOUNT_CC = 0x0D;
+    size_t mProgram = 0;
+    int mMorphProgram = -1;
+    float mMorphAmount = 0.0f;
+
+    // Lowers the quality of the synth when rendering takes too long. Off
+    // unless the environment variable JX11_GOVERNOR=1 is set.
+    Engine::QualityGovernor mGovernor;
+    const bool mGovernorEnabled;
+
+    // Per-block stats for the telemetry thread, see Telemetry.h.
+    std::shared_ptr<TelemetrySource> mTelemetry;
+    uint64_t mStolenVoiceCount = 0;
+
     //==============================================================================
 #if PERFETTO
     std::unique_ptr<perfetto::TracingSession> tracingSession;
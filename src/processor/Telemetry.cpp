@@ -0,0 +1,324 @@
+#include "Telemetry.h"
+#include "TelemetrySegment.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define JX11_TELEMETRY_SHM 1
+#else
+#define JX11_TELEMETRY_SHM 0
+#endif
+
+namespace JX11::Processor
+{
+
+namespace
+{
+
+// How often the telemetry thread drains the rings and updates the segment.
+constexpr auto UPDATE_INTERVAL = std::chrono::milliseconds(250);
+
+bool isTelemetryEnabled()
+{
+    const char* value = std::getenv("JX11_TELEMETRY");
+    return value != nullptr && std::strcmp(value, "1") == 0;
+}
+
+uint64_t getUnixTimeNanoseconds()
+{
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+}
+
+// The shared-memory segment of this process. If it can't be created, the
+// slots are kept in normal memory, so the rest of the code doesn't need to
+// care.
+class Segment
+{
+public:
+    Segment()
+    {
+#if JX11_TELEMETRY_SHM
+        getTelemetrySegmentName(name, static_cast<long>(getpid()));
+
+        // A segment with this name can be left over from a process that
+        // crashed and had the same pid. Truncating it clears the old data.
+        // Only the same user can read it, as it shows what the host is doing.
+        // shm_open keeps the mode of a segment that exists, so set it again.
+        int fd = shm_open(name, O_CREAT | O_RDWR, 0600);
+        if (fd >= 0) {
+            if (fchmod(fd, 0600) == 0 && ftruncate(fd, 0) == 0 && ftruncate(fd, sizeof(TelemetrySegment)) == 0) {
+                void* memory = mmap(nullptr, sizeof(TelemetrySegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (memory != MAP_FAILED) {
+                    segment = static_cast<TelemetrySegment*>(memory);
+                }
+            }
+            close(fd);
+            if (segment == nullptr) {
+                shm_unlink(name);
+            }
+        }
+#endif
+        if (segment == nullptr) {
+            fallback = std::make_unique<TelemetrySegment>();
+            segment = fallback.get();
+        }
+
+        segment->version = TelemetrySegment::VERSION;
+        segment->slotCount = TelemetrySegment::MAX_INSTANCES;
+        segment->processId = static_cast<uint32_t>(getProcessId());
+        segment->intervalMilliseconds = static_cast<uint32_t>(UPDATE_INTERVAL.count());
+
+        // Readers check the magic number last, so write it last.
+        std::atomic_thread_fence(std::memory_order_release);
+        segment->magic = TelemetrySegment::MAGIC;
+    }
+
+    ~Segment()
+    {
+#if JX11_TELEMETRY_SHM
+        if (fallback == nullptr) {
+            munmap(segment, sizeof(TelemetrySegment));
+            shm_unlink(name);
+        }
+#endif
+    }
+
+    Segment(const Segment&) = delete;
+    Segment& operator=(const Segment&) = delete;
+
+    TelemetrySlot& operator[](int slot) { return segment->slots[slot]; }
+
+private:
+    static long getProcessId()
+    {
+#if JX11_TELEMETRY_SHM
+        return static_cast<long>(getpid());
+#else
+        return 0;
+#endif
+    }
+
+    TelemetrySegment* segment = nullptr;
+    std::unique_ptr<TelemetrySegment> fallback;
+    char name[TELEMETRY_NAME_SIZE] = {};
+};
+
+// Writes a slot under its sequence lock.
+template <typename Function>
+void writeSlot(TelemetrySlot& slot, Function&& write)
+{
+    std::atomic_ref<uint32_t> sequence(slot.sequence);
+    uint32_t value = sequence.load(std::memory_order_relaxed);
+    sequence.store(value + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    write(slot);
+
+    sequence.store(value + 2, std::memory_order_release);
+}
+
+} // namespace
+
+class TelemetryExporter::Thread
+{
+public:
+    Thread()
+        : thread([this] { run(); })
+    {
+    }
+
+    ~Thread()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeUp.notify_one();
+        thread.join();
+    }
+
+    void add(const std::shared_ptr<TelemetrySource>& source)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int slot = 0; slot < static_cast<int>(TelemetrySegment::MAX_INSTANCES); ++slot) {
+            if (segment[slot].instanceId == 0) {
+                source->slot = slot;
+                writeSlot(segment[slot], [&](TelemetrySlot& s) { s.instanceId = source->instanceId; });
+                break;
+            }
+        }
+        sources.push_back(source);
+    }
+
+    void remove(const std::shared_ptr<TelemetrySource>& source)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sources.erase(std::remove(sources.begin(), sources.end(), source), sources.end());
+        if (source->slot >= 0) {
+            writeSlot(segment[source->slot], [](TelemetrySlot& s) { clearSlot(s); });
+            source->slot = -1;
+        }
+    }
+
+    bool isEmpty()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return sources.empty();
+    }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!wakeUp.wait_for(lock, UPDATE_INTERVAL, [this] { return stopping; })) {
+            for (auto& source : sources) {
+                update(*source);
+            }
+        }
+    }
+
+    static void clearSlot(TelemetrySlot& slot)
+    {
+        slot.instanceId = 0;
+        slot.updateTime = 0;
+        slot.blocks = 0;
+        slot.samples = 0;
+        slot.renderNanoseconds = 0;
+        slot.stolenVoices = 0;
+        slot.events = 0;
+        slot.droppedBlocks = 0;
+        slot.sampleRate = 0.0;
+        slot.intervalBlocks = 0;
+        slot.maxRenderNanoseconds = 0;
+        slot.load = 0.0f;
+        slot.peakLevel = 0.0f;
+        slot.activeVoices = 0;
+        slot.maxActiveVoices = 0;
+        slot.qualityLevel = 0;
+        slot.maxQualityLevel = 0;
+    }
+
+    // Drains the ring of one instance and writes the results into its slot.
+    void update(TelemetrySource& source)
+    {
+        uint32_t blocks = 0;
+        uint64_t samples = 0;
+        uint64_t renderNanoseconds = 0;
+        uint32_t maxRenderNanoseconds = 0;
+        double audioSeconds = 0.0;
+        uint64_t stolenVoices = 0;
+        uint64_t events = 0;
+        float peakLevel = 0.0f;
+        uint32_t activeVoices = 0;
+        uint32_t maxActiveVoices = 0;
+        uint32_t qualityLevel = 0;
+        uint32_t maxQualityLevel = 0;
+        float sampleRate = 0.0f;
+
+        BlockStats stats;
+        while (source.ring.pop(stats)) {
+            ++blocks;
+            samples += stats.sampleCount;
+            renderNanoseconds += stats.renderNanoseconds;
+            maxRenderNanoseconds = std::max(maxRenderNanoseconds, stats.renderNanoseconds);
+            if (stats.sampleRate > 0.0f) {
+                audioSeconds += static_cast<double>(stats.sampleCount) / static_cast<double>(stats.sampleRate);
+                sampleRate = stats.sampleRate;
+            }
+            stolenVoices += stats.stolenVoices;
+            events += stats.eventCount;
+            peakLevel = std::max(peakLevel, stats.peakLevel);
+            activeVoices = stats.activeVoices;
+            maxActiveVoices = std::max(maxActiveVoices, stats.activeVoices);
+            qualityLevel = stats.qualityLevel;
+            maxQualityLevel = std::max(maxQualityLevel, stats.qualityLevel);
+        }
+
+        if (source.slot < 0) {
+            return;
+        }
+
+        uint64_t droppedBlocks = source.droppedBlocks.load(std::memory_order_relaxed);
+        writeSlot(segment[source.slot], [&](TelemetrySlot& slot) {
+            slot.updateTime = getUnixTimeNanoseconds();
+            slot.blocks += blocks;
+            slot.samples += samples;
+            slot.renderNanoseconds += renderNanoseconds;
+            slot.stolenVoices += stolenVoices;
+            slot.events += events;
+            slot.droppedBlocks = droppedBlocks;
+            if (sampleRate > 0.0f) {
+                slot.sampleRate = sampleRate;
+            }
+            slot.intervalBlocks = blocks;
+            slot.maxRenderNanoseconds = maxRenderNanoseconds;
+            slot.load = audioSeconds > 0.0 ? static_cast<float>(renderNanoseconds * 1e-9 / audioSeconds) : 0.0f;
+            slot.peakLevel = peakLevel;
+            if (blocks > 0) {
+                slot.activeVoices = activeVoices;
+                slot.qualityLevel = qualityLevel;
+            }
+            slot.maxActiveVoices = maxActiveVoices;
+            slot.maxQualityLevel = maxQualityLevel;
+        });
+    }
+
+    Segment segment;
+
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+    std::vector<std::shared_ptr<TelemetrySource>> sources;
+
+    // Started last, once everything above is ready.
+    std::thread thread;
+};
+
+static std::mutex exporterMutex;
+static std::unique_ptr<TelemetryExporter::Thread> exporter;
+static uint32_t nextInstanceId = 1;
+
+std::shared_ptr<TelemetrySource> TelemetryExporter::connect()
+{
+    auto source = std::make_shared<TelemetrySource>();
+
+    std::lock_guard<std::mutex> lock(exporterMutex);
+    source->instanceId = nextInstanceId++;
+    if (!isTelemetryEnabled()) {
+        // The audio thread still publishes, but nobody reads the ring. Once
+        // it is full, publishing only increments the dropped counter.
+        return source;
+    }
+
+    if (exporter == nullptr) {
+        exporter = std::make_unique<Thread>();
+    }
+    exporter->add(source);
+    return source;
+}
+
+void TelemetryExporter::disconnect(const std::shared_ptr<TelemetrySource>& source)
+{
+    std::lock_guard<std::mutex> lock(exporterMutex);
+    if (exporter == nullptr || source == nullptr) {
+        return;
+    }
+
+    exporter->remove(source);
+    if (exporter->isEmpty()) {
+        exporter.reset();
+    }
+}
+
+} // namespace JX11::Processor
\ No newline at end of file
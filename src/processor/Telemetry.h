@@ -0,0 +1,131 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace JX11::Processor
+{
+
+// Runtime telemetry that works without attaching a profiler.
+//
+// On the audio thread, every plugin instance publishes the stats of each block
+// into its own TelemetrySource. That's a wait-free single-producer,
+// single-consumer ring, so the audio thread never blocks or allocates. A
+// background thread drains the rings of all instances in the process a few
+// times per second and writes the aggregated numbers into a POSIX shared-memory
+// segment (see TelemetrySegment.h), where a local sidecar process can read
+// them.
+//
+// The export is off unless the environment variable JX11_TELEMETRY=1 is set.
+// Only the user that runs the host can read the segment.
+
+// The stats for one processBlock call.
+struct BlockStats
+{
+    uint32_t renderNanoseconds = 0;
+    uint32_t sampleCount = 0;
+    float sampleRate = 0.0f;
+    uint32_t activeVoices = 0;
+    uint32_t stolenVoices = 0;
+    uint32_t eventCount = 0;
+    float peakLevel = 0.0f;
+    uint32_t qualityLevel = 0; // see Engine::QualityGovernor
+};
+
+// Fixed-capacity ring buffer for one producer thread and one consumer thread.
+// Both push and pop are wait-free. Capacity must be a power of two.
+template <typename T, size_t Capacity>
+class SpscRing
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    // Producer only. Returns false if the ring is full.
+    bool push(const T& item) noexcept
+    {
+        const size_t head = writeIndex.load(std::memory_order_relaxed);
+        if (head - cachedReadIndex == Capacity) {
+            cachedReadIndex = readIndex.load(std::memory_order_acquire);
+            if (head - cachedReadIndex == Capacity) {
+                return false;
+            }
+        }
+        items[head & (Capacity - 1)] = item;
+        writeIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns false if the ring is empty.
+    bool pop(T& item) noexcept
+    {
+        const size_t tail = readIndex.load(std::memory_order_relaxed);
+        if (tail == cachedWriteIndex) {
+            cachedWriteIndex = writeIndex.load(std::memory_order_acquire);
+            if (tail == cachedWriteIndex) {
+                return false;
+            }
+        }
+        item = items[tail & (Capacity - 1)];
+        readIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // The indices keep counting up and wrap around at SIZE_MAX. Each side
+    // keeps a copy of the other side's index, so it only has to touch the
+    // other side's cache line when the ring looks full or empty.
+    alignas(64) std::atomic<size_t> writeIndex {0};
+    size_t cachedReadIndex = 0;
+
+    alignas(64) std::atomic<size_t> readIndex {0};
+    size_t cachedWriteIndex = 0;
+
+    alignas(64) std::array<T, Capacity> items {};
+};
+
+// The channel from the audio thread of one plugin instance to the telemetry
+// thread.
+class TelemetrySource
+{
+public:
+    // Room for about a second of blocks at 48 kHz with a block size of 128.
+    // The telemetry thread drains the ring much more often than that.
+    static constexpr size_t CAPACITY = 512;
+
+    // Audio thread only. Wait-free; if the ring is full, the stats are dropped
+    // and counted.
+    void publish(const BlockStats& stats) noexcept
+    {
+        if (!ring.push(stats)) {
+            droppedBlocks.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    friend class TelemetryExporter;
+
+    SpscRing<BlockStats, CAPACITY> ring;
+    std::atomic<uint64_t> droppedBlocks {0};
+
+    // The slot in the shared-memory segment, or -1 if all slots are taken.
+    int slot = -1;
+    uint32_t instanceId = 0;
+};
+
+// Owns the telemetry thread and the shared-memory segment. These are created
+// when the first instance connects and removed when the last one disconnects.
+class TelemetryExporter
+{
+public:
+    // Call these from the message thread, not from the audio thread.
+    static std::shared_ptr<TelemetrySource> connect();
+    static void disconnect(const std::shared_ptr<TelemetrySource>& source);
+
+    // The telemetry thread, see Telemetry.cpp.
+    class Thread;
+};
+
+} // namespace JX11::Processor
\ No newline at end of file
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+namespace JX11::Processor
+{
+
+// Layout of the POSIX shared-memory segment that the plugin exports its
+// telemetry to, see Telemetry.h. Every process that has the plugin loaded
+// creates one segment called "/jx11-telemetry-<pid>" with a slot per plugin
+// instance. A sidecar process can open it read-only with shm_open and mmap.
+//
+// This header doesn't depend on JUCE so that sidecar tools can use it too.
+
+// Name of the segment for the given process.
+constexpr int TELEMETRY_NAME_SIZE = 48;
+
+inline void getTelemetrySegmentName(char (&name)[TELEMETRY_NAME_SIZE], long pid)
+{
+    std::snprintf(name, sizeof(name), "/jx11-telemetry-%ld", pid);
+}
+
+// One plugin instance. The telemetry thread rewrites the slot every update
+// interval. It uses a sequence lock: `sequence` is odd while the slot is being
+// written, so a reader copies the slot and retries if `sequence` was odd or
+// changed in the meantime. Access `sequence` through std::atomic_ref.
+struct TelemetrySlot
+{
+    uint32_t sequence;
+
+    // Unique for the lifetime of the process, 0 if the slot is not in use.
+    uint32_t instanceId;
+
+    // When the slot was last updated, in nanoseconds since the Unix epoch.
+    uint64_t updateTime;
+
+    // Totals since the instance was created.
+    uint64_t blocks;
+    uint64_t samples;
+    uint64_t renderNanoseconds;
+    uint64_t stolenVoices;
+    uint64_t events;
+
+    // Blocks that were lost because the ring between the audio thread and
+    // the telemetry thread was full.
+    uint64_t droppedBlocks;
+
+    // For the last update interval.
+    double sampleRate;
+    uint32_t intervalBlocks;
+    uint32_t maxRenderNanoseconds;
+    float load; // render time divided by the duration of the audio
+    float peakLevel;
+    uint32_t activeVoices; // at the end of the last block
+    uint32_t maxActiveVoices;
+    uint32_t qualityLevel; // at the end of the last block, 0 = full quality
+    uint32_t maxQualityLevel;
+};
+
+struct TelemetrySegment
+{
+    static constexpr uint32_t MAGIC = 0x4A583131; // "JX11"
+    static constexpr uint32_t VERSION = 2;
+    static constexpr uint32_t MAX_INSTANCES = 64;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t processId;
+
+    // How often the slots are updated.
+    uint32_t intervalMilliseconds;
+
+    TelemetrySlot slots[MAX_INSTANCES];
+};
+
+static_assert(std::atomic_ref<uint32_t>::is_always_lock_free,
+              "The sequence lock must work across processes");
+
+} // namespace JX11::Processor
\ No newline at end of file
@@ -0,0 +1,461 @@
+// jx11_batch: renders many single notes in parallel, for building sample
+// libraries.
+//
+// The job file has one note per line:
+//
+//     <preset> <note> <velocity> <hold seconds> [<output.wav>]
+//
+// The fields are separated by spaces, tabs or commas, and lines that start
+// with # are comments. The preset is a saved plugin state, see
+// common/Preset.h. Without an output name, the file is called
+// <preset name>_<note>_<velocity>.wav.
+//
+// The jobs run on a work-stealing thread pool. Every worker has its own Synth,
+// which is allocated once and reset between jobs. A job plays the note for the
+// hold time, releases it, and stops as soon as every envelope has dropped
+// below SILENCE, so the release tail is as long as the patch needs and no
+// longer. The finished audio is handed to a separate thread that writes the
+// files, so the workers can go on with the next note right away.
+
+#include "common/Json.h"
+#include "common/MidiEvents.h"
+#include "common/Preset.h"
+#include "common/Timer.h"
+#include "common/WavWriter.h"
+#include "common/WorkStealingPool.h"
+#include "engine/Synth.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace JX11;
+using namespace JX11::Engine;
+using Tools::MidiEvent;
+
+namespace
+{
+
+struct Options
+{
+    double sampleRate = 48000.0;
+    int blockSize = 256;
+    Tools::SampleFormat format = Tools::SampleFormat::pcm24;
+    int threads = 0; // 0 = one per core
+
+    // Longest release tail, in case a patch never goes silent.
+    double maxTail = 30.0;
+
+    std::optional<uint32_t> seed;
+
+    std::string jobsPath;
+    std::string outputDirectory = ".";
+    std::string jsonPath;
+};
+
+struct Job
+{
+    const Parameters* params;
+    uint8_t note;
+    uint8_t velocity;
+    double holdSeconds;
+    std::string outputPath;
+};
+
+// The rendered audio of one job, on its way to the file writer.
+struct Rendered
+{
+    std::string path;
+    std::vector<float> left;
+    std::vector<float> right;
+};
+
+// Writes the rendered jobs to disk on its own thread. The queue is bounded,
+// so that the workers wait instead of piling up audio in memory when the disk
+// can't keep up.
+class FileWriter
+{
+public:
+    FileWriter(const Options& options_, size_t capacity_)
+        : options(options_), capacity(capacity_), thread([this] { run(); })
+    {
+    }
+
+    ~FileWriter() { finish(); }
+
+    void push(Rendered&& rendered)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return queue.size() < capacity; });
+        queue.push_back(std::move(rendered));
+        notEmpty.notify_one();
+    }
+
+    // Writes what is left in the queue and stops the thread.
+    void finish()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (finishing) {
+                return;
+            }
+            finishing = true;
+        }
+        notEmpty.notify_one();
+        thread.join();
+    }
+
+    int getFailureCount() const { return failures; }
+    double getWriteSeconds() const { return writeSeconds; }
+
+private:
+    void run()
+    {
+        Tools::WavWriter writer;
+        while (true) {
+            Rendered rendered;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                notEmpty.wait(lock, [this] { return !queue.empty() || finishing; });
+                if (queue.empty()) {
+                    return;
+                }
+                rendered = std::move(queue.front());
+                queue.pop_front();
+            }
+            notFull.notify_one();
+
+            Tools::Timer timer;
+            bool ok = writer.open(rendered.path, int(options.sampleRate), options.format);
+            if (ok) {
+                writer.write(rendered.left.data(), rendered.right.data(), int(rendered.left.size()));
+                ok = writer.close();
+            }
+            if (!ok) {
+                std::fprintf(stderr, "cannot write %s\n", rendered.path.c_str());
+                ++failures;
+            }
+            writeSeconds += timer.elapsedNanoseconds() * 1e-9;
+        }
+    }
+
+    const Options& options;
+    const size_t capacity;
+
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::deque<Rendered> queue;
+    bool finishing = false;
+
+    // Only used by the writer thread until it has been joined.
+    int failures = 0;
+    double writeSeconds = 0.0;
+
+    std::thread thread;
+};
+
+// What every worker thread owns. Allocated once, before the jobs start.
+struct Worker
+{
+    Synth synth;
+    std::vector<float> left;
+    std::vector<float> right;
+    std::vector<MidiEvent> events;
+
+    int jobs = 0;
+    double renderSeconds = 0.0;
+    uint64_t frames = 0;
+};
+
+Rendered renderJob(const Job& job, const Options& options, Worker& worker)
+{
+    Synth& synth = worker.synth;
+    const Parameters& params = *job.params;
+    synth.reset();
+    synth.outputLevelSmoother.setCurrentAndTargetValue(std::pow(10.0f, params.outputLevel * 0.05f));
+    synth.applyParameters(params);
+
+    Rendered rendered;
+    rendered.path = job.outputPath;
+
+    float* outputBuffers[2] = {worker.left.data(), worker.right.data()};
+    const auto blockSize = uint64_t(options.blockSize);
+    const auto noteOffFrame = uint64_t(std::llround(job.holdSeconds * options.sampleRate));
+    const auto lastFrame = noteOffFrame + uint64_t(options.maxTail * options.sampleRate);
+
+    rendered.left.reserve(size_t(noteOffFrame + blockSize));
+    rendered.right.reserve(size_t(noteOffFrame + blockSize));
+
+    for (uint64_t blockStart = 0; blockStart < lastFrame; blockStart += blockSize) {
+        worker.events.clear();
+        if (blockStart == 0) {
+            worker.events.push_back({0, 0x90, job.note, job.velocity});
+        }
+        if (noteOffFrame >= blockStart && noteOffFrame < blockStart + blockSize) {
+            worker.events.push_back({int(noteOffFrame - blockStart), 0x80, job.note, 0});
+        }
+        Tools::renderWithEvents(synth, outputBuffers, options.blockSize, worker.events);
+
+        rendered.left.insert(rendered.left.end(), worker.left.begin(), worker.left.end());
+        rendered.right.insert(rendered.right.end(), worker.right.begin(), worker.right.end());
+
+        if (blockStart + blockSize > noteOffFrame && synth.getActiveVoiceCount() == 0) {
+            break;
+        }
+    }
+
+    // The voice went silent somewhere in the last block. Cut off the zeros
+    // after it, but never the held part of the note.
+    size_t length = rendered.left.size();
+    while (length > noteOffFrame && rendered.left[length - 1] == 0.0f && rendered.right[length - 1] == 0.0f) {
+        --length;
+    }
+    rendered.left.resize(length);
+    rendered.right.resize(length);
+    return rendered;
+}
+
+bool parseNumber(const std::string& text, double& value)
+{
+    char* end = nullptr;
+    value = std::strtod(text.c_str(), &end);
+    return end != text.c_str() && *end == '\0';
+}
+
+// Reads the job file. The presets are loaded once each and kept in presets.
+bool loadJobs(const Options& options, std::map<std::string, Parameters>& presets, std::vector<Job>& jobs)
+{
+    std::ifstream file(options.jobsPath);
+    if (!file) {
+        std::fprintf(stderr, "cannot open %s\n", options.jobsPath.c_str());
+        return false;
+    }
+
+    std::string line;
+    for (int lineNumber = 1; std::getline(file, line); ++lineNumber) {
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::istringstream stream(line);
+        std::vector<std::string> fields;
+        for (std::string field; stream >> field;) {
+            fields.push_back(field);
+        }
+        if (fields.empty() || fields[0][0] == '#') {
+            continue;
+        }
+
+        double note = 0.0, velocity = 0.0, hold = 0.0;
+        if (fields.size() < 4 || fields.size() > 5 || !parseNumber(fields[1], note) ||
+            !parseNumber(fields[2], velocity) || !parseNumber(fields[3], hold) || note < 0.0 || note > 127.0 ||
+            velocity < 1.0 || velocity > 127.0 || hold < 0.0) {
+            std::fprintf(stderr, "%s:%d: expected <preset> <note> <velocity> <hold seconds> [<output>]\n",
+                         options.jobsPath.c_str(), lineNumber);
+            return false;
+        }
+
+        const std::string& presetPath = fields[0];
+        auto preset = presets.find(presetPath);
+        if (preset == presets.end()) {
+            Parameters params;
+            std::string error;
+            if (!Tools::loadPreset(presetPath, params, error)) {
+                std::fprintf(stderr, "%s: %s\n", presetPath.c_str(), error.c_str());
+                return false;
+            }
+            preset = presets.emplace(presetPath, params).first;
+        }
+
+        Job job {&preset->second, uint8_t(note), uint8_t(velocity), hold, {}};
+        std::filesystem::path output;
+        if (fields.size() == 5) {
+            output = fields[4];
+        } else {
+            output = std::filesystem::path(presetPath).stem().string() + "_" + std::to_string(job.note) + "_" +
+                     std::to_string(job.velocity) + ".wav";
+        }
+        job.outputPath = (std::filesystem::path(options.outputDirectory) / output).string();
+        jobs.push_back(std::move(job));
+    }
+    return true;
+}
+
+void printUsage()
+{
+    std::fputs("usage: jx11_batch [options] <job file>\n"
+               "  --output-dir <dir>   where to write the files (default .)\n"
+               "  --threads <n>        worker threads (default: one per core)\n"
+               "  --sample-rate <hz>   sample rate (default 48000)\n"
+               "  --block-size <n>     samples per block (default 256)\n"
+               "  --format <format>    16, 24 or float (default 24)\n"
+               "  --max-tail <s>       max seconds to render after the note-off (default 30)\n"
+               "  --seed <n>           deterministic mode with this seed, see Synth::setSeed\n"
+               "  --json <file>        also write the stats as JSON\n",
+               stderr);
+}
+
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--output-dir" && hasValue) {
+            options.outputDirectory = argv[++i];
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = std::atoi(argv[++i]);
+        } else if (arg == "--sample-rate" && hasValue) {
+            options.sampleRate = std::atof(argv[++i]);
+        } else if (arg == "--block-size" && hasValue) {
+            options.blockSize = std::atoi(argv[++i]);
+        } else if (arg == "--format" && hasValue) {
+            std::string format = argv[++i];
+            if (format == "16") {
+                options.format = Tools::SampleFormat::pcm16;
+            } else if (format == "24") {
+                options.format = Tools::SampleFormat::pcm24;
+            } else if (format == "float") {
+                options.format = Tools::SampleFormat::float32;
+            } else {
+                return false;
+            }
+        } else if (arg == "--max-tail" && hasValue) {
+            options.maxTail = std::atof(argv[++i]);
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = uint32_t(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--json" && hasValue) {
+            options.jsonPath = argv[++i];
+        } else if (!arg.empty() && arg[0] != '-' && options.jobsPath.empty()) {
+            options.jobsPath = arg;
+        } else {
+            return false;
+        }
+    }
+    return !options.jobsPath.empty() && options.sampleRate > 0.0 && options.blockSize > 0 &&
+           options.threads >= 0 && options.maxTail >= 0.0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 1;
+    }
+
+    std::map<std::string, Parameters> presets;
+    std::vector<Job> jobs;
+    if (!loadJobs(options, presets, jobs)) {
+        return 1;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(options.outputDirectory, error);
+
+    int threadCount = options.threads;
+    if (threadCount == 0) {
+        threadCount = int(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    threadCount = std::min(threadCount, int(std::max<size_t>(1, jobs.size())));
+
+    // Everything a worker needs is allocated up front.
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (int i = 0; i < threadCount; ++i) {
+        auto worker = std::make_unique<Worker>();
+        worker->synth.allocateResources(options.sampleRate, options.blockSize);
+        worker->synth.setSeed(options.seed);
+        worker->left.resize(size_t(options.blockSize));
+        worker->right.resize(size_t(options.blockSize));
+        worker->events.reserve(2);
+        workers.push_back(std::move(worker));
+    }
+
+    Tools::Timer wallClock;
+    FileWriter writer(options, size_t(2 * threadCount));
+    uint64_t steals = 0;
+    {
+        Tools::WorkStealingPool pool(threadCount);
+        for (const auto& job : jobs) {
+            pool.submit([&](int index) {
+                Worker& worker = *workers[size_t(index)];
+                Tools::Timer timer;
+                Rendered rendered = renderJob(job, options, worker);
+                worker.renderSeconds += timer.elapsedNanoseconds() * 1e-9;
+                worker.frames += rendered.left.size();
+                worker.jobs += 1;
+                writer.push(std::move(rendered));
+            });
+        }
+        pool.wait();
+        steals = pool.getStealCount();
+    }
+    writer.finish();
+    const double wallSeconds = wallClock.elapsedNanoseconds() * 1e-9;
+
+    uint64_t frames = 0;
+    double renderSeconds = 0.0;
+    for (const auto& worker : workers) {
+        frames += worker->frames;
+        renderSeconds += worker->renderSeconds;
+    }
+    const double audioSeconds = double(frames) / options.sampleRate;
+
+    std::printf("jx11_batch: %zu jobs, %zu presets, %d threads, %s kernels\n", jobs.size(), presets.size(),
+                threadCount, getKernelName(selectKernels().level));
+    std::printf("  audio        %10.2f s\n", audioSeconds);
+    std::printf("  wall clock   %10.3f s  (%.1fx real time)\n", wallSeconds, audioSeconds / wallSeconds);
+    std::printf("  render time  %10.3f s  (%.1fx real time per thread)\n", renderSeconds,
+                audioSeconds / renderSeconds);
+    std::printf("  file writing %10.3f s\n", writer.getWriteSeconds());
+    std::printf("  stolen jobs  %10llu\n", static_cast<unsigned long long>(steals));
+
+    if (!options.jsonPath.empty()) {
+        FILE* file = std::fopen(options.jsonPath.c_str(), "w");
+        if (file == nullptr) {
+            std::fprintf(stderr, "cannot write %s\n", options.jsonPath.c_str());
+            return 1;
+        }
+        Tools::JsonWriter json(file);
+        json.beginObject();
+        json.member("tool", "jx11_batch");
+        json.member("version", JX11_VERSION);
+        json.member("kernel", getKernelName(selectKernels().level));
+        json.member("sample_rate", options.sampleRate);
+        json.member("block_size", options.blockSize);
+        json.member("threads", threadCount);
+        json.member("jobs", static_cast<long long>(jobs.size()));
+        json.member("audio_seconds", audioSeconds);
+        json.member("wall_seconds", wallSeconds);
+        json.member("render_seconds", renderSeconds);
+        json.member("write_seconds", writer.getWriteSeconds());
+        json.member("realtime_factor", audioSeconds / wallSeconds);
+        json.member("stolen_jobs", static_cast<long long>(steals));
+        json.member("failed_writes", writer.getFailureCount());
+        json.key("workers");
+        json.beginArray();
+        for (const auto& worker : workers) {
+            json.beginObject();
+            json.member("jobs", worker->jobs);
+            json.member("render_seconds", worker->renderSeconds);
+            json.endObject();
+        }
+        json.endArray();
+        json.endObject();
+        json.finish();
+        std::fclose(file);
+    }
+    return writer.getFailureCount() == 0 ? 0 : 1;
+}
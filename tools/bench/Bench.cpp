@@ -0,0 +1,687 @@
+// jx11_bench: measures the speed of the synth engine.
+//
+// The synth benchmarks drive Synth directly, the same way the plugin does,
+// and report the time per sample and per voice-sample. Each benchmark varies
+// one thing (number of voices, sample rate, block size, ...) from a common
+// base setup: 8 held notes at 48 kHz with 256-sample blocks.
+//
+// The micro-benchmarks time the building blocks of a voice in isolation, and
+// taking and restoring a snapshot of the whole synth.
+//
+// It also reports what every synth instance adds to the memory use, with the
+// lookup tables shared between the instances, see Engine::SharedTables.
+//
+// The results are written as JSON, so they can be compared between releases.
+// Like jx11_stress, it fails when the synth allocates memory or takes a lock
+// while it renders, see rtcheck/RtCheck.h.
+
+#include "common/Json.h"
+#include "common/PresetLibrary.h"
+#include "common/Timer.h"
+#include "engine/PluginState.h"
+#include "engine/PresetBank.h"
+#include "engine/Synth.h"
+#include "rtcheck/RtCheck.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace JX11;
+using namespace JX11::Engine;
+using Tools::doNotOptimize;
+
+namespace
+{
+
+struct Options
+{
+    // Seconds of audio to render for each measurement.
+    double seconds = 2.0;
+
+    // Number of times each benchmark is measured.
+    int repeats = 5;
+
+    // Only run the benchmarks whose name contains this.
+    std::string filter;
+
+    // Where to write the JSON, stdout if empty.
+    std::string jsonPath;
+
+    // Report allocations and locks while the synth renders.
+    bool rtCheck = true;
+};
+
+struct SynthBenchmark
+{
+    std::string name;
+    std::string group;
+    Parameters params;
+    double sampleRate = 48000.0;
+    int blockSize = 256;
+
+    // Number of notes that are held down.
+    int notes = 8;
+
+    // Render a mono output bus instead of stereo.
+    bool monoOutput = false;
+
+    // In mono mode, play a new note every this many samples, so that the
+    // voice keeps gliding. 0 to hold the same note.
+    int legatoInterval = 0;
+};
+
+struct MicroBenchmark
+{
+    std::string name;
+    double (*run)(long long calls);
+};
+
+struct Result
+{
+    double medianNanoseconds;
+    double minNanoseconds;
+};
+
+// Takes the median and the minimum of several measurements.
+Result summarize(std::vector<double> times)
+{
+    Result result;
+    result.medianNanoseconds = Tools::percentile(times, 0.5);
+    result.minNanoseconds = times.front();
+    return result;
+}
+
+// === Synth benchmarks ===
+
+std::vector<SynthBenchmark> makeSynthBenchmarks()
+{
+    std::vector<SynthBenchmark> benchmarks;
+
+    // Sustain at 100% so that all voices keep playing during the measurement.
+    SynthBenchmark base;
+    base.params.envSustain = 100.0f;
+
+    for (int notes : {1, 2, 4, 8}) {
+        auto b = base;
+        b.group = "voices";
+        b.name = "poly_" + std::to_string(notes) + "_voices";
+        b.notes = notes;
+        benchmarks.push_back(b);
+    }
+
+    {
+        auto b = base;
+        b.group = "mode";
+        b.name = "mono";
+        b.params.polyMode = 0;
+        b.notes = 1;
+        benchmarks.push_back(b);
+    }
+    {
+        auto b = base;
+        b.group = "mode";
+        b.name = "mono_glide";
+        b.params.polyMode = 0;
+        b.params.glideMode = 2;
+        b.params.glideRate = 50.0f;
+        b.params.glideBend = -12.0f;
+        b.notes = 1;
+        b.legatoInterval = 1024;
+        benchmarks.push_back(b);
+    }
+    {
+        auto b = base;
+        b.group = "mode";
+        b.name = "poly_noise";
+        b.params.noise = 100.0f;
+        benchmarks.push_back(b);
+    }
+    {
+        auto b = base;
+        b.group = "mode";
+        b.name = "poly_pwm";
+        b.params.vibrato = -50.0f;
+        benchmarks.push_back(b);
+    }
+    {
+        auto b = base;
+        b.group = "mode";
+        b.name = "poly_vibrato";
+        b.params.vibrato = 50.0f;
+        benchmarks.push_back(b);
+    }
+    {
+        auto b = base;
+        b.group = "mode";
+        b.name = "poly_mono_output";
+        b.monoOutput = true;
+        benchmarks.push_back(b);
+    }
+
+    for (double sampleRate : {44100.0, 48000.0, 88200.0, 96000.0, 176400.0, 192000.0}) {
+        auto b = base;
+        b.group = "sample_rate";
+        b.name = "sample_rate_" + std::to_string(int(sampleRate));
+        b.sampleRate = sampleRate;
+        benchmarks.push_back(b);
+    }
+
+    for (int blockSize = 16; blockSize <= 4096; blockSize *= 2) {
+        auto b = base;
+        b.group = "block_size";
+        b.name = "block_size_" + std::to_string(blockSize);
+        b.blockSize = blockSize;
+        benchmarks.push_back(b);
+    }
+
+    return benchmarks;
+}
+
+// Renders the benchmark's setup for the requested duration and returns the
+// time in nanoseconds per sample.
+double runSynthBenchmark(const SynthBenchmark& b, double seconds)
+{
+    Synth synth;
+    synth.allocateResources(b.sampleRate, b.blockSize);
+    synth.applyParameters(b.params);
+    synth.reset();
+
+    // Spread the notes out a little, like a chord.
+    for (int i = 0; i < b.notes; ++i) {
+        synth.midiMessage(0x90, uint8_t(48 + 5 * i), 100);
+    }
+
+    std::vector<float> left(size_t(b.blockSize));
+    std::vector<float> right(size_t(b.blockSize));
+    float* outputBuffers[2] = {left.data(), b.monoOutput ? nullptr : right.data()};
+
+    // Alternates between two notes in legato mode.
+    uint8_t note = 48;
+    int samplesUntilNextNote = b.legatoInterval;
+
+    auto renderBlock = [&]() {
+        Tools::RtCheck::AudioThreadScope audioThread;
+        if (b.legatoInterval > 0) {
+            samplesUntilNextNote -= b.blockSize;
+            if (samplesUntilNextNote <= 0) {
+                uint8_t nextNote = (note == 48) ? 60 : 48;
+                synth.midiMessage(0x90, nextNote, 100);
+                synth.midiMessage(0x80, note, 0);
+                note = nextNote;
+                samplesUntilNextNote += b.legatoInterval;
+            }
+        }
+        synth.render(outputBuffers, b.blockSize);
+        doNotOptimize(left[0]);
+    };
+
+    // Warm up, also gets the voices past the attack.
+    auto warmupBlocks = std::max(1, int(0.1 * b.sampleRate) / b.blockSize);
+    for (int i = 0; i < warmupBlocks; ++i) {
+        renderBlock();
+    }
+
+    auto blocks = std::max(1, int(seconds * b.sampleRate) / b.blockSize);
+    Tools::Timer timer;
+    for (int i = 0; i < blocks; ++i) {
+        renderBlock();
+    }
+    return timer.elapsedNanoseconds() / (double(blocks) * b.blockSize);
+}
+
+// === Micro-benchmarks ===
+
+double benchmarkOscillator(long long calls)
+{
+    Oscillator osc;
+    osc.reset();
+    osc.period = 48000.0f / 261.63f;
+
+    float sum = 0.0f;
+    Tools::Timer timer;
+    for (long long i = 0; i < calls; ++i) {
+        sum += osc.nextSample();
+    }
+    double elapsed = timer.elapsedNanoseconds();
+    doNotOptimize(sum);
+    return elapsed;
+}
+
+double benchmarkFilterRender(long long calls)
+{
+    Filter filter;
+    filter.sampleRate = 48000.0f;
+    filter.reset();
+    filter.updateCoefficients(1000.0f, 2.0f);
+
+    // A sawtooth as the input.
+    float x = 0.0f;
+    float sum = 0.0f;
+    Tools::Timer timer;
+    for (long long i = 0; i < calls; ++i) {
+        x += 0.01f;
+        if (x > 1.0f) {
+            x -= 2.0f;
+        }
+        sum += filter.render(x);
+    }
+    double elapsed = timer.elapsedNanoseconds();
+    doNotOptimize(sum);
+    return elapsed;
+}
+
+double benchmarkFilterUpdateCoefficients(long long calls)
+{
+    Filter filter;
+    filter.sampleRate = 48000.0f;
+    filter.reset();
+
+    // Sweep the cutoff, like the filter envelope does.
+    float cutoff = 20.0f;
+    Tools::Timer timer;
+    for (long long i = 0; i < calls; ++i) {
+        filter.updateCoefficients(cutoff, 2.0f);
+        doNotOptimize(filter);
+        cutoff *= 1.001f;
+        if (cutoff > 20000.0f) {
+            cutoff = 20.0f;
+        }
+    }
+    return timer.elapsedNanoseconds();
+}
+
+double benchmarkEnvelope(long long calls)
+{
+    Envelope env;
+    env.reset();
+    env.attackMultiplier = 0.999f;
+    env.decayMultiplier = 0.9999f;
+    env.sustainLevel = 0.5f;
+    env.releaseMultiplier = 0.999f;
+    env.attack();
+
+    float sum = 0.0f;
+    Tools::Timer timer;
+    for (long long i = 0; i < calls; ++i) {
+        sum += env.nextValue();
+    }
+    double elapsed = timer.elapsedNanoseconds();
+    doNotOptimize(sum);
+    return elapsed;
+}
+
+// Saves and restores the state of a synth with 8 playing voices. These must
+// not allocate either.
+double benchmarkSnapshot(long long calls)
+{
+    Synth synth;
+    synth.allocateResources(48000.0, 256);
+    synth.applyParameters(Parameters {});
+    synth.reset();
+    for (int i = 0; i < 8; ++i) {
+        synth.midiMessage(0x90, uint8_t(48 + 5 * i), 100);
+    }
+    std::vector<float> left(256), right(256);
+    float* outputBuffers[2] = {left.data(), right.data()};
+    synth.render(outputBuffers, 256);
+
+    Synth::Snapshot snapshot;
+    Tools::Timer timer;
+    for (long long i = 0; i < calls; ++i) {
+        Tools::RtCheck::AudioThreadScope audioThread;
+        synth.saveSnapshot(snapshot);
+        doNotOptimize(snapshot);
+        synth.restoreSnapshot(snapshot);
+        doNotOptimize(synth);
+    }
+    return timer.elapsedNanoseconds();
+}
+
+// Reads a plugin state, like loading a session does for every instance.
+double benchmarkStateRead(const std::string& state, long long calls)
+{
+    Parameters params;
+    const char* error = nullptr;
+    Tools::Timer timer;
+    for (long long i = 0; i < calls; ++i) {
+        readPluginState(state, params, error);
+        doNotOptimize(params);
+    }
+    return timer.elapsedNanoseconds();
+}
+
+double benchmarkStateReadBinary(long long calls)
+{
+    std::string state(STATE_SIZE, '\0');
+    writePluginState(Parameters {}, state.data(), state.size());
+    return benchmarkStateRead(state, calls);
+}
+
+// The XML that the plugin saved before the binary format.
+double benchmarkStateReadXml(long long calls)
+{
+    std::string state = "<?xml version=\"1.0\" encoding=\"UTF-8\"?> <PluginState";
+    for (const auto& info : PARAMETER_INFOS) {
+        char attribute[64];
+        std::snprintf(attribute, sizeof(attribute), " %s=\"%.9g\"", info.id,
+                      double(info.toNormalized(info.get(Parameters {}))));
+        state += attribute;
+    }
+    state += "/>";
+    return benchmarkStateRead(state, calls);
+}
+
+// Switches a synth back and forth between two presets, the way a program
+// change did before the preset bank, and the way it does with the bank.
+std::vector<PresetBank::Entry> makeProgramChangePresets()
+{
+    Parameters other;
+    other.oscMix = 40.0f;
+    other.filterFreq = 60.0f;
+    other.envAttack = 20.0f;
+    other.envRelease = 70.0f;
+    other.vibrato = -30.0f;
+    other.glideMode = 1;
+    other.outputLevel = -6.0f;
+    return {{"default", Parameters {}}, {"other", other}};
+}
+
+double benchmarkProgramChange(bool useBank, long long calls)
+{
+    Synth synth;
+    synth.allocateResources(48000.0, 256);
+    synth.reset();
+    const auto presets = makeProgramChangePresets();
+    const PresetBank bank(synth, presets);
+
+    Tools::Timer timer;
+    for (long long i = 0; i < calls; ++i) {
+        Tools::RtCheck::AudioThreadScope audioThread;
+        const size_t index = size_t(i & 1);
+        if (useBank) {
+            synth.applyCoefficients(bank[index].coefficients);
+        } else {
+            synth.applyParameters(presets[index].params);
+        }
+        doNotOptimize(synth);
+    }
+    return timer.elapsedNanoseconds();
+}
+
+double benchmarkProgramChangeParameters(long long calls) { return benchmarkProgramChange(false, calls); }
+double benchmarkProgramChangeBank(long long calls) { return benchmarkProgramChange(true, calls); }
+
+// Finds a preset by name in a library of 100k and reads its parameters, the
+// way a batch job loads its presets.
+double benchmarkPresetLibraryFind(long long calls)
+{
+    constexpr size_t PRESETS = 100000;
+    Tools::PresetLibraryWriter writer;
+    std::vector<std::string> names;
+    for (size_t i = 0; i < PRESETS; ++i) {
+        names.push_back("preset " + std::to_string(i));
+        Parameters params;
+        params.oscMix = float(i % 101);
+        writer.add(names.back(), params, {i % 2 == 0 ? "even" : "odd"});
+    }
+    const auto path = std::filesystem::temp_directory_path() / ("jx11_bench_" + std::to_string(calls) + ".jx11lib");
+    std::string error;
+    Tools::PresetLibrary library;
+    if (writer.write(path, error) == 0 || !library.open(path, error)) {
+        std::fprintf(stderr, "preset_library_find: %s\n", error.c_str());
+        return 0.0;
+    }
+
+    // Spread over the whole file, so that most lookups miss the cache.
+    Tools::Timer timer;
+    for (long long i = 0; i < calls; ++i) {
+        const auto index = library.find(names[size_t(i * 7919) % PRESETS]);
+        Parameters params = library.getParameters(index.value_or(0));
+        doNotOptimize(params);
+    }
+    double elapsed = timer.elapsedNanoseconds();
+    library.close();
+    std::filesystem::remove(path);
+    return elapsed;
+}
+
+std::vector<MicroBenchmark> makeMicroBenchmarks()
+{
+    return {
+        {"oscillator_next_sample", benchmarkOscillator},
+        {"filter_render", benchmarkFilterRender},
+        {"filter_update_coefficients", benchmarkFilterUpdateCoefficients},
+        {"envelope_next_value", benchmarkEnvelope},
+        {"synth_snapshot_save_restore", benchmarkSnapshot},
+        {"state_read_binary", benchmarkStateReadBinary},
+        {"state_read_xml", benchmarkStateReadXml},
+        {"program_change_parameters", benchmarkProgramChangeParameters},
+        {"program_change_bank", benchmarkProgramChangeBank},
+        {"preset_library_find", benchmarkPresetLibraryFind},
+    };
+}
+
+// === Memory ===
+
+struct MemoryReport
+{
+    size_t instances;
+    size_t synthBytes;
+    size_t tableBytes;
+    size_t tableSets;
+    size_t bytesPerInstance;
+};
+
+// Prepares many synths, half at 44.1 kHz and half at 48 kHz, and counts the
+// memory they take: the synths themselves plus the tables they share.
+MemoryReport measureMemory(size_t instances)
+{
+    const size_t liveBefore = SharedTables::getLiveCount();
+    std::vector<std::unique_ptr<Synth>> synths;
+    for (size_t i = 0; i < instances; ++i) {
+        auto synth = std::make_unique<Synth>();
+        synth->allocateResources(i % 2 == 0 ? 44100.0 : 48000.0, 256);
+        synths.push_back(std::move(synth));
+    }
+
+    MemoryReport report;
+    report.instances = instances;
+    report.synthBytes = sizeof(Synth);
+    report.tableBytes = sizeof(SharedTables);
+    report.tableSets = SharedTables::getLiveCount() - liveBefore;
+    report.bytesPerInstance = report.synthBytes + report.tableBytes * report.tableSets / instances;
+    return report;
+}
+
+// === Main ===
+
+void printUsage()
+{
+    std::fputs("usage: jx11_bench [options]\n"
+               "  --json <file>     write the results to this file instead of stdout\n"
+               "  --filter <text>   only run the benchmarks whose name contains this\n"
+               "  --seconds <s>     seconds of audio per measurement (default 2)\n"
+               "  --repeats <n>     measurements per benchmark (default 5)\n"
+               "  --quick           same as --seconds 0.2 --repeats 3\n"
+               "  --kernel <name>   render kernels to use: scalar, avx2, avx512\n"
+               "  --no-rt-check     don't check for allocations and locks while rendering\n",
+               stderr);
+}
+
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--json" && hasValue) {
+            options.jsonPath = argv[++i];
+        } else if (arg == "--filter" && hasValue) {
+            options.filter = argv[++i];
+        } else if (arg == "--seconds" && hasValue) {
+            options.seconds = std::atof(argv[++i]);
+        } else if (arg == "--repeats" && hasValue) {
+            options.repeats = std::atoi(argv[++i]);
+        } else if (arg == "--quick") {
+            options.seconds = 0.2;
+            options.repeats = 3;
+        } else if (arg == "--no-rt-check") {
+            options.rtCheck = false;
+        } else if (arg == "--kernel" && hasValue) {
+            std::string name = argv[++i];
+            bool found = false;
+            for (auto level : {KernelLevel::scalar, KernelLevel::avx2, KernelLevel::avx512}) {
+                if (name == getKernelName(level)) {
+                    if (getKernels(level) == nullptr) {
+                        std::fprintf(stderr, "kernel %s is not supported on this CPU\n", name.c_str());
+                        return false;
+                    }
+                    setKernelOverride(level);
+                    found = true;
+                }
+            }
+            if (!found) {
+                std::fprintf(stderr, "unknown kernel: %s\n", name.c_str());
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return options.seconds > 0.0 && options.repeats > 0;
+}
+
+bool matchesFilter(const Options& options, const std::string& name)
+{
+    return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 1;
+    }
+
+    FILE* file = stdout;
+    if (!options.jsonPath.empty()) {
+        file = std::fopen(options.jsonPath.c_str(), "w");
+        if (file == nullptr) {
+            std::fprintf(stderr, "cannot write %s\n", options.jsonPath.c_str());
+            return 1;
+        }
+    }
+
+    Tools::RtCheck::setEnabled(options.rtCheck);
+
+    const char* kernelName = getKernelName(selectKernels().level);
+    std::fprintf(stderr, "jx11_bench, %s kernels\n", kernelName);
+
+    Tools::JsonWriter json(file);
+    json.beginObject();
+    json.member("benchmark", "jx11_bench");
+    json.member("version", JX11_VERSION);
+    json.member("kernel", kernelName);
+    json.member("seconds", options.seconds);
+    json.member("repeats", options.repeats);
+
+    json.key("synth");
+    json.beginArray();
+    for (const auto& b : makeSynthBenchmarks()) {
+        if (!matchesFilter(options, b.name)) {
+            continue;
+        }
+
+        std::vector<double> times;
+        for (int i = 0; i < options.repeats; ++i) {
+            times.push_back(runSynthBenchmark(b, options.seconds));
+        }
+        Result result = summarize(times);
+
+        // In mono mode, only one voice plays no matter how many keys are held.
+        int voices = (b.params.polyMode == 0) ? 1 : b.notes;
+        double nsPerVoiceSample = result.medianNanoseconds / voices;
+
+        // How many times faster than real time.
+        double realtime = 1e9 / b.sampleRate / result.medianNanoseconds;
+
+        std::fprintf(stderr, "  %-28s %8.2f ns/sample %8.2f ns/voice-sample %8.1fx realtime\n",
+                     b.name.c_str(), result.medianNanoseconds, nsPerVoiceSample, realtime);
+
+        json.beginObject();
+        json.member("name", b.name);
+        json.member("group", b.group);
+        json.member("sample_rate", b.sampleRate);
+        json.member("block_size", b.blockSize);
+        json.member("voices", voices);
+        json.member("poly", b.params.polyMode != 0);
+        json.member("glide", b.legatoInterval > 0);
+        json.member("noise", b.params.noise);
+        json.member("vibrato", b.params.vibrato);
+        json.member("mono_output", b.monoOutput);
+        json.member("ns_per_sample", result.medianNanoseconds);
+        json.member("min_ns_per_sample", result.minNanoseconds);
+        json.member("ns_per_voice_sample", nsPerVoiceSample);
+        json.member("realtime_factor", realtime);
+        json.endObject();
+    }
+    json.endArray();
+
+    json.key("micro");
+    json.beginArray();
+    const auto calls = static_cast<long long>(options.seconds * 48000.0 * 8.0);
+    for (const auto& b : makeMicroBenchmarks()) {
+        if (!matchesFilter(options, b.name)) {
+            continue;
+        }
+
+        b.run(calls / 10); // warm up
+        std::vector<double> times;
+        for (int i = 0; i < options.repeats; ++i) {
+            times.push_back(b.run(calls) / double(calls));
+        }
+        Result result = summarize(times);
+
+        std::fprintf(stderr, "  %-28s %8.2f ns/call\n", b.name.c_str(), result.medianNanoseconds);
+
+        json.beginObject();
+        json.member("name", b.name);
+        json.member("calls", calls);
+        json.member("ns_per_call", result.medianNanoseconds);
+        json.member("min_ns_per_call", result.minNanoseconds);
+        json.endObject();
+    }
+    json.endArray();
+
+    const MemoryReport memory = measureMemory(256);
+    std::fprintf(stderr, "  %-28s %8zu bytes per instance (synth %zu, %zu table sets of %zu bytes shared by %zu)\n",
+                 "memory", memory.bytesPerInstance, memory.synthBytes, memory.tableSets, memory.tableBytes,
+                 memory.instances);
+
+    json.key("memory");
+    json.beginObject();
+    json.member("instances", memory.instances);
+    json.member("synth_bytes", memory.synthBytes);
+    json.member("table_bytes", memory.tableBytes);
+    json.member("table_sets", memory.tableSets);
+    json.member("bytes_per_instance", memory.bytesPerInstance);
+    json.member("bytes_per_instance_unshared", memory.synthBytes + memory.tableBytes);
+    json.endObject();
+
+    json.member("rt_violations", static_cast<long long>(Tools::RtCheck::getViolationCount()));
+    json.endObject();
+    json.finish();
+
+    if (file != stdout) {
+        std::fclose(file);
+    }
+
+    Tools::RtCheck::printSummary();
+    return Tools::RtCheck::getViolationCount() > 0 ? 1 : 0;
+}
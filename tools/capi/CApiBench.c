@@ -0,0 +1,286 @@
+/*
+ * jx11_capi_bench: measures what it costs to use the engine through libjx11.
+ *
+ * It renders the same thing, 8 held notes at 48 kHz like jx11_bench, in three
+ * ways: with jx11_render, with jx11_render_interleaved, and with direct calls
+ * to Engine::Synth that are compiled into this program (DirectSynth.cpp). The
+ * difference between the first and the last is the cost of the C API: the
+ * call through the shared library and the checks on the arguments. The block
+ * size goes down to a single frame, where that cost is largest compared to
+ * the work per call.
+ *
+ * Every measurement starts from a new synth. The three ways take turns, and
+ * the fastest of the repeats is kept, so that they see the same conditions.
+ * Before measuring, it checks that all three give exactly the same audio, and
+ * that a synth refuses MIDI and rendering until it is prepared.
+ */
+
+#include "DirectSynth.h"
+#include "jx11.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NOTE_COUNT 8
+#define SAMPLE_RATE 48000.0
+#define MAX_BLOCK_SIZE 1024
+
+typedef enum
+{
+    DIRECT,
+    PLANAR,
+    INTERLEAVED,
+    METHOD_COUNT
+} Method;
+
+static const char* const METHOD_NAMES[METHOD_COUNT] = {"direct", "capi_planar", "capi_interleaved"};
+
+static const int BLOCK_SIZES[] = {1, 16, 64, 256, 1024};
+#define BLOCK_SIZE_COUNT ((int)(sizeof(BLOCK_SIZES) / sizeof(BLOCK_SIZES[0])))
+
+typedef struct
+{
+    double seconds;
+    int repeats;
+    const char* jsonPath;
+} Options;
+
+/* The output buffers, allocated once. */
+static float left[MAX_BLOCK_SIZE];
+static float right[MAX_BLOCK_SIZE];
+static float interleaved[2 * MAX_BLOCK_SIZE];
+
+static double now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* A synth made with one of the methods, with the notes held down. */
+typedef struct
+{
+    Method method;
+    jx11_synth* api;
+    direct_synth* direct;
+} Instance;
+
+static int createInstance(Instance* instance, Method method)
+{
+    instance->method = method;
+    instance->api = NULL;
+    instance->direct = NULL;
+    if (method == DIRECT) {
+        instance->direct = direct_create(SAMPLE_RATE);
+    } else {
+        instance->api = jx11_create();
+        if (instance->api == NULL || jx11_prepare(instance->api, SAMPLE_RATE, MAX_BLOCK_SIZE) != JX11_OK) {
+            return 0;
+        }
+    }
+    for (int i = 0; i < NOTE_COUNT; ++i) {
+        const unsigned char note = (unsigned char)(48 + 5 * i);
+        if (method == DIRECT) {
+            direct_send_midi(instance->direct, 0x90, note, 100);
+        } else {
+            jx11_send_midi(instance->api, 0x90, note, 100);
+        }
+    }
+    return 1;
+}
+
+static void destroyInstance(Instance* instance)
+{
+    if (instance->direct != NULL) {
+        direct_destroy(instance->direct);
+    }
+    if (instance->api != NULL) {
+        jx11_destroy(instance->api);
+    }
+}
+
+/* Renders one block into left and right. */
+static void renderBlock(Instance* instance, int blockSize)
+{
+    switch (instance->method) {
+    case DIRECT:
+        direct_render(instance->direct, left, right, blockSize);
+        break;
+    case PLANAR:
+        jx11_render(instance->api, left, right, blockSize);
+        break;
+    default:
+        jx11_render_interleaved(instance->api, interleaved, blockSize);
+        break;
+    }
+}
+
+/* Seconds per block, rendering the given number of blocks. */
+static double measure(Method method, int blockSize, long blocks)
+{
+    Instance instance;
+    if (!createInstance(&instance, method)) {
+        fprintf(stderr, "cannot create the synth\n");
+        exit(1);
+    }
+    const double start = now();
+    for (long i = 0; i < blocks; ++i) {
+        renderBlock(&instance, blockSize);
+    }
+    const double elapsed = now() - start;
+    destroyInstance(&instance);
+    return elapsed / (double)blocks;
+}
+
+/* Renders a second with every method and compares the audio. */
+static int checkOutput(void)
+{
+    static float expected[2][MAX_BLOCK_SIZE];
+    const int blockSize = 256;
+    Instance instances[METHOD_COUNT];
+    int same = 1;
+
+    for (int m = 0; m < METHOD_COUNT; ++m) {
+        if (!createInstance(&instances[m], (Method)m)) {
+            return 0;
+        }
+    }
+    for (int block = 0; block < (int)SAMPLE_RATE / blockSize; ++block) {
+        for (int m = 0; m < METHOD_COUNT; ++m) {
+            renderBlock(&instances[m], blockSize);
+            if (m == INTERLEAVED) {
+                for (int i = 0; i < blockSize; ++i) {
+                    left[i] = interleaved[2 * i];
+                    right[i] = interleaved[2 * i + 1];
+                }
+            }
+            if (m == DIRECT) {
+                memcpy(expected[0], left, sizeof(float) * (size_t)blockSize);
+                memcpy(expected[1], right, sizeof(float) * (size_t)blockSize);
+            } else if (memcmp(expected[0], left, sizeof(float) * (size_t)blockSize) != 0 ||
+                       memcmp(expected[1], right, sizeof(float) * (size_t)blockSize) != 0) {
+                same = 0;
+            }
+        }
+    }
+    for (int m = 0; m < METHOD_COUNT; ++m) {
+        destroyInstance(&instances[m]);
+    }
+    return same;
+}
+
+/* MIDI and rendering before jx11_prepare must fail without touching the
+ * engine, which has no lookup tables yet. */
+static int checkNotPrepared(void)
+{
+    jx11_synth* synth = jx11_create();
+    if (synth == NULL) {
+        return 0;
+    }
+    int refused = jx11_send_midi(synth, 0x90, 60, 100) == JX11_NOT_PREPARED &&
+                  jx11_send_midi(synth, 0xB0, 0x07, 100) == JX11_NOT_PREPARED &&
+                  jx11_render(synth, left, right, 64) == JX11_NOT_PREPARED &&
+                  jx11_render_interleaved(synth, interleaved, 64) == JX11_NOT_PREPARED;
+    jx11_reset(synth);
+    refused = refused && jx11_prepare(synth, SAMPLE_RATE, MAX_BLOCK_SIZE) == JX11_OK &&
+              jx11_send_midi(synth, 0x90, 60, 100) == JX11_OK;
+    jx11_destroy(synth);
+    return refused;
+}
+
+static void printUsage(void)
+{
+    fputs("usage: jx11_capi_bench [options]\n"
+          "  --json <file>     also write the results as JSON\n"
+          "  --seconds <s>     seconds of audio per measurement (default 2)\n"
+          "  --repeats <n>     measurements per method and block size (default 5)\n"
+          "  --quick           same as --seconds 0.2 --repeats 3\n",
+          stderr);
+}
+
+static int parseOptions(int argc, char* argv[], Options* options)
+{
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const int hasValue = i + 1 < argc;
+        if (strcmp(arg, "--json") == 0 && hasValue) {
+            options->jsonPath = argv[++i];
+        } else if (strcmp(arg, "--seconds") == 0 && hasValue) {
+            options->seconds = atof(argv[++i]);
+        } else if (strcmp(arg, "--repeats") == 0 && hasValue) {
+            options->repeats = atoi(argv[++i]);
+        } else if (strcmp(arg, "--quick") == 0) {
+            options->seconds = 0.2;
+            options->repeats = 3;
+        } else {
+            return 0;
+        }
+    }
+    return options->seconds > 0.0 && options->repeats > 0;
+}
+
+int main(int argc, char* argv[])
+{
+    Options options = {2.0, 5, NULL};
+    if (!parseOptions(argc, argv, &options)) {
+        printUsage();
+        return 1;
+    }
+    if (jx11_get_api_version() != JX11_API_VERSION) {
+        fprintf(stderr, "libjx11 has API version %d, expected %d\n", jx11_get_api_version(), JX11_API_VERSION);
+        return 1;
+    }
+
+    if (!checkNotPrepared()) {
+        fprintf(stderr, "jx11_capi_bench: a synth that is not prepared accepts MIDI or rendering\n");
+        return 1;
+    }
+
+    const int same = checkOutput();
+    printf("jx11_capi_bench: %d notes at %g Hz, output of all methods %s\n", NOTE_COUNT, SAMPLE_RATE,
+           same ? "identical" : "DIFFERENT");
+
+    double best[BLOCK_SIZE_COUNT][METHOD_COUNT];
+    for (int b = 0; b < BLOCK_SIZE_COUNT; ++b) {
+        const int blockSize = BLOCK_SIZES[b];
+        const long blocks = (long)(options.seconds * SAMPLE_RATE / blockSize) + 1;
+        for (int m = 0; m < METHOD_COUNT; ++m) {
+            best[b][m] = 1e30;
+        }
+        for (int r = 0; r < options.repeats; ++r) {
+            for (int m = 0; m < METHOD_COUNT; ++m) {
+                const double seconds = measure((Method)m, blockSize, blocks);
+                if (seconds < best[b][m]) {
+                    best[b][m] = seconds;
+                }
+            }
+        }
+
+        const double direct = best[b][DIRECT];
+        printf("  block %5d: direct %9.1f ns, planar %9.1f ns (%+5.1f %%), interleaved %9.1f ns (%+5.1f %%)\n",
+               blockSize, direct * 1e9, best[b][PLANAR] * 1e9, 100.0 * (best[b][PLANAR] / direct - 1.0),
+               best[b][INTERLEAVED] * 1e9, 100.0 * (best[b][INTERLEAVED] / direct - 1.0));
+    }
+
+    if (options.jsonPath != NULL) {
+        FILE* file = fopen(options.jsonPath, "w");
+        if (file == NULL) {
+            fprintf(stderr, "cannot write %s\n", options.jsonPath);
+            return 1;
+        }
+        fprintf(file, "{\n  \"tool\": \"jx11_capi_bench\",\n  \"api_version\": %d,\n", JX11_API_VERSION);
+        fprintf(file, "  \"output_identical\": %s,\n  \"results\": [", same ? "true" : "false");
+        for (int b = 0; b < BLOCK_SIZE_COUNT; ++b) {
+            for (int m = 0; m < METHOD_COUNT; ++m) {
+                fprintf(file, "%s\n    {\"method\": \"%s\", \"block_size\": %d, \"ns_per_block\": %.1f, "
+                              "\"overhead\": %.4f}",
+                        (b == 0 && m == 0) ? "" : ",", METHOD_NAMES[m], BLOCK_SIZES[b], best[b][m] * 1e9,
+                        best[b][m] / best[b][DIRECT] - 1.0);
+            }
+        }
+        fprintf(file, "\n  ]\n}\n");
+        fclose(file);
+    }
+    return same ? 0 : 1;
+}
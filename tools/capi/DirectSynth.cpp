@@ -0,0 +1,41 @@
+#include "DirectSynth.h"
+#include "engine/Synth.h"
+#include <cmath>
+
+using namespace JX11::Engine;
+
+struct direct_synth
+{
+    Synth synth;
+    Parameters params;
+};
+
+extern "C" {
+
+direct_synth* direct_create(double sample_rate)
+{
+    auto* s = new direct_synth();
+    s->synth.allocateResources(sample_rate, 0);
+    s->synth.reset();
+    s->synth.outputLevelSmoother.setCurrentAndTargetValue(std::pow(10.0f, s->params.outputLevel * 0.05f));
+    s->synth.applyParameters(s->params);
+    return s;
+}
+
+void direct_destroy(direct_synth* synth)
+{
+    delete synth;
+}
+
+void direct_send_midi(direct_synth* synth, unsigned char status, unsigned char data1, unsigned char data2)
+{
+    synth->synth.midiMessage(status, data1, data2);
+}
+
+void direct_render(direct_synth* synth, float* left, float* right, int frame_count)
+{
+    float* outputBuffers[2] = {left, right};
+    synth->synth.render(outputBuffers, frame_count);
+}
+
+} // extern "C"
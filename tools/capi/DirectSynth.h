@@ -0,0 +1,25 @@
+/*
+ * The baseline for jx11_capi_bench: a synth that is driven the same way as by
+ * the C API, but with direct calls to Engine::Synth, compiled into the
+ * benchmark instead of going through the shared library.
+ */
+
+#ifndef JX11_DIRECT_SYNTH_H
+#define JX11_DIRECT_SYNTH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct direct_synth direct_synth;
+
+direct_synth* direct_create(double sample_rate);
+void direct_destroy(direct_synth* synth);
+void direct_send_midi(direct_synth* synth, unsigned char status, unsigned char data1, unsigned char data2);
+void direct_render(direct_synth* synth, float* left, float* right, int frame_count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JX11_DIRECT_SYNTH_H */
@@ -0,0 +1,239 @@
+#pragma once
+
+#include "MidiEvents.h"
+#include "Timer.h"
+#include "WorkStealingPool.h"
+#include "engine/Synth.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace JX11::Tools
+{
+
+// Runs many synths in one process, for instance one per user session, and
+// renders them all once per period on a shared work-stealing pool.
+//
+// Between periods, the owner gives every instance the MIDI for the next
+// period and changes its parameters. renderPeriod then renders the instances
+// that have something to do and waits for all of them:
+//
+// - An instance with no voices playing, no MIDI, no parameter change and a
+//   settled output level is idle, and is skipped. Its output is silence. The
+//   LFO and the noise generator of a skipped instance don't move, so after a
+//   pause an instance doesn't sound exactly like one that rendered the
+//   silence, but the output is still the same for the same MIDI.
+//
+// - The other instances are cut into batches of neighbours with about the
+//   same amount of work, a few per thread. A batch always goes to the same
+//   worker, so an instance keeps running on the same core, where its state is
+//   likely still in the cache. Workers that run out of batches steal whole
+//   batches from the others.
+//
+// - Every instance has a deadline, the time after the start of the period by
+//   which its audio must be done, and keeps count of how often it was late.
+class EngineHost
+{
+public:
+    struct InstanceStats
+    {
+        uint64_t rendered = 0;
+        uint64_t skipped = 0;
+        uint64_t late = 0;
+        double renderSeconds = 0.0;
+        double worstRenderSeconds = 0.0;
+
+        // The latest that its audio was done, after the start of a period.
+        double worstFinishSeconds = 0.0;
+    };
+
+    // On its own cache lines, as different workers update neighbours.
+    struct alignas(64) Instance
+    {
+        Engine::Synth synth;
+        Engine::Parameters params;
+
+        // Set this after changing params. They are applied at the start of
+        // the next period.
+        bool parametersChanged = true;
+
+        // The MIDI for the next period, sorted by offset. Cleared once it has
+        // been played.
+        std::vector<MidiEvent> events;
+
+        // The audio of the last period.
+        std::vector<float> left;
+        std::vector<float> right;
+
+        // Seconds after the start of a period by which the audio must be
+        // done. The length of a period by default.
+        double deadline = 0.0;
+
+        InstanceStats stats;
+
+    private:
+        friend class EngineHost;
+        bool silent = true;
+        bool late = false;
+    };
+
+    struct PeriodStats
+    {
+        double seconds = 0.0;
+        size_t rendered = 0;
+        size_t skipped = 0;
+        size_t batches = 0;
+        size_t late = 0;
+    };
+
+    EngineHost(double sampleRate_, int periodSize_, int threadCount, bool skipIdle_ = true) :
+        sampleRate(sampleRate_), periodSize(periodSize_), skipIdle(skipIdle_), pool(threadCount)
+    {
+    }
+
+    // Allocates everything the instance needs. Call between periods.
+    Instance& addInstance(const Engine::Parameters& params, std::optional<uint32_t> seed = std::nullopt)
+    {
+        auto instance = std::make_unique<Instance>();
+        instance->params = params;
+        instance->left.resize(size_t(periodSize));
+        instance->right.resize(size_t(periodSize));
+        instance->events.reserve(64);
+        instance->deadline = double(periodSize) / sampleRate;
+
+        // Like JX11AudioProcessor::prepareToPlay.
+        Engine::Synth& synth = instance->synth;
+        synth.allocateResources(sampleRate, periodSize);
+        synth.setSeed(seed);
+        synth.reset();
+        synth.outputLevelSmoother.setCurrentAndTargetValue(std::pow(10.0f, params.outputLevel * 0.05f));
+
+        instances.push_back(std::move(instance));
+        active.reserve(instances.size());
+        return *instances.back();
+    }
+
+    size_t getInstanceCount() const { return instances.size(); }
+    Instance& getInstance(size_t index) { return *instances[index]; }
+    int getPeriodSize() const { return periodSize; }
+    int getThreadCount() const { return pool.getThreadCount(); }
+    uint64_t getStealCount() const { return pool.getStealCount(); }
+
+    // Renders one period of every instance, and returns once all are done.
+    PeriodStats renderPeriod()
+    {
+        periodTimer.restart();
+        PeriodStats period;
+
+        active.clear();
+        double totalCost = 0.0;
+        for (size_t i = 0; i < instances.size(); ++i) {
+            Instance& instance = *instances[i];
+            if (skipIdle && isIdle(instance)) {
+                if (!instance.silent) {
+                    std::fill(instance.left.begin(), instance.left.end(), 0.0f);
+                    std::fill(instance.right.begin(), instance.right.end(), 0.0f);
+                    instance.silent = true;
+                }
+                ++instance.stats.skipped;
+                continue;
+            }
+            active.push_back({i, getCost(instance)});
+            totalCost += active.back().cost;
+        }
+        period.skipped = instances.size() - active.size();
+        period.rendered = active.size();
+
+        // Cut the active instances into batches of about the same cost.
+        const int threadCount = pool.getThreadCount();
+        const double batchCost = totalCost / double(threadCount * BATCHES_PER_THREAD);
+        size_t begin = 0;
+        double cost = 0.0;
+        for (size_t i = 0; i < active.size(); ++i) {
+            cost += active[i].cost;
+            if (cost >= batchCost || i + 1 == active.size()) {
+                // The worker that owns this part of the instances.
+                const auto worker = int(active[begin].index * size_t(threadCount) / instances.size());
+                pool.submit([this, begin, end = i + 1](int) { renderBatch(begin, end); }, worker);
+                ++period.batches;
+                begin = i + 1;
+                cost = 0.0;
+            }
+        }
+        pool.wait();
+
+        for (const auto& entry : active) {
+            period.late += instances[entry.index]->late ? 1 : 0;
+        }
+        period.seconds = periodTimer.elapsedNanoseconds() * 1e-9;
+        return period;
+    }
+
+private:
+    static constexpr int BATCHES_PER_THREAD = 4;
+
+    struct ActiveInstance
+    {
+        size_t index;
+        double cost;
+    };
+
+    static bool isIdle(const Instance& instance)
+    {
+        return instance.events.empty() && !instance.parametersChanged &&
+               instance.synth.getActiveVoiceCount() == 0 && !instance.synth.outputLevelSmoother.isSmoothing();
+    }
+
+    // The work for an instance in this period, roughly in voices. The 1 is
+    // for what it costs to render an instance at all.
+    static double getCost(const Instance& instance)
+    {
+        return 1.0 + double(instance.synth.getActiveVoiceCount()) + double(instance.events.size());
+    }
+
+    void renderBatch(size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i) {
+            Instance& instance = *instances[active[i].index];
+            InstanceStats& stats = instance.stats;
+            Timer timer;
+
+            if (instance.parametersChanged) {
+                instance.parametersChanged = false;
+                instance.synth.applyParameters(instance.params);
+            }
+            float* outputBuffers[2] = {instance.left.data(), instance.right.data()};
+            renderWithEvents(instance.synth, outputBuffers, periodSize, instance.events);
+            instance.events.clear();
+
+            const double renderSeconds = timer.elapsedNanoseconds() * 1e-9;
+            const double finishSeconds = periodTimer.elapsedNanoseconds() * 1e-9;
+            ++stats.rendered;
+            stats.renderSeconds += renderSeconds;
+            stats.worstRenderSeconds = std::max(stats.worstRenderSeconds, renderSeconds);
+            stats.worstFinishSeconds = std::max(stats.worstFinishSeconds, finishSeconds);
+
+            instance.silent = false;
+            instance.late = finishSeconds > instance.deadline;
+            if (instance.late) {
+                ++stats.late;
+            }
+        }
+    }
+
+    double sampleRate;
+    int periodSize;
+    bool skipIdle;
+
+    std::vector<std::unique_ptr<Instance>> instances;
+    std::vector<ActiveInstance> active;
+    Timer periodTimer;
+
+    // Last, so that the workers stop before the instances go away.
+    WorkStealingPool pool;
+};
+
+} // namespace JX11::Tools
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace JX11::Tools
+{
+
+// Minimal streaming JSON writer for the reports of the command line tools.
+// Objects and arrays are opened and closed explicitly, commas and indentation
+// are handled here.
+class JsonWriter
+{
+public:
+    explicit JsonWriter(FILE* file_) : file(file_) {}
+
+    void beginObject() { open('{'); }
+    void endObject() { close('}'); }
+    void beginArray() { open('['); }
+    void endArray() { close(']'); }
+
+    // Starts a member of the current object. Follow with a value, or with
+    // beginObject / beginArray.
+    void key(std::string_view name)
+    {
+        separator();
+        writeString(name);
+        std::fputs(": ", file);
+        afterKey = true;
+    }
+
+    void value(std::string_view v)
+    {
+        separator();
+        writeString(v);
+    }
+
+    void value(const char* v) { value(std::string_view(v)); }
+
+    void value(bool v)
+    {
+        separator();
+        std::fputs(v ? "true" : "false", file);
+    }
+
+    void value(double v)
+    {
+        separator();
+        // JSON has no NaN or infinity.
+        if (std::isfinite(v)) {
+            std::fprintf(file, "%.6g", v);
+        } else {
+            std::fputs("null", file);
+        }
+    }
+
+    void value(float v) { value(double(v)); }
+
+    void value(long long v)
+    {
+        separator();
+        std::fprintf(file, "%lld", v);
+    }
+
+    void value(int v) { value((long long)v); }
+    void value(size_t v) { value((long long)v); }
+
+    template <typename T>
+    void member(std::string_view name, const T& v)
+    {
+        key(name);
+        value(v);
+    }
+
+    // Call after the top-level value.
+    void finish() { std::fputc('\n', file); }
+
+private:
+    void open(char bracket)
+    {
+        separator();
+        std::fputc(bracket, file);
+        first.push_back(true);
+    }
+
+    void close(char bracket)
+    {
+        bool empty = first.back();
+        first.pop_back();
+        if (!empty) {
+            newline();
+        }
+        std::fputc(bracket, file);
+    }
+
+    // Writes the comma and newline that go before a new value, unless the
+    // value follows a key.
+    void separator()
+    {
+        if (afterKey) {
+            afterKey = false;
+            return;
+        }
+        if (first.empty()) {
+            return;
+        }
+        if (!first.back()) {
+            std::fputc(',', file);
+        }
+        first.back() = false;
+        newline();
+    }
+
+    void newline()
+    {
+        std::fputc('\n', file);
+        for (size_t i = 0; i < first.size(); ++i) {
+            std::fputs("  ", file);
+        }
+    }
+
+    void writeString(std::string_view s)
+    {
+        std::fputc('"', file);
+        for (char c : s) {
+            switch (c) {
+            case '"':
+                std::fputs("\\\"", file);
+                break;
+            case '\\':
+                std::fputs("\\\\", file);
+                break;
+            case '\n':
+                std::fputs("\\n", file);
+                break;
+            case '\t':
+                std::fputs("\\t", file);
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    std::fprintf(file, "\\u%04x", c);
+                } else {
+                    std::fputc(c, file);
+                }
+            }
+        }
+        std::fputc('"', file);
+    }
+
+    FILE* file;
+
+    // One entry for every open object or array: true until it has a value.
+    std::vector<bool> first;
+
+    bool afterKey = false;
+};
+
+} // namespace JX11::Tools
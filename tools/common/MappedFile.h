@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace JX11::Tools
+{
+
+// Maps a whole file into memory, read-only. The pages are only read from disk
+// when they are touched, and they are shared with the OS file cache, so this
+// is cheaper than reading the file into a buffer.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Returns false if the file can't be opened. An empty file maps to
+    // nullptr with a size of 0.
+    bool open(const std::filesystem::path& path)
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize)) {
+            close();
+            return false;
+        }
+        size = size_t(fileSize.QuadPart);
+        if (size == 0) {
+            opened = true;
+            return true;
+        }
+        mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) {
+            close();
+            return false;
+        }
+        memory = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            ::close(fd);
+            return false;
+        }
+        size = size_t(info.st_size);
+        if (size == 0) {
+            ::close(fd);
+            opened = true;
+            return true;
+        }
+        void* address = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd); // the mapping keeps the file open
+        memory = (address != MAP_FAILED) ? static_cast<const uint8_t*>(address) : nullptr;
+#endif
+        if (memory == nullptr) {
+            close();
+            return false;
+        }
+        opened = true;
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (memory != nullptr) {
+            UnmapViewOfFile(memory);
+        }
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (memory != nullptr) {
+            munmap(const_cast<uint8_t*>(memory), size);
+        }
+#endif
+        memory = nullptr;
+        size = 0;
+        opened = false;
+    }
+
+    bool isOpen() const { return opened; }
+    const uint8_t* data() const { return memory; }
+    size_t getSize() const { return size; }
+
+private:
+    const uint8_t* memory = nullptr;
+    size_t size = 0;
+    bool opened = false;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+} // namespace JX11::Tools
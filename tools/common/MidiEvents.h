@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace JX11::Tools
+{
+
+// A MIDI message at a sample position inside a block.
+struct MidiEvent
+{
+    int offset;
+    uint8_t data0;
+    uint8_t data1;
+    uint8_t data2;
+};
+
+// Renders one block the same way JX11AudioProcessor::splitBufferByEvents does:
+// the audio between two events is rendered in one go, and each event is
+// handled at its sample position. The events must be sorted by offset.
+// SynthType is Engine::Synth, or any class with the same render and
+// midiMessage functions.
+template <typename SynthType>
+void renderWithEvents(SynthType& synth, float** outputBuffers, int sampleCount,
+                             const std::vector<MidiEvent>& events)
+{
+    float* buffers[2];
+    int bufferOffset = 0;
+
+    auto renderSegment = [&](int samplesThisSegment) {
+        buffers[0] = outputBuffers[0] + bufferOffset;
+        buffers[1] = (outputBuffers[1] != nullptr) ? outputBuffers[1] + bufferOffset : nullptr;
+        synth.render(buffers, samplesThisSegment);
+        bufferOffset += samplesThisSegment;
+    };
+
+    for (const auto& event : events) {
+        int samplesThisSegment = event.offset - bufferOffset;
+        if (samplesThisSegment > 0) {
+            renderSegment(samplesThisSegment);
+        }
+        synth.midiMessage(event.data0, event.data1, event.data2);
+    }
+
+    int samplesLastSegment = sampleCount - bufferOffset;
+    if (samplesLastSegment > 0) {
+        renderSegment(samplesLastSegment);
+    }
+}
+
+} // namespace JX11::Tools
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace JX11::Tools
+{
+
+// A channel message from a MIDI file, with its time in seconds.
+struct TimedMidiMessage
+{
+    double seconds;
+    uint8_t data0;
+    uint8_t data1;
+    uint8_t data2;
+};
+
+// Reads the channel messages of a Standard MIDI File (format 0 or 1) into one
+// list, sorted by time. The ticks are turned into seconds with the tempo map,
+// which may be in any track. SysEx and meta events other than the tempo are
+// skipped.
+class MidiFileReader
+{
+public:
+    bool read(const std::string& path, std::vector<TimedMidiMessage>& messages, std::string& error)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            error = "cannot open " + path;
+            return false;
+        }
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        position = 0;
+        events.clear();
+
+        if (!readHeader(error)) {
+            return false;
+        }
+        for (int track = 0; track < trackCount; ++track) {
+            if (!readTrack(error)) {
+                return false;
+            }
+        }
+
+        // At the same tick, the tempo changes go first, otherwise keep the
+        // order of the file.
+        std::stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+            return a.tick < b.tick || (a.tick == b.tick && a.tempo != 0 && b.tempo == 0);
+        });
+
+        messages.clear();
+        double seconds = 0.0;
+        uint64_t lastTick = 0;
+        double secondsPerTick = getSecondsPerTick(500000); // 120 BPM until the first tempo event
+        for (const auto& event : events) {
+            seconds += double(event.tick - lastTick) * secondsPerTick;
+            lastTick = event.tick;
+            if (event.tempo != 0) {
+                secondsPerTick = getSecondsPerTick(event.tempo);
+            } else {
+                messages.push_back({seconds, event.data0, event.data1, event.data2});
+            }
+        }
+        return true;
+    }
+
+private:
+    struct Event
+    {
+        uint64_t tick;
+        uint32_t tempo; // microseconds per quarter note, 0 for channel messages
+        uint8_t data0;
+        uint8_t data1;
+        uint8_t data2;
+    };
+
+    bool readHeader(std::string& error)
+    {
+        uint32_t length = 0;
+        if (!expectChunk("MThd", length) || length < 6) {
+            error = "not a Standard MIDI File";
+            return false;
+        }
+        size_t end = position + length;
+        int format = readU16();
+        trackCount = readU16();
+        division = readU16();
+        position = end;
+
+        if (format > 1) {
+            error = "format 2 MIDI files are not supported";
+            return false;
+        }
+        if (division == 0) {
+            error = "invalid time division";
+            return false;
+        }
+        return true;
+    }
+
+    bool readTrack(std::string& error)
+    {
+        uint32_t length = 0;
+        while (true) {
+            if (position + 8 > data.size()) {
+                error = "missing track";
+                return false;
+            }
+            if (expectChunk("MTrk", length)) {
+                break;
+            }
+            // Skip unknown chunks.
+            position += 8 + readU32At(position + 4);
+        }
+
+        const size_t end = std::min(data.size(), position + length);
+        uint64_t tick = 0;
+        uint8_t runningStatus = 0;
+
+        while (position < end) {
+            tick += readVariableLength(end);
+            if (position >= end) {
+                break;
+            }
+
+            uint8_t status = data[position];
+            if (status < 0x80) {
+                // Running status: reuse the last status byte.
+                if (runningStatus == 0) {
+                    error = "data byte without a status byte";
+                    return false;
+                }
+                status = runningStatus;
+            } else {
+                ++position;
+            }
+
+            if (status == 0xFF) {
+                if (position >= end) {
+                    break;
+                }
+                uint8_t type = data[position++];
+                uint32_t size = readVariableLength(end);
+                if (type == 0x51 && size == 3 && position + 3 <= end) {
+                    uint32_t tempo = uint32_t(data[position]) << 16 | uint32_t(data[position + 1]) << 8 |
+                                     data[position + 2];
+                    if (tempo > 0) {
+                        events.push_back({tick, tempo, 0, 0, 0});
+                    }
+                } else if (type == 0x2F) {
+                    position = end; // end of track
+                    break;
+                }
+                position += size;
+            } else if (status == 0xF0 || status == 0xF7) {
+                position += readVariableLength(end);
+            } else if (status < 0xF0) {
+                runningStatus = status;
+                const int dataBytes = ((status & 0xF0) == 0xC0 || (status & 0xF0) == 0xD0) ? 1 : 2;
+                if (position + size_t(dataBytes) > end) {
+                    break;
+                }
+                uint8_t data1 = data[position++];
+                uint8_t data2 = (dataBytes == 2) ? data[position++] : 0;
+                events.push_back({tick, 0, status, data1, data2});
+            } else {
+                // System common and real-time messages don't belong in a file.
+                error = "unexpected status byte";
+                return false;
+            }
+        }
+        position = end;
+        return true;
+    }
+
+    double getSecondsPerTick(uint32_t tempo) const
+    {
+        if ((division & 0x8000) != 0) {
+            // SMPTE: frames per second in the high byte, ticks per frame in
+            // the low byte. The tempo doesn't matter.
+            int framesPerSecond = -int8_t(division >> 8);
+            int ticksPerFrame = division & 0xFF;
+            double fps = (framesPerSecond == 29) ? 29.97 : double(framesPerSecond);
+            return 1.0 / (fps * std::max(1, ticksPerFrame));
+        }
+        return double(tempo) * 1e-6 / double(division);
+    }
+
+    bool expectChunk(const char* id, uint32_t& length)
+    {
+        if (position + 8 > data.size() || std::memcmp(data.data() + position, id, 4) != 0) {
+            return false;
+        }
+        length = readU32At(position + 4);
+        position += 8;
+        return true;
+    }
+
+    uint32_t readU32At(size_t at) const
+    {
+        return uint32_t(data[at]) << 24 | uint32_t(data[at + 1]) << 16 | uint32_t(data[at + 2]) << 8 | data[at + 3];
+    }
+
+    int readU16()
+    {
+        if (position + 2 > data.size()) {
+            return 0;
+        }
+        int value = data[position] << 8 | data[position + 1];
+        position += 2;
+        return value;
+    }
+
+    uint32_t readVariableLength(size_t end)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < 4 && position < end; ++i) {
+            uint8_t byte = data[position++];
+            value = (value << 7) | (byte & 0x7F);
+            if ((byte & 0x80) == 0) {
+                break;
+            }
+        }
+        return value;
+    }
+
+    std::vector<uint8_t> data;
+    size_t position = 0;
+    int trackCount = 0;
+    int division = 0;
+    std::vector<Event> events;
+};
+
+} // namespace JX11::Tools
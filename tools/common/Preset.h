@@ -0,0 +1,53 @@
+#pragma once
+
+#include "PresetLibrary.h"
+#include "engine/PluginState.h"
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+namespace JX11::Tools
+{
+
+// Reads a preset saved by BaseProcessor::getStateInformation, in the binary
+// format or the XML of older versions. See Engine::readPluginState.
+inline bool parsePreset(std::string_view data, Engine::Parameters& params, std::string& error)
+{
+    const char* message = nullptr;
+    if (!Engine::readPluginState(data, params, message)) {
+        error = message;
+        return false;
+    }
+    return true;
+}
+
+// A preset in a library, see PresetLibrary.h, is <library>#<name>.
+inline bool loadPreset(const std::string& path, Engine::Parameters& params, std::string& error)
+{
+    const size_t hash = path.rfind('#');
+    if (hash != std::string::npos && !std::filesystem::exists(path)) {
+        PresetLibrary library;
+        if (!library.open(path.substr(0, hash), error)) {
+            return false;
+        }
+        const auto index = library.find(std::string_view(path).substr(hash + 1));
+        if (!index) {
+            error = "no preset " + path.substr(hash + 1) + " in " + path.substr(0, hash);
+            return false;
+        }
+        params = library.getParameters(*index);
+        return true;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return parsePreset(data, params, error);
+}
+
+} // namespace JX11::Tools
@@ -0,0 +1,437 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "engine/PluginState.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace JX11::Tools
+{
+
+// A single file with many presets, for batch jobs that would otherwise spend
+// their startup listing and reading thousands of state files. The file is
+// memory-mapped, and finding a preset by name or by index only touches the
+// header, one or two slots of the hash table, the index entry and the record,
+// so opening a library of 100k presets costs the same as one of ten.
+//
+// All numbers are little-endian, and every section starts on a multiple of 8
+// bytes:
+//
+//     header       96 bytes, see below
+//     entries      presetCount x 24 bytes: uint64 FNV-1a hash of the name,
+//                  uint32 name offset and uint32 name length in the strings,
+//                  uint32 first tag in the tag list and uint32 tag count
+//     slots        slotCount x uint32: the hash table, with open addressing
+//                  and linear probing. A slot holds an entry index + 1, or 0
+//                  when it's empty. slotCount is a power of two, at least
+//                  twice presetCount.
+//     tags         tagCount x 8 bytes: uint32 name offset, uint32 length
+//     tag list     tagListCount x uint32 tag numbers, the tags of each entry
+//     records      presetCount x valueCount x float32, the values of the
+//                  parameters in their own units, as ParameterInfo::get
+//                  returns them, in the order of PARAMETER_INFOS. Reading a
+//                  record is a copy: the values were converted from the
+//                  normalized ones of the state when the library was built.
+//                  A record's offset follows from its index.
+//     strings      the names of the presets and the tags, in UTF-8
+//
+// The header:
+//
+//     offset 0    "JX11PLIB"
+//     offset 8    uint32 version, LIBRARY_VERSION
+//     offset 12   uint32 presetCount
+//     offset 16   uint32 valueCount
+//     offset 20   uint32 slotCount
+//     offset 24   uint32 tagCount
+//     offset 28   uint32 tagListCount
+//     offset 32   uint64 offsets of the entries, slots, tags, tag list,
+//                 records and strings, in that order
+//     offset 80   uint64 size of the strings
+//     offset 88   uint64 reserved, 0
+//
+// Like in the plugin state, a library from an older version has fewer values
+// per record, and the parameters after them keep their default value.
+
+inline constexpr uint32_t LIBRARY_VERSION = 1;
+
+namespace PresetLibraryDetail
+{
+
+inline constexpr size_t HEADER_SIZE = 96;
+inline constexpr size_t ENTRY_SIZE = 24;
+
+inline uint64_t hashName(std::string_view name)
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (char c : name) {
+        hash = (hash ^ uint8_t(c)) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+inline uint32_t readUint32(const uint8_t* p)
+{
+    return Engine::PluginStateDetail::readUint32(reinterpret_cast<const char*>(p));
+}
+
+inline uint64_t readUint64(const uint8_t* p) { return readUint32(p) | uint64_t(readUint32(p + 4)) << 32; }
+
+inline void writeUint64(uint8_t* p, uint64_t value)
+{
+    Engine::PluginStateDetail::writeUint32(p, uint32_t(value));
+    Engine::PluginStateDetail::writeUint32(p + 4, uint32_t(value >> 32));
+}
+
+} // namespace PresetLibraryDetail
+
+// Reads a library. Nothing is read from disk until it's used.
+class PresetLibrary
+{
+public:
+    // Checks the header and that every section is inside the file. The
+    // offsets inside the entries are checked when they are used.
+    bool open(const std::filesystem::path& path, std::string& error)
+    {
+        using namespace PresetLibraryDetail;
+        close();
+        if (!file.open(path)) {
+            error = "cannot open " + path.string();
+            return false;
+        }
+        const uint8_t* data = file.data();
+        const uint64_t size = file.getSize();
+        if (size < HEADER_SIZE || std::memcmp(data, "JX11PLIB", 8) != 0) {
+            error = path.string() + " is not a preset library";
+            return close();
+        }
+        // Version 0 was never written, so the file is damaged.
+        const uint32_t version = readUint32(data + 8);
+        if (version == 0) {
+            error = path.string() + " is damaged";
+            return close();
+        }
+        if (version > LIBRARY_VERSION) {
+            error = path.string() + " is from a newer version";
+            return close();
+        }
+
+        presetCount = readUint32(data + 12);
+        valueCount = readUint32(data + 16);
+        slotCount = readUint32(data + 20);
+        tagCount = readUint32(data + 24);
+        tagListCount = readUint32(data + 28);
+        stringsSize = readUint64(data + 80);
+
+        // The counts are 32-bit, so these products can't overflow.
+        const bool valid = slotCount >= 2 * uint64_t(presetCount) && slotCount > 0 &&
+                           (slotCount & (slotCount - 1)) == 0 &&
+                           isInside(data + 32, uint64_t(presetCount) * ENTRY_SIZE) &&
+                           isInside(data + 40, uint64_t(slotCount) * 4) && isInside(data + 48, uint64_t(tagCount) * 8) &&
+                           isInside(data + 56, uint64_t(tagListCount) * 4) &&
+                           isInside(data + 64, uint64_t(presetCount) * valueCount * 4) &&
+                           isInside(data + 72, stringsSize);
+        if (!valid) {
+            error = path.string() + " is damaged";
+            return close();
+        }
+        entries = data + readUint64(data + 32);
+        slots = data + readUint64(data + 40);
+        tags = data + readUint64(data + 48);
+        tagList = data + readUint64(data + 56);
+        records = data + readUint64(data + 64);
+        strings = data + readUint64(data + 72);
+        return true;
+    }
+
+    bool close()
+    {
+        file.close();
+        presetCount = 0;
+        tagCount = 0;
+        return false;
+    }
+
+    bool isOpen() const { return file.isOpen(); }
+    size_t size() const { return presetCount; }
+    size_t getTagCount() const { return tagCount; }
+
+    // The index of the preset with this name.
+    std::optional<size_t> find(std::string_view name) const
+    {
+        using namespace PresetLibraryDetail;
+        if (presetCount == 0) {
+            return std::nullopt;
+        }
+        const uint64_t hash = hashName(name);
+        // A damaged file may have no empty slot, so don't probe forever.
+        const uint32_t mask = slotCount - 1;
+        uint32_t slot = uint32_t(hash) & mask;
+        for (uint32_t probe = 0; probe < slotCount; ++probe, slot = (slot + 1) & mask) {
+            const uint32_t value = readUint32(slots + 4 * size_t(slot));
+            if (value == 0 || value > presetCount) {
+                return std::nullopt;
+            }
+            const size_t index = value - 1;
+            if (readUint64(getEntry(index)) == hash && getName(index) == name) {
+                return index;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Empty if there is no such preset, or if the name is outside the strings.
+    std::string_view getName(size_t index) const
+    {
+        if (index >= presetCount) {
+            return {};
+        }
+        const uint8_t* entry = getEntry(index);
+        return getString(PresetLibraryDetail::readUint32(entry + 8), PresetLibraryDetail::readUint32(entry + 12));
+    }
+
+    // The tags of a preset, as numbers from 0 to getTagCount() - 1.
+    std::vector<uint32_t> getTags(size_t index) const
+    {
+        using namespace PresetLibraryDetail;
+        std::vector<uint32_t> result;
+        if (index >= presetCount) {
+            return result;
+        }
+        const uint8_t* entry = getEntry(index);
+        const uint64_t first = readUint32(entry + 16);
+        const uint64_t count = readUint32(entry + 20);
+        for (uint64_t i = first; i < first + count && i < tagListCount; ++i) {
+            const uint32_t tag = readUint32(tagList + 4 * i);
+            if (tag < tagCount) {
+                result.push_back(tag);
+            }
+        }
+        return result;
+    }
+
+    // Empty if there is no such tag.
+    std::string_view getTagName(uint32_t tag) const
+    {
+        if (tag >= tagCount) {
+            return {};
+        }
+        const uint8_t* p = tags + 8 * size_t(tag);
+        return getString(PresetLibraryDetail::readUint32(p), PresetLibraryDetail::readUint32(p + 4));
+    }
+
+    std::optional<uint32_t> findTag(std::string_view name) const
+    {
+        for (uint32_t tag = 0; tag < tagCount; ++tag) {
+            if (getTagName(tag) == name) {
+                return tag;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Parameters that the record doesn't have, or that aren't a number, keep
+    // their default. The others are snapped and clamped to their range, like
+    // readPluginState does, so a damaged file can't put a parameter out of
+    // range. All defaults if there is no such preset.
+    Engine::Parameters getParameters(size_t index) const
+    {
+        Engine::Parameters params;
+        if (index >= presetCount) {
+            return params;
+        }
+        const uint8_t* record = records + size_t(valueCount) * 4 * index;
+        const size_t count = std::min(size_t(valueCount), Engine::PARAMETER_COUNT);
+        for (size_t i = 0; i < count; ++i) {
+            const uint32_t bits = PresetLibraryDetail::readUint32(record + 4 * i);
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            if (!std::isfinite(value)) {
+                continue;
+            }
+            Engine::PARAMETER_INFOS[i].set(params, value);
+        }
+        return params;
+    }
+
+private:
+    // Whether the section whose offset is at header fits in the file.
+    bool isInside(const uint8_t* header, uint64_t sectionSize) const
+    {
+        const uint64_t offset = PresetLibraryDetail::readUint64(header);
+        return offset <= file.getSize() && sectionSize <= file.getSize() - offset;
+    }
+
+    const uint8_t* getEntry(size_t index) const { return entries + PresetLibraryDetail::ENTRY_SIZE * index; }
+
+    std::string_view getString(uint64_t offset, uint64_t length) const
+    {
+        if (offset > stringsSize || length > stringsSize - offset) {
+            return {};
+        }
+        return {reinterpret_cast<const char*>(strings + offset), size_t(length)};
+    }
+
+    MappedFile file;
+    uint32_t presetCount = 0;
+    uint32_t valueCount = 0;
+    uint32_t slotCount = 0;
+    uint32_t tagCount = 0;
+    uint32_t tagListCount = 0;
+    const uint8_t* entries = nullptr;
+    const uint8_t* slots = nullptr;
+    const uint8_t* tags = nullptr;
+    const uint8_t* tagList = nullptr;
+    const uint8_t* records = nullptr;
+    const uint8_t* strings = nullptr;
+    uint64_t stringsSize = 0;
+};
+
+// Collects presets and writes them as a library.
+class PresetLibraryWriter
+{
+public:
+    // Returns false if there is already a preset with this name.
+    bool add(const std::string& name, const Engine::Parameters& params, const std::vector<std::string>& tagNames)
+    {
+        if (!names.insert(name).second) {
+            return false;
+        }
+        Preset preset {name, params, {}};
+        for (const auto& tagName : tagNames) {
+            const auto [it, added] = tagNumbers.try_emplace(tagName, uint32_t(tagNumbers.size()));
+            preset.tags.push_back(it->second);
+        }
+        presets.push_back(std::move(preset));
+        return true;
+    }
+
+    size_t size() const { return presets.size(); }
+    size_t getTagCount() const { return tagNumbers.size(); }
+
+    // Returns the size of the file, or 0 if it can't be written.
+    uint64_t write(const std::filesystem::path& path, std::string& error) const
+    {
+        using namespace PresetLibraryDetail;
+        using Engine::PluginStateDetail::writeUint32;
+
+        uint32_t slotCount = 1;
+        while (slotCount < 2 * presets.size()) {
+            slotCount *= 2;
+        }
+        std::vector<std::string_view> tagNames(tagNumbers.size());
+        for (const auto& [name, number] : tagNumbers) {
+            tagNames[number] = name;
+        }
+        size_t tagListCount = 0;
+        uint64_t stringsSize = 0;
+        for (const auto& name : tagNames) {
+            stringsSize += name.size();
+        }
+        for (const auto& preset : presets) {
+            tagListCount += preset.tags.size();
+            stringsSize += preset.name.size();
+        }
+        // The name offsets are 32-bit.
+        if (stringsSize > UINT32_MAX || presets.size() > UINT32_MAX / 2) {
+            error = "too many presets";
+            return 0;
+        }
+        std::string strings;
+        strings.reserve(stringsSize);
+
+        auto align = [](uint64_t offset) { return (offset + 7) & ~uint64_t(7); };
+        const uint64_t entriesOffset = HEADER_SIZE;
+        const uint64_t slotsOffset = align(entriesOffset + ENTRY_SIZE * presets.size());
+        const uint64_t tagsOffset = align(slotsOffset + 4 * uint64_t(slotCount));
+        const uint64_t tagListOffset = align(tagsOffset + 8 * tagNames.size());
+        const uint64_t recordsOffset = align(tagListOffset + 4 * tagListCount);
+        const uint64_t stringsOffset = align(recordsOffset + 4 * Engine::PARAMETER_COUNT * presets.size());
+
+        std::vector<uint8_t> out(stringsOffset);
+        uint8_t* data = out.data();
+        std::memcpy(data, "JX11PLIB", 8);
+        writeUint32(data + 8, LIBRARY_VERSION);
+        writeUint32(data + 12, uint32_t(presets.size()));
+        writeUint32(data + 16, uint32_t(Engine::PARAMETER_COUNT));
+        writeUint32(data + 20, slotCount);
+        writeUint32(data + 24, uint32_t(tagNames.size()));
+        writeUint32(data + 28, uint32_t(tagListCount));
+        const uint64_t offsets[] = {entriesOffset, slotsOffset, tagsOffset, tagListOffset, recordsOffset, stringsOffset};
+        for (size_t i = 0; i < std::size(offsets); ++i) {
+            writeUint64(data + 32 + 8 * i, offsets[i]);
+        }
+
+        for (size_t tag = 0; tag < tagNames.size(); ++tag) {
+            writeUint32(data + tagsOffset + 8 * tag, uint32_t(strings.size()));
+            writeUint32(data + tagsOffset + 8 * tag + 4, uint32_t(tagNames[tag].size()));
+            strings += tagNames[tag];
+        }
+
+        const uint32_t mask = slotCount - 1;
+        size_t tagListIndex = 0;
+        for (size_t index = 0; index < presets.size(); ++index) {
+            const Preset& preset = presets[index];
+            const uint64_t hash = hashName(preset.name);
+            uint8_t* entry = data + entriesOffset + ENTRY_SIZE * index;
+            writeUint64(entry, hash);
+            writeUint32(entry + 8, uint32_t(strings.size()));
+            writeUint32(entry + 12, uint32_t(preset.name.size()));
+            writeUint32(entry + 16, uint32_t(tagListIndex));
+            writeUint32(entry + 20, uint32_t(preset.tags.size()));
+            strings += preset.name;
+
+            for (uint32_t tag : preset.tags) {
+                writeUint32(data + tagListOffset + 4 * tagListIndex++, tag);
+            }
+
+            uint32_t slot = uint32_t(hash) & mask;
+            while (readUint32(data + slotsOffset + 4 * slot) != 0) {
+                slot = (slot + 1) & mask;
+            }
+            writeUint32(data + slotsOffset + 4 * slot, uint32_t(index + 1));
+
+            uint8_t* record = data + recordsOffset + 4 * Engine::PARAMETER_COUNT * index;
+            for (size_t i = 0; i < Engine::PARAMETER_COUNT; ++i) {
+                const float value = Engine::PARAMETER_INFOS[i].get(preset.params);
+                uint32_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                writeUint32(record + 4 * i, bits);
+            }
+        }
+        writeUint64(data + 80, strings.size());
+
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(out.data()), std::streamsize(out.size()));
+        file.write(strings.data(), std::streamsize(strings.size()));
+        if (!file) {
+            error = "cannot write " + path.string();
+            return 0;
+        }
+        return out.size() + strings.size();
+    }
+
+private:
+    struct Preset
+    {
+        std::string name;
+        Engine::Parameters params;
+        std::vector<uint32_t> tags;
+    };
+
+    std::vector<Preset> presets;
+    std::unordered_set<std::string> names;
+    std::map<std::string, uint32_t> tagNumbers;
+};
+
+} // namespace JX11::Tools
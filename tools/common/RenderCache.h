@@ -0,0 +1,244 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+namespace JX11::Tools
+{
+
+// Builds the key of a render from everything that affects its output. This
+// is a 128-bit hash: two 64-bit FNV-1a hashes with different offset bases.
+class CacheKey
+{
+public:
+    void add(const void* data, size_t size)
+    {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            low = (low ^ bytes[i]) * PRIME;
+            high = (high ^ bytes[i]) * PRIME;
+        }
+    }
+
+    // Numbers are hashed by their bytes, so 0.0 and -0.0 are different.
+    template <typename T>
+        requires std::is_arithmetic_v<T>
+    void add(T value)
+    {
+        add(&value, sizeof(value));
+    }
+
+    // The length goes first, so that "ab" + "c" and "a" + "bc" differ.
+    void add(std::string_view text)
+    {
+        add(uint64_t(text.size()));
+        add(text.data(), text.size());
+    }
+
+    // 32 hexadecimal digits.
+    std::string toString() const
+    {
+        char text[33];
+        std::snprintf(text, sizeof(text), "%016llx%016llx", (unsigned long long)high, (unsigned long long)low);
+        return text;
+    }
+
+private:
+    static constexpr uint64_t PRIME = 0x100000001B3ull;
+    uint64_t low = 0xCBF29CE484222325ull;
+    uint64_t high = 0x6C62272E07BB0142ull;
+};
+
+// A directory of finished renders, one file per key. A hit is copied to the
+// output file with std::filesystem::copy_file, which lets the system copy it
+// without reading it into the process. When the files take up more than the
+// size limit, the ones that were used least recently are removed, when the
+// cache is opened and every time a render is added. The modification time of
+// a file is the time it was last used.
+//
+// Several processes can use the same cache directory. New files are written
+// under a temporary name and then renamed, and the stats are a log that every
+// process appends a line to.
+class RenderCache
+{
+public:
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+
+        // The size of the files that came from the cache instead of being
+        // rendered.
+        uint64_t bytesSaved = 0;
+
+        double getHitRate() const { return hits + misses > 0 ? double(hits) / double(hits + misses) : 0.0; }
+    };
+
+    RenderCache(std::filesystem::path directory_, uint64_t maxBytes_) :
+        directory(std::move(directory_)), maxBytes(maxBytes_)
+    {
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        evict({});
+    }
+
+    // Copies the render for this key to `destination` and returns its size.
+    // Counts a hit or a miss. A render that another process removes in the
+    // meantime is a miss.
+    std::optional<uint64_t> find(const std::string& key, const std::filesystem::path& destination)
+    {
+        const auto path = getPath(key);
+        std::error_code error;
+        const auto size = std::filesystem::file_size(path, error);
+        if (!error) {
+            std::filesystem::copy_file(path, destination, std::filesystem::copy_options::overwrite_existing, error);
+        }
+        if (error) {
+            log("miss 0");
+            return std::nullopt;
+        }
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+        log("hit " + std::to_string(size));
+        return size;
+    }
+
+    // Copies a finished render into the cache, then makes room for it. The
+    // cache is trimmed even when the render is not added, for instance
+    // because it is larger than the size limit on its own. Returns false if
+    // the file could not be added.
+    bool insert(const std::string& key, const std::filesystem::path& source)
+    {
+        const bool added = copyIn(key, source);
+        evict(added ? getPath(key) : std::filesystem::path());
+        return added;
+    }
+
+    // Adds up the log of all the processes that used the cache.
+    Stats getStats() const
+    {
+        Stats stats;
+        FILE* file = std::fopen((directory / "stats.log").string().c_str(), "r");
+        if (file == nullptr) {
+            return stats;
+        }
+        char result[8];
+        unsigned long long bytes;
+        while (std::fscanf(file, "%7s %llu", result, &bytes) == 2) {
+            if (std::string_view(result) == "hit") {
+                ++stats.hits;
+                stats.bytesSaved += bytes;
+            } else {
+                ++stats.misses;
+            }
+        }
+        std::fclose(file);
+        return stats;
+    }
+
+    // The total size of the renders in the cache.
+    uint64_t getSize() const
+    {
+        uint64_t total = 0;
+        for (const auto& entry : listEntries()) {
+            total += entry.size;
+        }
+        return total;
+    }
+
+private:
+    static constexpr const char* EXTENSION = ".wav";
+
+    struct Entry
+    {
+        std::filesystem::path path;
+        std::filesystem::file_time_type lastUsed;
+        uint64_t size;
+    };
+
+    std::filesystem::path getPath(const std::string& key) const { return directory / (key + EXTENSION); }
+
+    bool copyIn(const std::string& key, const std::filesystem::path& source)
+    {
+        std::error_code error;
+        const auto size = std::filesystem::file_size(source, error);
+        if (error || size > maxBytes) {
+            return false;
+        }
+
+        const auto ticks = std::chrono::steady_clock::now().time_since_epoch().count();
+        const auto temporary = directory / (key + "." + std::to_string(ticks) + ".tmp");
+        std::filesystem::copy_file(source, temporary, std::filesystem::copy_options::overwrite_existing, error);
+        if (!error) {
+            std::filesystem::rename(temporary, getPath(key), error);
+        }
+        if (error) {
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+        return true;
+    }
+
+    std::vector<Entry> listEntries() const
+    {
+        std::vector<Entry> entries;
+        std::error_code error;
+        for (const auto& file : std::filesystem::directory_iterator(directory, error)) {
+            std::error_code fileError;
+            if (file.path().extension() == EXTENSION && file.is_regular_file(fileError)) {
+                Entry entry {file.path(), file.last_write_time(fileError), file.file_size(fileError)};
+                if (!fileError) {
+                    entries.push_back(entry);
+                }
+            }
+        }
+        return entries;
+    }
+
+    // Removes the least recently used renders until the cache fits in its
+    // size limit. `keep`, the render that was just added, stays.
+    void evict(const std::filesystem::path& keep)
+    {
+        auto entries = listEntries();
+        uint64_t total = 0;
+        for (const auto& entry : entries) {
+            total += entry.size;
+        }
+        std::sort(entries.begin(), entries.end(),
+                  [](const Entry& a, const Entry& b) { return a.lastUsed < b.lastUsed; });
+
+        for (const auto& entry : entries) {
+            if (total <= maxBytes) {
+                break;
+            }
+            std::error_code error;
+            if (entry.path != keep && std::filesystem::remove(entry.path, error)) {
+                total -= entry.size;
+            }
+        }
+    }
+
+    // One short write in append mode, so lines from different processes
+    // don't get mixed up.
+    void log(const std::string& line) const
+    {
+        FILE* file = std::fopen((directory / "stats.log").string().c_str(), "a");
+        if (file != nullptr) {
+            std::fputs((line + "\n").c_str(), file);
+            std::fclose(file);
+        }
+    }
+
+    std::filesystem::path directory;
+    uint64_t maxBytes;
+};
+
+} // namespace JX11::Tools
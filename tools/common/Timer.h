@@ -0,0 +1,54 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace JX11::Tools
+{
+
+// Measures elapsed wall-clock time in nanoseconds.
+class Timer
+{
+public:
+    Timer() : start(Clock::now()) {}
+
+    void restart() { start = Clock::now(); }
+
+    double elapsedNanoseconds() const
+    {
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point start;
+};
+
+// Keeps the compiler from optimizing away a value that is computed only to be
+// measured.
+template <typename T>
+inline void doNotOptimize(T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : "+m"(value) : : "memory");
+#else
+    *static_cast<volatile T*>(&value) = value;
+#endif
+}
+
+// Returns the value below which `fraction` of the samples fall, using the
+// nearest rank. Sorts the samples.
+inline double percentile(std::vector<double>& samples, double fraction)
+{
+    if (samples.empty()) {
+        return 0.0;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto rank = static_cast<size_t>(std::ceil(fraction * double(samples.size())));
+    return samples[std::clamp(rank, size_t(1), samples.size()) - 1];
+}
+
+} // namespace JX11::Tools
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace JX11::Tools
+{
+
+enum class SampleFormat
+{
+    pcm16,
+    pcm24,
+    float32
+};
+
+inline int getBytesPerSample(SampleFormat format)
+{
+    switch (format) {
+    case SampleFormat::pcm16:
+        return 2;
+    case SampleFormat::pcm24:
+        return 3;
+    default:
+        return 4;
+    }
+}
+
+// Stores a sample in little-endian order, the way WAV files have them, and
+// returns the position after it. Integer samples are clipped.
+inline uint8_t* writeSample(uint8_t* out, float sample, SampleFormat format)
+{
+    switch (format) {
+    case SampleFormat::pcm16: {
+        auto value = int32_t(std::lrint(std::clamp(sample, -1.0f, 1.0f) * 32767.0f));
+        out[0] = uint8_t(value);
+        out[1] = uint8_t(value >> 8);
+        return out + 2;
+    }
+    case SampleFormat::pcm24: {
+        auto value = int32_t(std::lrint(std::clamp(sample, -1.0f, 1.0f) * 8388607.0f));
+        out[0] = uint8_t(value);
+        out[1] = uint8_t(value >> 8);
+        out[2] = uint8_t(value >> 16);
+        return out + 3;
+    }
+    case SampleFormat::float32:
+    default: {
+        uint32_t bits;
+        std::memcpy(&bits, &sample, sizeof(bits));
+        for (int i = 0; i < 4; ++i) {
+            out[i] = uint8_t(bits >> (8 * i));
+        }
+        return out + 4;
+    }
+    }
+}
+
+// Writes a stereo WAV file. The sizes in the header are filled in by close().
+class WavWriter
+{
+public:
+    WavWriter() = default;
+    ~WavWriter() { close(); }
+
+    WavWriter(const WavWriter&) = delete;
+    WavWriter& operator=(const WavWriter&) = delete;
+
+    bool open(const std::string& path, int sampleRate_, SampleFormat format_)
+    {
+        close();
+        file = std::fopen(path.c_str(), "wb");
+        if (file == nullptr) {
+            return false;
+        }
+        sampleRate = sampleRate_;
+        format = format_;
+        frames = 0;
+        writeHeader();
+        return true;
+    }
+
+    // Appends frameCount samples of the left and right channel. If right is
+    // nullptr, left is written to both channels.
+    void write(const float* left, const float* right, int frameCount)
+    {
+        if (right == nullptr) {
+            right = left;
+        }
+        const int bytes = getBytesPerSample(format);
+        buffer.resize(size_t(frameCount) * 2 * size_t(bytes));
+        uint8_t* out = buffer.data();
+        for (int i = 0; i < frameCount; ++i) {
+            out = writeSample(out, left[i], format);
+            out = writeSample(out, right[i], format);
+        }
+        std::fwrite(buffer.data(), 1, buffer.size(), file);
+        frames += uint64_t(frameCount);
+    }
+
+    // Finishes the header and closes the file. Returns false if anything
+    // could not be written.
+    bool close()
+    {
+        if (file == nullptr) {
+            return true;
+        }
+        std::fseek(file, 0, SEEK_SET);
+        writeHeader();
+        bool ok = std::ferror(file) == 0;
+        ok = (std::fclose(file) == 0) && ok;
+        file = nullptr;
+        return ok;
+    }
+
+    uint64_t getFrameCount() const { return frames; }
+
+private:
+    static void writeLE(uint8_t* out, uint64_t value, int bytes)
+    {
+        for (int i = 0; i < bytes; ++i) {
+            out[i] = uint8_t(value >> (8 * i));
+        }
+    }
+
+    void writeHeader()
+    {
+        const int bytes = getBytesPerSample(format);
+        const int channels = 2;
+        const uint64_t dataSize = frames * uint64_t(channels * bytes);
+        const uint16_t formatTag = (format == SampleFormat::float32) ? 3 : 1; // IEEE float or PCM
+
+        // RIFF sizes are 32 bits; files over 4 GB get clamped sizes, which
+        // most readers accept for the last chunk.
+        const auto clamp32 = [](uint64_t size) { return std::min<uint64_t>(size, 0xFFFFFFFFu); };
+
+        uint8_t header[44];
+        std::memcpy(header, "RIFF", 4);
+        writeLE(header + 4, clamp32(36 + dataSize), 4);
+        std::memcpy(header + 8, "WAVEfmt ", 8);
+        writeLE(header + 16, 16, 4);
+        writeLE(header + 20, formatTag, 2);
+        writeLE(header + 22, channels, 2);
+        writeLE(header + 24, uint64_t(sampleRate), 4);
+        writeLE(header + 28, uint64_t(sampleRate) * uint64_t(channels * bytes), 4);
+        writeLE(header + 32, uint64_t(channels * bytes), 2);
+        writeLE(header + 34, uint64_t(8 * bytes), 2);
+        std::memcpy(header + 36, "data", 4);
+        writeLE(header + 40, clamp32(dataSize), 4);
+        std::fwrite(header, 1, sizeof(header), file);
+    }
+
+    FILE* file = nullptr;
+    int sampleRate = 0;
+    SampleFormat format = SampleFormat::float32;
+    uint64_t frames = 0;
+    std::vector<uint8_t> buffer;
+};
+
+} // namespace JX11::Tools
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace JX11::Tools
+{
+
+// A fixed set of worker threads for tasks that take a while, like rendering a
+// whole note.
+//
+// Every worker has its own queue. It takes tasks from the back of its own
+// queue, and when that is empty it steals from the front of the queues of the
+// other workers. So the workers that get the short tasks end up helping the
+// ones with the long tasks, without all of them fighting over one queue.
+//
+// A task gets the index of the worker that runs it, so it can use resources
+// that belong to that worker, like a preallocated Synth.
+class WorkStealingPool
+{
+public:
+    using Task = std::function<void(int worker)>;
+
+    explicit WorkStealingPool(int threadCount)
+    {
+        threadCount = std::max(1, threadCount);
+        for (int i = 0; i < threadCount; ++i) {
+            queues.push_back(std::make_unique<Queue>());
+        }
+        for (int i = 0; i < threadCount; ++i) {
+            threads.emplace_back([this, i] { run(i); });
+        }
+    }
+
+    ~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    int getThreadCount() const { return static_cast<int>(queues.size()); }
+
+    // Adds a task to the queue of a worker. Without a worker index, the tasks
+    // are spread over the workers in turn.
+    void submit(Task task, int worker = -1)
+    {
+        if (worker < 0) {
+            worker = static_cast<int>(nextQueue++ % queues.size());
+        }
+        pending.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(queues[size_t(worker)]->mutex);
+            queues[size_t(worker)]->tasks.push_back(std::move(task));
+        }
+        queued.fetch_add(1);
+
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wakeUp.notify_one();
+    }
+
+    // Blocks until all submitted tasks have finished.
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        done.wait(lock, [this] { return pending.load() == 0; });
+    }
+
+    // Number of tasks that were run by another worker than the one they were
+    // submitted to.
+    uint64_t getStealCount() const { return steals.load(); }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void run(int worker)
+    {
+        while (true) {
+            Task task;
+            if (pop(worker, task) || steal(worker, task)) {
+                task(worker);
+                if (pending.fetch_sub(1) == 1) {
+                    std::lock_guard<std::mutex> lock(doneMutex);
+                    done.notify_all();
+                }
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wakeUp.wait(lock, [this] { return stopping || queued.load() > 0; });
+            if (stopping) {
+                return;
+            }
+        }
+    }
+
+    bool pop(int worker, Task& task)
+    {
+        Queue& queue = *queues[size_t(worker)];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return false;
+        }
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        queued.fetch_sub(1);
+        return true;
+    }
+
+    bool steal(int worker, Task& task)
+    {
+        const size_t count = queues.size();
+        for (size_t i = 1; i < count; ++i) {
+            Queue& victim = *queues[(size_t(worker) + i) % count];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                queued.fetch_sub(1);
+                steals.fetch_add(1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    size_t nextQueue = 0;
+
+    // Tasks that are in a queue, and tasks that haven't finished yet.
+    std::atomic<int64_t> queued {0};
+    std::atomic<int64_t> pending {0};
+    std::atomic<uint64_t> steals {0};
+
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+
+    std::mutex doneMutex;
+    std::condition_variable done;
+};
+
+} // namespace JX11::Tools
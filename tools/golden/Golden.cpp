@@ -0,0 +1,583 @@
+// jx11_golden: compares the optimized engine against a frozen reference.
+//
+// The code in reference/ is a copy of the scalar engine from before the render
+// kernels were vectorized. Every patch and performance in the corpus is
+// rendered by the reference and by the engine, once for each kernel level the
+// CPU supports. The report shows the max absolute error, the RMS error in
+// dBFS and the speedup over the reference.
+//
+// Each kernel has its own tolerance. Kernels.cpp is built without fused
+// multiply-add, so every kernel must match the reference exactly. The building
+// blocks of a voice are also compared one by one, and a morph at 0 and 1
+// against the two presets it morphs between.
+//
+// Exits with an error if any tolerance is exceeded.
+
+#include "common/Json.h"
+#include "common/MidiEvents.h"
+#include "common/Timer.h"
+#include "engine/KernelMath.h"
+#include "engine/Synth.h"
+#include "reference/Synth.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace JX11;
+using Tools::MidiEvent;
+
+namespace
+{
+
+constexpr double SAMPLE_RATE = 48000.0;
+constexpr int BLOCK_SIZE = 256;
+
+struct Tolerance
+{
+    const char* kernel;
+    double maxAbsError;
+    double maxRmsErrorDb;
+};
+
+// Tolerances for the kernel levels and for the building blocks of a voice.
+const Tolerance TOLERANCES[] = {
+    {"scalar", 0.0, -std::numeric_limits<double>::infinity()},
+    {"avx2", 0.0, -std::numeric_limits<double>::infinity()},
+    {"avx512", 0.0, -std::numeric_limits<double>::infinity()},
+    {"oscillator", 0.0, -std::numeric_limits<double>::infinity()},
+    {"filter", 0.0, -std::numeric_limits<double>::infinity()},
+    {"envelope", 0.0, -std::numeric_limits<double>::infinity()},
+    {"morph", 0.0, -std::numeric_limits<double>::infinity()},
+};
+
+const Tolerance& getTolerance(const std::string& kernel)
+{
+    for (const auto& tolerance : TOLERANCES) {
+        if (kernel == tolerance.kernel) {
+            return tolerance;
+        }
+    }
+    std::fprintf(stderr, "no tolerance for %s\n", kernel.c_str());
+    std::exit(1);
+}
+
+// Accumulates the difference between two signals.
+struct ErrorStats
+{
+    double maxAbsError = 0.0;
+    double sumSquaredError = 0.0;
+    long long count = 0;
+
+    void add(float expected, float actual)
+    {
+        // Both paths may output NaN for the same input, which counts as a
+        // match. NaN in only one of them is an infinite error.
+        double error = 0.0;
+        if (std::isnan(expected) || std::isnan(actual)) {
+            error = (std::isnan(expected) && std::isnan(actual)) ? 0.0 : std::numeric_limits<double>::infinity();
+        } else {
+            error = double(actual) - double(expected);
+        }
+        maxAbsError = std::max(maxAbsError, std::abs(error));
+        sumSquaredError += error * error;
+        count += 1;
+    }
+
+    void add(const ErrorStats& other)
+    {
+        maxAbsError = std::max(maxAbsError, other.maxAbsError);
+        sumSquaredError += other.sumSquaredError;
+        count += other.count;
+    }
+
+    // -inf when the signals are identical.
+    double rmsErrorDb() const
+    {
+        double rms = std::sqrt(sumSquaredError / double(std::max(count, 1LL)));
+        return 20.0 * std::log10(rms);
+    }
+
+    bool withinTolerance(const Tolerance& tolerance) const
+    {
+        return maxAbsError <= tolerance.maxAbsError && rmsErrorDb() <= tolerance.maxRmsErrorDb;
+    }
+};
+
+// === Corpus ===
+
+struct Patch
+{
+    const char* name;
+    Engine::Parameters params;
+};
+
+std::vector<Patch> makePatches()
+{
+    std::vector<Patch> patches;
+    patches.push_back({"init", {}});
+
+    Patch p {"square", {}};
+    p.params.oscMix = 100.0f;
+    p.params.oscTune = 0.0f;
+    p.params.oscFine = 10.0f;
+    patches.push_back(p);
+
+    p = {"pwm", {}};
+    p.params.oscMix = 100.0f;
+    p.params.vibrato = -60.0f;
+    patches.push_back(p);
+
+    p = {"vibrato", {}};
+    p.params.vibrato = 60.0f;
+    p.params.lfoRate = 0.6f;
+    patches.push_back(p);
+
+    p = {"noise", {}};
+    p.params.noise = 80.0f;
+    patches.push_back(p);
+
+    p = {"resonant", {}};
+    p.params.filterFreq = 40.0f;
+    p.params.filterReso = 90.0f;
+    p.params.filterEnv = 80.0f;
+    p.params.filterLFO = 50.0f;
+    patches.push_back(p);
+
+    p = {"pad", {}};
+    p.params.envAttack = 60.0f;
+    p.params.envRelease = 70.0f;
+    p.params.filterAttack = 50.0f;
+    p.params.filterSustain = 60.0f;
+    patches.push_back(p);
+
+    p = {"velocity", {}};
+    p.params.filterVelocity = 80.0f;
+    p.params.filterFreq = 30.0f;
+    patches.push_back(p);
+
+    p = {"mono_glide", {}};
+    p.params.polyMode = 0;
+    p.params.glideMode = 2;
+    p.params.glideRate = 60.0f;
+    p.params.glideBend = -5.0f;
+    patches.push_back(p);
+
+    return patches;
+}
+
+struct TimedEvent
+{
+    long long position;
+    MidiEvent event;
+};
+
+struct Performance
+{
+    const char* name;
+    std::vector<TimedEvent> events;
+    long long length;
+};
+
+void addNote(std::vector<TimedEvent>& events, long long start, long long length, uint8_t note, uint8_t velocity)
+{
+    events.push_back({start, {0, 0x90, note, velocity}});
+    events.push_back({start + length, {0, 0x80, note, 0}});
+}
+
+std::vector<Performance> makePerformances()
+{
+    const auto beat = static_cast<long long>(0.25 * SAMPLE_RATE);
+    std::vector<Performance> performances;
+
+    // Overlapping chords, more notes than there are voices.
+    Performance chords {"chords", {}, 20 * beat};
+    const uint8_t roots[] = {48, 45, 41, 43};
+    for (int bar = 0; bar < 4; ++bar) {
+        for (uint8_t i = 0; i < 5; ++i) {
+            addNote(chords.events, bar * 4 * beat + i * 7, 5 * beat, uint8_t(roots[bar] + 4 * i), uint8_t(60 + 15 * i));
+        }
+    }
+    performances.push_back(chords);
+
+    // Fast notes with different velocities.
+    Performance arpeggio {"arpeggio", {}, 17 * beat};
+    for (int step = 0; step < 64; ++step) {
+        addNote(arpeggio.events, step * beat / 4 + 3, beat / 3, uint8_t(48 + (step * 5) % 24), uint8_t(30 + (step * 37) % 97));
+    }
+    performances.push_back(arpeggio);
+
+    // A monophonic line where the notes overlap.
+    Performance legato {"legato", {}, 18 * beat};
+    const uint8_t line[] = {60, 62, 64, 67, 72, 67, 64, 62};
+    for (int step = 0; step < 16; ++step) {
+        addNote(legato.events, step * beat + 11, beat + beat / 2, line[step % 8], 100);
+    }
+    performances.push_back(legato);
+
+    // Controllers: pitch bend, mod wheel, aftertouch, filter and resonance,
+    // the sustain pedal and finally all notes off.
+    Performance controllers {"controllers", {}, 16 * beat};
+    controllers.events.push_back({0, {0, 0xB0, 0x40, 127}});
+    for (uint8_t i = 0; i < 4; ++i) {
+        addNote(controllers.events, i * 101, 2 * beat, uint8_t(55 + 5 * i), 100);
+    }
+    for (int step = 0; step < 64; ++step) {
+        long long position = step * beat / 8 + 17;
+        auto value = uint8_t((step * 11) % 128);
+        controllers.events.push_back({position, {0, 0xE0, 0, value}});
+        controllers.events.push_back({position + 1, {0, 0xB0, 0x01, value}});
+        controllers.events.push_back({position + 2, {0, 0xD0, uint8_t(127 - value), 0}});
+        controllers.events.push_back({position + 3, {0, 0xB0, 0x4A, value}});
+        controllers.events.push_back({position + 4, {0, 0xB0, 0x47, uint8_t(value / 2)}});
+    }
+    controllers.events.push_back({6 * beat, {0, 0xB0, 0x40, 0}});
+    addNote(controllers.events, 7 * beat, 4 * beat, 48, 90);
+    addNote(controllers.events, 7 * beat + 5, 4 * beat, 60, 90);
+    controllers.events.push_back({9 * beat, {0, 0xB0, 0x7B, 0}});
+    performances.push_back(controllers);
+
+    for (auto& performance : performances) {
+        std::stable_sort(performance.events.begin(), performance.events.end(),
+                         [](const TimedEvent& a, const TimedEvent& b) { return a.position < b.position; });
+    }
+    return performances;
+}
+
+// Renders a performance in blocks, the way the plugin does, with a synth that
+// has been set up. Returns the rendering time in nanoseconds.
+template <typename SynthType>
+double renderPerformance(SynthType& synth, const Performance& performance, bool stereo, std::vector<float>& left,
+                         std::vector<float>& right)
+{
+    left.assign(size_t(performance.length), 0.0f);
+    right.assign(size_t(performance.length), 0.0f);
+
+    std::vector<MidiEvent> events;
+    size_t next = 0;
+    double elapsed = 0.0;
+    for (long long position = 0; position < performance.length; position += BLOCK_SIZE) {
+        int blockSize = int(std::min<long long>(BLOCK_SIZE, performance.length - position));
+
+        events.clear();
+        while (next < performance.events.size() && performance.events[next].position < position + blockSize) {
+            MidiEvent event = performance.events[next].event;
+            event.offset = int(performance.events[next].position - position);
+            events.push_back(event);
+            ++next;
+        }
+
+        float* outputBuffers[2] = {left.data() + position, stereo ? right.data() + position : nullptr};
+        Tools::Timer timer;
+        Tools::renderWithEvents(synth, outputBuffers, blockSize, events);
+        elapsed += timer.elapsedNanoseconds();
+    }
+    return elapsed;
+}
+
+// Renders a performance with a patch.
+template <typename SynthType>
+double render(SynthType& synth, const Patch& patch, const Performance& performance, bool stereo,
+              std::vector<float>& left, std::vector<float>& right)
+{
+    synth.allocateResources(SAMPLE_RATE, BLOCK_SIZE);
+    synth.applyParameters(patch.params);
+    synth.reset();
+    return renderPerformance(synth, performance, stereo, left, right);
+}
+
+// === Building blocks ===
+
+// Compares the building blocks of a voice against the reference, using the
+// same inputs for both.
+std::vector<std::pair<std::string, ErrorStats>> compareBuildingBlocks()
+{
+    std::vector<std::pair<std::string, ErrorStats>> results;
+    constexpr int SAMPLES = 48000;
+
+    {
+        ErrorStats stats;
+        for (float period : {20.0f, 109.0f, 183.4f, 734.0f}) {
+            Engine::Oscillator osc {};
+            Reference::Oscillator ref {};
+            osc.reset();
+            ref.reset();
+            osc.period = ref.period = period;
+            for (int i = 0; i < SAMPLES; ++i) {
+                // Modulate the period, like vibrato does.
+                osc.modulation = ref.modulation = 1.0f + 0.01f * std::sin(float(i) * 0.001f);
+                stats.add(ref.nextSample(), osc.nextSample());
+            }
+        }
+        results.push_back({"oscillator", stats});
+    }
+
+    {
+        // A sawtooth through a filter whose cutoff and resonance move, with
+        // new coefficients every 32 samples like in the synth.
+        ErrorStats stats;
+        Engine::Filter filter;
+        Reference::Filter ref;
+        filter.sampleRate = ref.sampleRate = float(SAMPLE_RATE);
+        filter.reset();
+        ref.reset();
+
+        float x = 0.0f;
+        for (int i = 0; i < SAMPLES; ++i) {
+            if (i % 32 == 0) {
+                float cutoff = 30.0f * std::pow(600.0f, 0.5f + 0.5f * std::sin(float(i) * 0.0003f));
+                float q = 1.0f + 10.0f * float(i) / SAMPLES;
+                filter.updateCoefficients(cutoff, q);
+                ref.updateCoefficients(cutoff, q);
+            }
+            x += 0.013f;
+            if (x > 1.0f) {
+                x -= 2.0f;
+            }
+            stats.add(ref.render(x), filter.render(x));
+        }
+        results.push_back({"filter", stats});
+    }
+
+    {
+        // The kernels run the envelope with KernelMath::envelopeStep. Start
+        // both from an attack, then release halfway, until the reference
+        // falls silent.
+        ErrorStats stats;
+        for (float speed : {0.99f, 0.999f, 0.9999f}) {
+            Reference::Envelope ref;
+            ref.reset();
+            ref.attackMultiplier = speed;
+            ref.decayMultiplier = speed;
+            ref.sustainLevel = 0.5f;
+            ref.releaseMultiplier = speed;
+            ref.attack();
+
+            // Same state as Envelope::attack() sets up.
+            float level = Engine::SILENCE + Engine::SILENCE;
+            float target = 2.0f;
+            float multiplier = speed;
+            const float decayMultiplier = speed;
+            const float sustainLevel = 0.5f;
+
+            for (int i = 0; i < 4 * SAMPLES && ref.isActive(); ++i) {
+                if (i == 2 * SAMPLES) {
+                    ref.release();
+                    target = 0.0f;
+                    multiplier = speed;
+                }
+                bool active;
+                float actual = Engine::KernelMath::envelopeStep(level, target, multiplier, decayMultiplier,
+                                                                sustainLevel, active);
+                stats.add(ref.nextValue(), actual);
+            }
+        }
+        results.push_back({"envelope", stats});
+    }
+
+    return results;
+}
+
+// A morph at amount 0 and 1 must sound exactly like the presets it morphs
+// between, at full quality and at the lowest quality level, where the
+// control period is different. Each patch morphs to the next one.
+std::pair<std::string, ErrorStats> compareMorphs(const std::vector<Patch>& patches,
+                                                 const std::vector<Performance>& performances)
+{
+    ErrorStats stats;
+    std::vector<float> expectedLeft, expectedRight, left, right;
+    for (size_t i = 0; i < patches.size(); ++i) {
+        const Patch& from = patches[i];
+        const Patch& to = patches[(i + 1) % patches.size()];
+        for (int qualityLevel : {0, Engine::QUALITY_LEVEL_COUNT - 1}) {
+            for (float amount : {0.0f, 1.0f}) {
+                const Patch& patch = (amount == 0.0f) ? from : to;
+                const auto& performance = performances[i % performances.size()];
+
+                auto expected = std::make_unique<Engine::Synth>();
+                expected->allocateResources(SAMPLE_RATE, BLOCK_SIZE);
+                expected->applyParameters(patch.params);
+                expected->reset();
+                expected->setQualityLevel(qualityLevel);
+                renderPerformance(*expected, performance, true, expectedLeft, expectedRight);
+
+                auto synth = std::make_unique<Engine::Synth>();
+                synth->allocateResources(SAMPLE_RATE, BLOCK_SIZE);
+                synth->setMorph(synth->computeCoefficientSets(from.params), synth->computeCoefficientSets(to.params),
+                                amount);
+                synth->reset();
+                synth->setQualityLevel(qualityLevel);
+                renderPerformance(*synth, performance, true, left, right);
+
+                for (size_t n = 0; n < left.size(); ++n) {
+                    stats.add(expectedLeft[n], left[n]);
+                    stats.add(expectedRight[n], right[n]);
+                }
+            }
+        }
+    }
+    return {"morph", stats};
+}
+
+// === Main ===
+
+struct KernelReport
+{
+    std::string kernel;
+    ErrorStats errors;
+    std::string worstCase;
+    double worstCaseError = 0.0;
+    double referenceNanoseconds = 0.0;
+    double kernelNanoseconds = 0.0;
+    bool passed = true;
+};
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    bool verbose = false;
+    std::string jsonPath;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--verbose") {
+            verbose = true;
+        } else if (arg == "--json" && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else {
+            std::fputs("usage: jx11_golden [--verbose] [--json <file>]\n", stderr);
+            return 1;
+        }
+    }
+
+    const auto patches = makePatches();
+    const auto performances = makePerformances();
+
+    std::vector<Engine::KernelLevel> levels;
+    for (auto level : {Engine::KernelLevel::scalar, Engine::KernelLevel::avx2, Engine::KernelLevel::avx512}) {
+        if (Engine::getKernels(level) != nullptr) {
+            levels.push_back(level);
+        }
+    }
+
+    std::vector<KernelReport> reports;
+    for (auto level : levels) {
+        KernelReport report;
+        report.kernel = Engine::getKernelName(level);
+        reports.push_back(report);
+    }
+
+    // Rendered output of the reference and the engine.
+    std::vector<float> refLeft, refRight, left, right;
+
+    for (const auto& patch : patches) {
+        for (const auto& performance : performances) {
+            for (bool stereo : {true, false}) {
+                // Every render gets a new synth. Synth::reset doesn't reset all
+                // of the oscillator state, so reusing one would carry some of it
+                // over from the previous render.
+                auto reference = std::make_unique<Reference::Synth>();
+                double refTime = render(*reference, patch, performance, stereo, refLeft, refRight);
+
+                for (size_t i = 0; i < levels.size(); ++i) {
+                    auto& report = reports[i];
+                    Engine::setKernelOverride(levels[i]);
+                    auto synth = std::make_unique<Engine::Synth>();
+                    double time = render(*synth, patch, performance, stereo, left, right);
+
+                    ErrorStats stats;
+                    for (size_t n = 0; n < left.size(); ++n) {
+                        stats.add(refLeft[n], left[n]);
+                        if (stereo) {
+                            stats.add(refRight[n], right[n]);
+                        }
+                    }
+
+                    std::string name = std::string(patch.name) + "/" + performance.name + (stereo ? "" : "/mono");
+                    if (verbose) {
+                        std::printf("  %-8s %-32s max abs %.3g, rms %.1f dBFS\n", report.kernel.c_str(), name.c_str(),
+                                    stats.maxAbsError, stats.rmsErrorDb());
+                    }
+                    if (stats.maxAbsError > report.worstCaseError || report.worstCase.empty()) {
+                        report.worstCase = name;
+                        report.worstCaseError = stats.maxAbsError;
+                    }
+                    report.errors.add(stats);
+                    report.referenceNanoseconds += refTime;
+                    report.kernelNanoseconds += time;
+                }
+            }
+        }
+    }
+    Engine::setKernelOverride(std::nullopt);
+
+    bool passed = true;
+    std::printf("jx11_golden: %d patches x %d performances, stereo and mono\n", int(patches.size()),
+                int(performances.size()));
+    std::printf("  %-20s %12s %14s %10s  %s\n", "kernel", "max abs", "rms dBFS", "speedup", "worst case");
+    for (auto& report : reports) {
+        report.passed = report.errors.withinTolerance(getTolerance(report.kernel));
+        passed = passed && report.passed;
+        std::printf("  %-20s %12.3g %14.1f %9.2fx  %s %s\n", report.kernel.c_str(), report.errors.maxAbsError,
+                    report.errors.rmsErrorDb(), report.referenceNanoseconds / report.kernelNanoseconds,
+                    report.worstCase.c_str(), report.passed ? "" : "FAILED");
+    }
+
+    auto blocks = compareBuildingBlocks();
+    blocks.push_back(compareMorphs(patches, performances));
+    for (const auto& [name, stats] : blocks) {
+        bool ok = stats.withinTolerance(getTolerance(name));
+        passed = passed && ok;
+        std::printf("  %-20s %12.3g %14.1f %10s  %s\n", name.c_str(), stats.maxAbsError, stats.rmsErrorDb(), "",
+                    ok ? "" : "FAILED");
+    }
+
+    if (!jsonPath.empty()) {
+        FILE* file = std::fopen(jsonPath.c_str(), "w");
+        if (file == nullptr) {
+            std::fprintf(stderr, "cannot write %s\n", jsonPath.c_str());
+            return 1;
+        }
+        Tools::JsonWriter json(file);
+        json.beginObject();
+        json.member("benchmark", "jx11_golden");
+        json.member("version", JX11_VERSION);
+        json.key("kernels");
+        json.beginArray();
+        for (const auto& report : reports) {
+            const auto& tolerance = getTolerance(report.kernel);
+            json.beginObject();
+            json.member("kernel", report.kernel);
+            json.member("max_abs_error", report.errors.maxAbsError);
+            json.member("rms_error_dbfs", report.errors.rmsErrorDb());
+            json.member("speedup", report.referenceNanoseconds / report.kernelNanoseconds);
+            json.member("worst_case", report.worstCase);
+            json.member("tolerance_max_abs_error", tolerance.maxAbsError);
+            json.member("tolerance_rms_error_dbfs", tolerance.maxRmsErrorDb);
+            json.member("passed", report.passed);
+            json.endObject();
+        }
+        for (const auto& [name, stats] : blocks) {
+            const auto& tolerance = getTolerance(name);
+            json.beginObject();
+            json.member("kernel", name);
+            json.member("max_abs_error", stats.maxAbsError);
+            json.member("rms_error_dbfs", stats.rmsErrorDb());
+            json.member("tolerance_max_abs_error", tolerance.maxAbsError);
+            json.member("tolerance_rms_error_dbfs", tolerance.maxRmsErrorDb);
+            json.member("passed", stats.withinTolerance(tolerance));
+            json.endObject();
+        }
+        json.endArray();
+        json.endObject();
+        json.finish();
+        std::fclose(file);
+    }
+
+    std::puts(passed ? "PASSED" : "FAILED");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+// Frozen copy of the scalar engine code, used as the reference for the
+// optimized engine. Don't change or optimize this.
+
+namespace JX11::Reference
+{
+
+// Very simple white noise generator.
+class NoiseGenerator
+{
+public:
+    void reset()
+    {
+        noiseSeed = 22222;
+    }
+
+    float nextValue()
+    {
+        // Generate the next integer pseudorandom number.
+        noiseSeed = noiseSeed * 196314165 + 907633515;
+
+        // Convert to a signed value.
+        int temp = int(noiseSeed >> 7) - 16777216;
+
+        // Convert to a floating-point number between -1.0 and 1.0.
+        return float(temp) / 16777216.0f;
+    }
+
+private:
+    unsigned int noiseSeed;
+};
+
+} // namespace JX11::Reference
@@ -0,0 +1,640 @@
+// Frozen copy of the scalar engine code, used as the reference for the
+// optimized engine. Don't change or optimize this.
+
+#include "Synth.h"
+#include <cmath>
+#include <limits>
+
+namespace JX11::Reference
+{
+
+static const float ANALOG = 0.002f; // oscillator drift
+
+// Special "note number" that says this voice is now kept alive by the sustain
+// pedal being pressed down. As soon as the pedal is released, this voice will
+// fade out.
+static const size_t SUSTAIN = std::numeric_limits<size_t>::max();
+
+// Same as juce::Decibels::decibelsToGain.
+static float decibelsToGain(float decibels)
+{
+    return decibels > -100.0f ? std::pow(10.0f, decibels * 0.05f) : 0.0f;
+}
+
+void Synth::allocateResources(double sampleRate_, int /*samplesPerBlock*/)
+{
+    sampleRate = static_cast<float>(sampleRate_);
+
+    for (auto& voice : voices) {
+        voice.filter.sampleRate = sampleRate;
+    }
+}
+
+void Synth::deallocateResources()
+{
+    // do nothing
+}
+
+void Synth::reset()
+{
+    // Turn off all playing voices.
+    for (auto& voice : voices) {
+        voice.reset();
+    }
+
+    noiseGen.reset();
+    heldNotes.reset();
+
+    // These variables are changed by MIDI CC, reset to defaults.
+    pitchBend = 1.0f;
+    sustainPedalPressed = false;
+    modWheel = 0.0f;
+    resonanceCtl = 1.0f;
+    pressure = 0.0f;
+    filterCtl = 0.0f;
+
+    // Reset other state.
+    lfo = 0.0f;
+    lfoStep = 0;
+    lastNote = 0;
+    filterZip = 0.0f;
+
+    outputLevelSmoother.reset(sampleRate, 0.05);
+}
+
+void Synth::applyParameters(const Parameters& params)
+{
+    // The plugin calls this from the audio callback whenever any of the
+    // parameters have changed. Here, we simply recalculate everything when
+    // this happens. This function is called at most once per audio block.
+    // It could be optimized to recalculate only the things that have changed,
+    // but doing the bookkeeping for that also has a cost. Still, it might be
+    // worth it for parameters that are heavily automated.
+
+    float inverseSampleRate = 1.0f / sampleRate;
+
+    // The envelope is implemented using a simple one-pole filter, which creates
+    // an analog-style exponential curve. The formulas below calculate the filter
+    // coefficients for the attack, decay, and release stages.
+    envAttack = std::exp(-inverseSampleRate * std::exp(5.5f - 0.075f * params.envAttack));
+    envDecay = std::exp(-inverseSampleRate * std::exp(5.5f - 0.075f * params.envDecay));
+
+    envSustain = params.envSustain / 100.0f;
+
+    if (params.envRelease < 1.0f) {
+        envRelease = 0.75f; // extra fast release
+    } else {
+        envRelease = std::exp(-inverseSampleRate * std::exp(5.5f - 0.075f * params.envRelease));
+    }
+
+    // How much noise to mix into the signal. This is a parabolic curve,
+    // similar to creating a parameter with skew = 0.5.
+    float noiseAmount = params.noise / 100.0f;
+    noiseMix = noiseAmount * noiseAmount * 0.06f;
+
+    // How much to mix osc2 into the output. This is a value between 0 and 1.
+    oscMix = params.oscMix / 100.0f;
+
+    // Calculate the multiplication factor for detuning oscillator 2. This is
+    // the same as 2^(N/12) where N is the number of (fractional) semitones.
+    // This value will be multiplied with the oscillator period, which is why
+    // detuning down is greater than 1, as lowering the pitch means the period
+    // becomes longer. Vice versa for going up in pitch.
+    float semi = params.oscTune;
+    float cent = params.oscFine;
+    detune = std::pow(1.059463094359f, -semi - 0.01f * cent);
+
+    // Master tuning. See the book for a full explanation of what happens here.
+    float octave = params.octave; // -2 to +2
+    float tuning = params.tuning; // -100 to +100
+    float tuneInSemi = -36.3763f - 12.0f * octave - tuning / 100.0f;
+    tune = sampleRate * std::exp(0.05776226505f * tuneInSemi);
+
+    // Mono or poly?
+    numVoices = (params.polyMode == 0) ? 1 : MAX_VOICES;
+
+    // Convert decibels to gain. Use a smoother for this parameter.
+    outputLevelSmoother.setTargetValue(decibelsToGain(params.outputLevel));
+
+    // Filter velocity sensitivity, a value between -0.05 and +0.05.
+    // If disabled, the velocity is completely ignored.
+    float filterVelocity = params.filterVelocity;
+    if (filterVelocity < -90.0f) {
+        velocitySensitivity = 0.0f; // turn off velocity
+        ignoreVelocity = true;
+    } else {
+        velocitySensitivity = 0.0005f * filterVelocity;
+        ignoreVelocity = false;
+    }
+
+    // Use a lower update rate for the glide and filter envelope, 32 times
+    // (= LFO_MAX) slower than the sample rate.
+    const float inverseUpdateRate = inverseSampleRate * static_cast<float>(LFO_MAX);
+
+    // The LFO rate is an exponentional curve that maps the 0 - 1 parameter
+    // value to 0.018 Hz - 20.09 Hz. Use this to calculate the phase increment
+    // for a sine wave running at 1/32th the sample rate.
+    float lfoRate = std::exp(7.0f * params.lfoRate - 4.0f);
+    lfoInc = lfoRate * inverseUpdateRate * TWO_PI;
+
+    // The vibrato parameter is a parabolic curve going from 0.0 for 0% up to
+    // 0.05 for 100%. You can choose between PWM mode (to the left) and vibrato
+    // mode (to the right). These values are used as the amplitude of the LFO
+    // sine wave that modulates the oscillator periods.
+    float vibratoAmount = params.vibrato / 200.0f;
+    vibrato = 0.2f * vibratoAmount * vibratoAmount;
+    pwmDepth = vibrato;
+    if (vibratoAmount < 0.0f) {
+        vibrato = 0.0f;
+    }
+
+    // Need to glide?
+    glideMode = params.glideMode;
+
+    // Just like the envelope, glide is implemented using a one-pole filter
+    // that is updated every 32 samples. Here we set the filter coefficient.
+    // A smaller coefficient means the glide takes longer.
+    if (params.glideRate < 2.0f) {
+        glideRate = 1.0f; // no glide
+    } else {
+        glideRate = 1.0f - std::exp(-inverseUpdateRate * std::exp(6.0f - 0.07f * params.glideRate));
+    }
+
+    // Glide bend goes from -36 semitones to +36 semitones.
+    glideBend = params.glideBend;
+
+    // The filter's cutoff is set using the note's pitch and velocity. This
+    // parameter shifts that cutoff up or down. Values are from -1.5 to 6.5.
+    filterKeyTracking = 0.08f * params.filterFreq - 1.5f;
+
+    // Filter Q. Starts at 1 and goes up to 20, approximately.
+    float filterReso = params.filterReso / 100.0f;
+    filterQ = std::exp(3.0f * filterReso);
+
+    // Self-oscillation:
+    // synth.filterQ = 1.0f / ((1.0f - filterReso + 1e-9) * (1.0f - filterReso + 1e-9));
+
+    // When using both oscillators, and/or noise or large filter resonance,
+    // the overall gain increases. This variable tries to compensate for that.
+    // There is also a manual output level control, as the total volume also
+    // depends on how many notes are playing, their envelopes, velocities, etc.
+    volumeTrim = 0.0008f * (3.2f - oscMix - 25.0f * noiseMix) * (1.5f - 0.5f * filterReso);
+
+    // Filter LFO intensity. Parabolic curve from 0 to 2.5.
+    float filterLFO = params.filterLFO / 100.0f;
+    filterLFODepth = 2.5f * filterLFO * filterLFO;
+
+    // The filter envelope uses the same formulas as the amplitude envelope
+    // but runs 32 times slower, at the same update rate as the LFO.
+    filterAttack = std::exp(-inverseUpdateRate * std::exp(5.5f - 0.075f * params.filterAttack));
+    filterDecay = std::exp(-inverseUpdateRate * std::exp(5.5f - 0.075f * params.filterDecay));
+
+    float filterSustainAmount = params.filterSustain / 100.0f;
+    filterSustain = filterSustainAmount * filterSustainAmount;
+
+    filterRelease = std::exp(-inverseUpdateRate * std::exp(5.5f - 0.075f * params.filterRelease));
+
+    // Filter envelope intensity. Linear curve from -6.0 to +6.0.
+    filterEnvDepth = 0.06f * params.filterEnv;
+}
+
+void Synth::render(float** outputBuffers, int sampleCount)
+{
+    // The voices need to have access to some of the synth's parameters and
+    // MIDI controller values. We copy these values into the active voices
+    // at the start of the block. They will never change during the block.
+    for (auto& voice : voices) {
+        if (voice.env.isActive()) {
+            updatePeriod(voice);
+            voice.glideRate = glideRate;
+            voice.filterQ = filterQ * resonanceCtl;
+            voice.pitchBend = pitchBend;
+            voice.filterEnvDepth = filterEnvDepth;
+        }
+    }
+
+    // The host may give us a mono bus, in which case there is no buffer for
+    // the right channel.
+    if (outputBuffers[1] != nullptr) {
+        renderStereo(outputBuffers[0], outputBuffers[1], sampleCount);
+    } else {
+        renderMono(outputBuffers[0], sampleCount);
+    }
+
+    // Turn off voices whose envelope has dropped below the minimum level.
+    for (auto& voice : voices) {
+        if (!voice.env.isActive()) {
+            voice.env.reset();
+            voice.filter.reset();
+        }
+    }
+}
+
+void Synth::renderStereo(float* outputBufferLeft, float* outputBufferRight, int sampleCount)
+{
+    for (int sample = 0; sample < sampleCount; ++sample) {
+
+        // The LFO and any things it modulates are updated every 32 samples.
+        // It's also guaranteed to be called the very first time.
+        updateLFO();
+
+        // Noise oscillator.
+        float noise = noiseGen.nextValue() * noiseMix;
+
+        // These variables add up the output values of all the active voices.
+        float outputLeft = 0.0f;
+        float outputRight = 0.0f;
+
+        // Render the voices that have an active envelope.
+        for (auto& voice : voices) {
+            if (voice.env.isActive()) {
+                float output = voice.render(noise);
+                outputLeft += output * voice.panLeft;
+                outputRight += output * voice.panRight;
+            }
+        }
+
+        // Apply additional gain.
+        float outputLevel = outputLevelSmoother.getNextValue();
+        outputLeft *= outputLevel;
+        outputRight *= outputLevel;
+
+        // Write the result into the output buffer.
+        outputBufferLeft[sample] = outputLeft;
+        outputBufferRight[sample] = outputRight;
+    }
+}
+
+void Synth::renderMono(float* outputBuffer, int sampleCount)
+{
+    // Same as renderStereo, but each voice is mixed with its mono gain, which
+    // folds both panning amounts into one. This way we only need to add up
+    // a single channel.
+    for (int sample = 0; sample < sampleCount; ++sample) {
+        updateLFO();
+
+        float noise = noiseGen.nextValue() * noiseMix;
+
+        float output = 0.0f;
+        for (auto& voice : voices) {
+            if (voice.env.isActive()) {
+                output += voice.render(noise) * voice.panMono;
+            }
+        }
+
+        outputBuffer[sample] = output * outputLevelSmoother.getNextValue();
+    }
+}
+
+void Synth::updateLFO()
+{
+    if (--lfoStep <= 0) {
+        lfoStep = LFO_MAX; // reset the counter
+
+        lfo += lfoInc;
+        if (lfo > PI) {
+            lfo -= TWO_PI;
+        }
+
+        // The LFO is a basic sine wave.
+        const float sine = std::sin(lfo);
+
+        // The modulation intensity for vibrato / PWM is set by the parameter
+        // and by the modulation wheel. Together, they can modulate the pitch
+        // by approximately two semitones up and down.
+        float vibratoMod = 1.0f + sine * (modWheel + vibrato);
+        float pwm = 1.0f + sine * (modWheel + pwmDepth);
+
+        // The low-pass filter cutoff is modulated by the combination of the
+        // Filter Freq parameter set by the user, the MIDI CC, aftertouch, and
+        // the LFO intensity. This value swings between approx -7.97 and 11.7.
+        // The Voice will also add the filter envelope to this.
+        float filterMod = filterKeyTracking + filterCtl + (filterLFODepth + pressure) * sine;
+
+        // Use a basic one-pole smoothing filter to de-zipper changes to the
+        // amount of filter modulation.
+        filterZip += 0.005f * (filterMod - filterZip);
+
+        // Tell all active voices to perform any computations that depend on
+        // the LFO modulations.
+        for (auto& voice : voices) {
+            if (voice.env.isActive()) {
+                voice.osc1.modulation = vibratoMod;
+                voice.osc2.modulation = pwm;
+                voice.filterMod = filterZip;
+                voice.updateLFO();
+                updatePeriod(voice);
+            }
+        }
+    }
+}
+
+void Synth::midiMessage(uint8_t data0, uint8_t data1, uint8_t data2)
+{
+    switch (data0 & 0xF0) { // status byte (all channels)
+    // Note off
+    case 0x80:
+        noteOff(data1 & 0x7F);
+        break;
+
+    // Note on
+    case 0x90: {
+        uint8_t note = data1 & 0x7F;
+        uint8_t velo = data2 & 0x7F;
+        if (velo > 0) {
+            noteOn(note, velo);
+        } else {
+            noteOff(note);
+        }
+        break;
+    }
+
+    // Control change
+    case 0xB0:
+        controlChange(data1, data2);
+        break;
+
+    // Channel aftertouch
+    case 0xD0:
+        // This maps the pressure value to a parabolic curve starting at
+        // 0.0 (position 0) up to 1.61 (position 127).
+        pressure = 0.0001f * float(data1 * data1);
+        break;
+
+    // Pitch bend
+    case 0xE0:
+        // The pitch wheel can shift the tone up or down by 2 semitones.
+        pitchBend = std::exp(-0.000014102f * float(data1 + 128 * data2 - 8192));
+        break;
+    }
+}
+
+void Synth::controlChange(uint8_t data1, uint8_t data2)
+{
+    switch (data1) {
+    // Mod wheel
+    case 0x01:
+        modWheel = 0.000005f * float(data2 * data2);
+        break;
+
+    // Sustain pedal
+    case 0x40:
+        sustainPedalPressed = (data2 >= 64);
+
+        // Pedal released? Then end all sustained notes. This sends a
+        // note-off event with note = -1, meaning all sustained notes
+        // will be moved into their envelope release stage.
+        if (!sustainPedalPressed) {
+            noteOff(SUSTAIN);
+        }
+        break;
+
+    // Resonance
+    case 0x47:
+    case 0x17: // knob on my MIDI controller
+        resonanceCtl = 154.0f / float(154 - data2);
+        break;
+
+    // Filter +
+    case 0x4A:
+    case 0x15: // knob on my MIDI controller
+        filterCtl = 0.02f * float(data2);
+        break;
+
+    // Filter -
+    case 0x4B:
+    case 0x16: // knob on my MIDI controller
+        filterCtl = -0.03f * float(data2);
+        break;
+
+    // All notes off
+    default:
+        if (data1 >= 0x78) {
+            for (auto& voice : voices) {
+                voice.reset();
+            }
+            heldNotes.reset();
+            sustainPedalPressed = false;
+        }
+        break;
+    }
+}
+
+void Synth::noteOn(size_t note, int velocity)
+{
+    if (ignoreVelocity) {
+        velocity = 80;
+    }
+
+    size_t v = 0; // index of the voice to use (0 = mono voice)
+
+    if (numVoices == 1) { // monophonic
+        // Remember the key even if it doesn't get to play right away, so it
+        // can be restored when the other keys are released.
+        heldNotes.push(note);
+        note = *heldNotes.top(notePriority);
+
+        auto& voice = voices.front();
+        if (voice.note.has_value() && voice.note != SUSTAIN) { // legato-style playing
+            // With low or high note priority, the new key may not replace
+            // the note that is already playing.
+            if (note != *voice.note) {
+                restartMonoVoice(note, velocity);
+            }
+            return;
+        }
+    } else { // polyphonic
+        v = findFreeVoice();
+    }
+
+    startVoice(v, note, velocity);
+}
+
+void Synth::noteOff(size_t note)
+{
+    // The key is no longer held. This is done in poly mode too, in case the
+    // key was pressed before switching from mono to poly.
+    heldNotes.remove(note);
+
+    // In monophonic mode and the currently playing note is released?
+    if ((numVoices == 1) && (voices[0].note == note)) {
+        // Is another key still held down? Then put that note into voice 0
+        // and restart it. Note that keys that were released while the sustain
+        // pedal is pressed are no longer on the stack, so notes kept alive
+        // only by the sustain pedal are not restored.
+        if (auto heldNote = heldNotes.top(notePriority); heldNote) {
+            restartMonoVoice(*heldNote, -1);
+        }
+    }
+
+    // We get here in polyphonic mode, or when a key was released that is
+    // not currently playing in monophonic mode.
+    // We also get here when the sustain pedal is released. In that case,
+    // the note number is SUSTAIN.
+
+    for (auto& voice : voices) {
+        // Any voices playing this note?
+        if (voice.note == note) {
+            if (sustainPedalPressed) {
+                // Sustain pedal is pressed, so put the note in sustain mode.
+                voice.note = SUSTAIN;
+            } else {
+                // Sustain pedal is not pressed, so start envelope release.
+                voice.release();
+                voice.note = std::nullopt;
+            }
+        }
+    }
+}
+
+void Synth::startVoice(size_t v, size_t note, int velocity)
+{
+    float period = calcPeriod(v, note);
+
+    // Set the period as the target that we'll glide to (if glide enabled).
+    Voice& voice = voices[v];
+    voice.target = period;
+
+    // Determine if we need to perform a portamento from the previous note's
+    // pitch to the new one. Note that legato-style playing in monophonic mode
+    // is handled elsewhere.
+    size_t noteDistance = 0;
+    if (lastNote.has_value()) {
+        if ((glideMode == 2) || ((glideMode == 1) && isPlayingLegatoStyle())) {
+            noteDistance = note - *lastNote;
+        }
+    }
+
+    // If gliding, make the starting period equal to the period of the previous
+    // note. Also offset it by an additional amount of glide bending, given in
+    // semitones. `glideBend` is always used, even if gliding is disabled.
+    voice.period = period * std::pow(1.059463094359f, float(noteDistance) - glideBend);
+
+    // Make sure the starting period does not become too small. Unlike the
+    // target period, this doesn't need to be exact, so we can simply limit
+    // it to the minimum of 6 samples.
+    if (voice.period < 6.0f) {
+        voice.period = 6.0f;
+    }
+
+    // Remember which note was last played, for gliding next time.
+    lastNote = note;
+    voice.note = note;
+    voice.updatePanning();
+
+    // Set the base cutoff frequency for the low-pass filter, based on the
+    // pitch of the note and its velocity.
+    voice.cutoff = sampleRate / (period * PI);
+    voice.cutoff *= std::exp(velocitySensitivity * float(velocity - 64));
+
+    // The loudness of the tone uses the MIDI velocity but you cannot set the
+    // sensitivity other than on/off. Convert the linear velocity into a curve
+    // that is parabolic.
+    float vel = 0.004f * float((velocity + 64) * (velocity + 64)) - 8.0f;
+
+    // Use the different volume controls to set the amplitude level (a value
+    // between 0 and 1) for both oscillators.
+    voice.osc1.amplitude = volumeTrim * vel;
+    voice.osc2.amplitude = voice.osc1.amplitude * oscMix;
+
+    // OPTIONAL: reset the oscillators.
+    // voice.osc1.reset();
+    // voice.osc2.reset();
+
+    // In PWM mode, change the starting phase of the second oscillator so that
+    // it combines with the first oscillator into a square wave.
+    if (vibrato == 0.0f && pwmDepth > 0.0f) {
+        voice.osc2.squareWave(voice.osc1, voice.period);
+    }
+
+    // Set the parameters for the envelope and start the attack.
+    Envelope& env = voice.env;
+    env.attackMultiplier = envAttack;
+    env.decayMultiplier = envDecay;
+    env.sustainLevel = envSustain;
+    env.releaseMultiplier = envRelease;
+    env.attack();
+
+    Envelope& filterEnv = voice.filterEnv;
+    filterEnv.attackMultiplier = filterAttack;
+    filterEnv.decayMultiplier = filterDecay;
+    filterEnv.sustainLevel = filterSustain;
+    filterEnv.releaseMultiplier = filterRelease;
+    filterEnv.attack();
+}
+
+void Synth::restartMonoVoice(size_t note, int velocity)
+{
+    // This is a simplified version of startVoice, used only in mono mode when
+    // playing legato-style or when activating a queued note after a key up.
+
+    float period = calcPeriod(0, note);
+
+    auto& voice = voices.front();
+    voice.target = period;
+
+    // Glide mode is off? Then no portamento. Otherwise, glide from whatever
+    // was the previous period for this voice. Note that this does not use the
+    // additional glide bend parameter.
+    if (glideMode == 0) {
+        voice.period = period;
+    }
+
+    // Same formula as in startVoice. When playing a queued note we do not have
+    // the velocity anymore, so just ignore that part when setting the low-pass
+    // filter cutoff.
+    voice.cutoff = sampleRate / (period * PI);
+    if (velocity > 0) {
+        voice.cutoff *= std::exp(velocitySensitivity * float(velocity - 64));
+    }
+
+    voice.env.level += SILENCE + SILENCE;
+    voice.note = note;
+    voice.updatePanning();
+}
+
+float Synth::calcPeriod(size_t v, size_t note) const
+{
+    // Calculate the period in samples. This formula may look complicated but
+    // is explained in detail in the book.
+    // The ANALOG term adds a small amount of detuning based on the current
+    // voice number. For moar analog!
+    float period = tune * std::exp(-0.05776226505f * (float(note) + ANALOG * float(v)));
+
+    // Make sure the period does not become too small. This lowers the pitch an
+    // octave at a time until `period` is at least six samples long.
+    while (period < 6.0f || (period * detune) < 6.0f) {
+        period += period;
+    }
+
+    return period;
+}
+
+size_t Synth::findFreeVoice() const
+{
+    size_t v = 0;
+    float l = 100.0f; // louder than any envelope!
+
+    for (size_t i = 0; i < MAX_VOICES; ++i) {
+        // Replace quietest voice not in attack. This will first use any voices
+        // that are not playing (with env level = 0.0). If all are in use, pick
+        // the voice with the lowest envelope value.
+        if (voices[i].env.level < l && !voices[i].env.isInAttack()) {
+            l = voices[i].env.level;
+            v = i;
+        }
+    }
+    return v;
+}
+
+bool Synth::isPlayingLegatoStyle() const
+{
+    // Count how many playing voices are for keys that are still held down,
+    // i.e. that did not get a Note Off event yet. If note is 0, this voice
+    // is not playing; if it's SUSTAIN, the note is sustained by the pedal.
+    return std::any_of(voices.begin(), voices.end(), [](const Voice& voice) {
+        return voice.note.has_value() && voice.note != SUSTAIN;
+    });
+}
+
+} // namespace JX11::Reference
@@ -0,0 +1,337 @@
+// jx11_host: runs hundreds of synths in one process on a shared thread pool,
+// like a server with one instance per user session, see common/EngineHost.h.
+//
+// Every instance is played by a simulated user, who plays phrases of random
+// notes with pauses in between. --active sets the fraction of the time that a
+// user is playing, so the rest of the time the instance only has its release
+// tails to finish and is then idle. The users are seeded by their number, so
+// every run gets the same load.
+//
+// The periods are rendered back to back, as fast as possible. For every
+// period it measures how long the host took, and for every instance whether
+// its audio was done before its deadline, which is the length of a period
+// unless --deadline says otherwise. The presets given on the command line are
+// handed out to the instances in turn.
+
+#include "common/EngineHost.h"
+#include "common/Json.h"
+#include "common/Preset.h"
+#include "common/Timer.h"
+#include "engine/Synth.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace JX11;
+using namespace JX11::Engine;
+
+namespace
+{
+
+struct Options
+{
+    int instances = 256;
+    int threads = 0; // 0 = one per core
+    int periodSize = 256;
+    double sampleRate = 48000.0;
+    double seconds = 10.0;
+
+    // The fraction of the time that the users are playing.
+    double active = 0.25;
+
+    // Milliseconds after the start of a period, 0 = the length of a period.
+    double deadline = 0.0;
+
+    bool skipIdle = true;
+    std::optional<uint32_t> seed;
+
+    std::vector<std::string> presetPaths;
+    std::string jsonPath;
+};
+
+// Average length of a phrase, and time between two notes in a phrase.
+constexpr double PHRASE_SECONDS = 4.0;
+constexpr double NOTE_INTERVAL_SECONDS = 0.25;
+
+// A simulated user of one instance.
+class Session
+{
+public:
+    Session(uint32_t seed, const Options& options) : random(seed), sampleRate(options.sampleRate)
+    {
+        pauseSeconds = PHRASE_SECONDS * (1.0 - options.active) / options.active;
+        noteProbability = double(options.periodSize) / (NOTE_INTERVAL_SECONDS * sampleRate);
+
+        // Start somewhere in a phrase or a pause.
+        if (std::uniform_real_distribution<double>(0.0, 1.0)(random) < options.active) {
+            startPhrase(0);
+        } else {
+            pauseEnd = toFrames(exponential(pauseSeconds));
+        }
+    }
+
+    // Adds the MIDI for the period that starts at frame to events.
+    void play(uint64_t frame, int periodSize, std::vector<Tools::MidiEvent>& events)
+    {
+        const uint64_t periodEnd = frame + uint64_t(periodSize);
+        if (frame >= phraseEnd && frame >= pauseEnd) {
+            startPhrase(frame);
+        }
+        if (frame < phraseEnd && std::uniform_real_distribution<double>(0.0, 1.0)(random) < noteProbability) {
+            const auto offset = std::uniform_int_distribution<int>(0, periodSize - 1)(random);
+            const auto note = uint8_t(std::uniform_int_distribution<int>(36, 84)(random));
+            const auto velocity = uint8_t(std::uniform_int_distribution<int>(40, 127)(random));
+            const double length = std::uniform_real_distribution<double>(0.1, 1.0)(random);
+            events.push_back({offset, 0x90, note, velocity});
+            noteOffs.emplace_back(frame + uint64_t(offset) + toFrames(length), note);
+        }
+        for (auto it = noteOffs.begin(); it != noteOffs.end();) {
+            if (it->first < periodEnd) {
+                events.push_back({int(std::max(it->first, frame) - frame), 0x80, it->second, 0});
+                it = noteOffs.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        std::stable_sort(events.begin(), events.end(),
+                         [](const auto& a, const auto& b) { return a.offset < b.offset; });
+    }
+
+private:
+    void startPhrase(uint64_t frame)
+    {
+        phraseEnd = frame + toFrames(exponential(PHRASE_SECONDS));
+        pauseEnd = phraseEnd + toFrames(exponential(pauseSeconds));
+    }
+
+    double exponential(double mean)
+    {
+        return mean > 0.0 ? std::exponential_distribution<double>(1.0 / mean)(random) : 0.0;
+    }
+
+    uint64_t toFrames(double seconds) const { return uint64_t(std::llround(seconds * sampleRate)); }
+
+    std::mt19937 random;
+    double sampleRate;
+    double pauseSeconds;
+    double noteProbability;
+
+    uint64_t phraseEnd = 0;
+    uint64_t pauseEnd = 0;
+
+    // Frame and note of the notes that are playing.
+    std::vector<std::pair<uint64_t, uint8_t>> noteOffs;
+};
+
+double getPercentile(const std::vector<double>& sorted, double fraction)
+{
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    return sorted[std::min(sorted.size() - 1, size_t(fraction * double(sorted.size())))];
+}
+
+void printUsage()
+{
+    std::fputs("usage: jx11_host [options] [<preset>...]\n"
+               "  --instances <n>      number of synths (default 256)\n"
+               "  --threads <n>        worker threads (default: one per core)\n"
+               "  --period <n>         samples per period (default 256)\n"
+               "  --sample-rate <hz>   sample rate (default 48000)\n"
+               "  --seconds <s>        seconds of audio to render (default 10)\n"
+               "  --active <fraction>  fraction of the time that the users play (default 0.25)\n"
+               "  --deadline <ms>      deadline of the instances (default: the period)\n"
+               "  --no-idle-skip       also render the instances that are idle\n"
+               "  --seed <n>           deterministic mode with this seed, see Synth::setSeed\n"
+               "  --json <file>        also write the stats as JSON\n",
+               stderr);
+}
+
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--instances" && hasValue) {
+            options.instances = std::atoi(argv[++i]);
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = std::atoi(argv[++i]);
+        } else if (arg == "--period" && hasValue) {
+            options.periodSize = std::atoi(argv[++i]);
+        } else if (arg == "--sample-rate" && hasValue) {
+            options.sampleRate = std::atof(argv[++i]);
+        } else if (arg == "--seconds" && hasValue) {
+            options.seconds = std::atof(argv[++i]);
+        } else if (arg == "--active" && hasValue) {
+            options.active = std::atof(argv[++i]);
+        } else if (arg == "--deadline" && hasValue) {
+            options.deadline = std::atof(argv[++i]);
+        } else if (arg == "--no-idle-skip") {
+            options.skipIdle = false;
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = uint32_t(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--json" && hasValue) {
+            options.jsonPath = argv[++i];
+        } else if (!arg.empty() && arg[0] != '-') {
+            options.presetPaths.push_back(arg);
+        } else {
+            return false;
+        }
+    }
+    return options.instances > 0 && options.threads >= 0 && options.periodSize > 0 && options.sampleRate > 0.0 &&
+           options.seconds > 0.0 && options.active > 0.0 && options.active <= 1.0 && options.deadline >= 0.0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 1;
+    }
+
+    std::vector<Parameters> presets;
+    for (const auto& path : options.presetPaths) {
+        Parameters params;
+        std::string error;
+        if (!Tools::loadPreset(path, params, error)) {
+            std::fprintf(stderr, "%s: %s\n", path.c_str(), error.c_str());
+            return 1;
+        }
+        presets.push_back(params);
+    }
+    if (presets.empty()) {
+        presets.emplace_back();
+    }
+
+    int threadCount = options.threads;
+    if (threadCount == 0) {
+        threadCount = int(std::max(1u, std::thread::hardware_concurrency()));
+    }
+
+    Tools::EngineHost host(options.sampleRate, options.periodSize, threadCount, options.skipIdle);
+    std::vector<Session> sessions;
+    sessions.reserve(size_t(options.instances));
+    for (int i = 0; i < options.instances; ++i) {
+        auto& instance = host.addInstance(presets[size_t(i) % presets.size()], options.seed);
+        if (options.deadline > 0.0) {
+            instance.deadline = options.deadline * 1e-3;
+        }
+        sessions.emplace_back(uint32_t(i + 1), options);
+    }
+
+    const auto periodCount = size_t(std::ceil(options.seconds * options.sampleRate / options.periodSize));
+    const double periodSeconds = double(options.periodSize) / options.sampleRate;
+    std::vector<double> periodTimes;
+    periodTimes.reserve(periodCount);
+    uint64_t rendered = 0, skipped = 0, batches = 0, latePeriods = 0;
+    double hostSeconds = 0.0;
+
+    for (size_t period = 0; period < periodCount; ++period) {
+        const uint64_t frame = uint64_t(period) * uint64_t(options.periodSize);
+        for (size_t i = 0; i < sessions.size(); ++i) {
+            sessions[i].play(frame, options.periodSize, host.getInstance(i).events);
+        }
+
+        const auto stats = host.renderPeriod();
+        periodTimes.push_back(stats.seconds);
+        hostSeconds += stats.seconds;
+        rendered += stats.rendered;
+        skipped += stats.skipped;
+        batches += stats.batches;
+        latePeriods += stats.seconds > periodSeconds ? 1 : 0;
+    }
+
+    uint64_t lateRenders = 0;
+    size_t lateInstances = 0;
+    double worstFinish = 0.0;
+    for (size_t i = 0; i < host.getInstanceCount(); ++i) {
+        const auto& stats = host.getInstance(i).stats;
+        lateRenders += stats.late;
+        lateInstances += stats.late > 0 ? 1 : 0;
+        worstFinish = std::max(worstFinish, stats.worstFinishSeconds);
+    }
+
+    std::sort(periodTimes.begin(), periodTimes.end());
+    const double p50 = getPercentile(periodTimes, 0.5);
+    const double p99 = getPercentile(periodTimes, 0.99);
+    const double worst = periodTimes.back();
+    const double total = double(rendered + skipped);
+    const double renderedPercent = 100.0 * double(rendered) / total;
+    const double audioSeconds = double(periodCount) * periodSeconds;
+
+    // How many instances this machine could keep up with, at the same load.
+    const double capacity = double(options.instances) * audioSeconds / hostSeconds;
+    const char* kernelName = getKernelName(selectKernels().level);
+
+    std::printf("jx11_host: %d instances, %d threads, %d-sample periods at %g Hz (%.2f ms), %s kernels\n",
+                options.instances, threadCount, options.periodSize, options.sampleRate, periodSeconds * 1e3,
+                kernelName);
+    std::printf("  periods      %10zu  (%.2f s of audio, %.0f %% of the time playing)\n", periodCount,
+                audioSeconds, options.active * 100.0);
+    std::printf("  period time  p50 %.3f ms, p99 %.3f ms, max %.3f ms, %llu over the period\n", p50 * 1e3,
+                p99 * 1e3, worst * 1e3, static_cast<unsigned long long>(latePeriods));
+    std::printf("  instances    %.1f %% rendered, %.1f %% skipped as idle%s\n", renderedPercent,
+                100.0 - renderedPercent, options.skipIdle ? "" : " (skipping off)");
+    std::printf("  batches      %10.1f per period, %llu stolen\n", double(batches) / double(periodCount),
+                static_cast<unsigned long long>(host.getStealCount()));
+    std::printf("  deadlines    %zu of %d instances late at least once, %llu late renders, worst finish %.3f ms\n",
+                lateInstances, options.instances, static_cast<unsigned long long>(lateRenders), worstFinish * 1e3);
+    std::printf("  capacity     %10.0f instances in real time\n", capacity);
+
+    if (!options.jsonPath.empty()) {
+        FILE* file = std::fopen(options.jsonPath.c_str(), "w");
+        if (file == nullptr) {
+            std::fprintf(stderr, "cannot write %s\n", options.jsonPath.c_str());
+            return 1;
+        }
+        Tools::JsonWriter json(file);
+        json.beginObject();
+        json.member("tool", "jx11_host");
+        json.member("version", JX11_VERSION);
+        json.member("kernel", kernelName);
+        json.member("sample_rate", options.sampleRate);
+        json.member("period_size", options.periodSize);
+        json.member("threads", threadCount);
+        json.member("instances", options.instances);
+        json.member("active", options.active);
+        json.member("skip_idle", options.skipIdle);
+        json.member("periods", static_cast<long long>(periodCount));
+        json.member("period_p50_ms", p50 * 1e3);
+        json.member("period_p99_ms", p99 * 1e3);
+        json.member("period_max_ms", worst * 1e3);
+        json.member("late_periods", static_cast<long long>(latePeriods));
+        json.member("rendered_fraction", double(rendered) / total);
+        json.member("batches_per_period", double(batches) / double(periodCount));
+        json.member("stolen_batches", static_cast<long long>(host.getStealCount()));
+        json.member("late_renders", static_cast<long long>(lateRenders));
+        json.member("capacity", capacity);
+        json.key("per_instance");
+        json.beginArray();
+        for (size_t i = 0; i < host.getInstanceCount(); ++i) {
+            const auto& stats = host.getInstance(i).stats;
+            json.beginObject();
+            json.member("rendered", static_cast<long long>(stats.rendered));
+            json.member("skipped", static_cast<long long>(stats.skipped));
+            json.member("late", static_cast<long long>(stats.late));
+            json.member("render_seconds", stats.renderSeconds);
+            json.member("worst_render_ms", stats.worstRenderSeconds * 1e3);
+            json.member("worst_finish_ms", stats.worstFinishSeconds * 1e3);
+            json.endObject();
+        }
+        json.endArray();
+        json.endObject();
+        json.finish();
+        std::fclose(file);
+    }
+    return 0;
+}
@@ -0,0 +1,250 @@
+// jx11_library: builds and reads preset libraries, see common/PresetLibrary.h.
+//
+//     jx11_library build --output <library> <directory or file>...
+//     jx11_library list <library> [--tag <tag>]
+//     jx11_library show <library> <name or index>
+//
+// build reads every file under the directories, in either state format, see
+// common/Preset.h. A preset is named after its file without the extension,
+// and gets the names of the directories it is in, below the one on the
+// command line, as tags. Files that aren't states, and names that are already
+// taken, are reported and left out.
+//
+// The other tools load a preset from a library as <library>#<name>.
+
+#include "common/MappedFile.h"
+#include "common/PresetLibrary.h"
+#include "common/Timer.h"
+#include "engine/PluginState.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace JX11;
+using namespace JX11::Engine;
+
+namespace
+{
+
+struct Options
+{
+    std::string command;
+    std::string libraryPath;
+    std::vector<std::string> inputs;
+    std::string tag;
+};
+
+void printUsage()
+{
+    std::fputs("usage: jx11_library build --output <library> <directory or file>...\n"
+               "       jx11_library list <library> [--tag <tag>]\n"
+               "       jx11_library show <library> <name or index>\n"
+               "  --output <file>   the library to write\n"
+               "  --tag <tag>       only list the presets with this tag\n",
+               stderr);
+}
+
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    if (argc < 2) {
+        return false;
+    }
+    options.command = argv[1];
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--output" && hasValue) {
+            options.libraryPath = argv[++i];
+        } else if (arg == "--tag" && hasValue) {
+            options.tag = argv[++i];
+        } else if (!arg.empty() && arg[0] != '-') {
+            options.inputs.push_back(arg);
+        } else {
+            return false;
+        }
+    }
+    if (options.command == "build") {
+        return !options.libraryPath.empty() && !options.inputs.empty() && options.tag.empty();
+    }
+    if (options.command == "list" || options.command == "show") {
+        const size_t count = (options.command == "list") ? 1 : 2;
+        if (!options.libraryPath.empty() || options.inputs.size() != count) {
+            return false;
+        }
+        options.libraryPath = options.inputs[0];
+        return options.command == "list" || options.tag.empty();
+    }
+    return false;
+}
+
+struct InputFile
+{
+    std::filesystem::path path;
+    std::vector<std::string> tags;
+};
+
+// The files under an input, sorted so that the library is the same from run
+// to run, with the directories below the input as tags.
+std::vector<InputFile> listInput(const std::filesystem::path& input)
+{
+    std::vector<InputFile> files;
+    if (!std::filesystem::is_directory(input)) {
+        files.push_back({input, {}});
+        return files;
+    }
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(input)) {
+        if (!entry.is_regular_file()) {
+            continue;
+        }
+        InputFile file {entry.path(), {}};
+        for (const auto& part : entry.path().parent_path().lexically_relative(input)) {
+            if (part != ".") {
+                file.tags.push_back(part.string());
+            }
+        }
+        files.push_back(std::move(file));
+    }
+    std::sort(files.begin(), files.end(), [](const auto& a, const auto& b) { return a.path < b.path; });
+    return files;
+}
+
+int build(const Options& options)
+{
+    Tools::Timer timer;
+    Tools::PresetLibraryWriter writer;
+    size_t skipped = 0;
+
+    for (const auto& input : options.inputs) {
+        std::error_code error;
+        if (!std::filesystem::exists(input, error)) {
+            std::fprintf(stderr, "jx11_library: %s doesn't exist\n", input.c_str());
+            return 1;
+        }
+        for (const auto& file : listInput(input)) {
+            Tools::MappedFile contents;
+            Parameters params;
+            const char* message = "cannot open the file";
+            if (!contents.open(file.path) ||
+                !readPluginState({reinterpret_cast<const char*>(contents.data()), contents.getSize()}, params,
+                                 message)) {
+                std::fprintf(stderr, "jx11_library: skipping %s: %s\n", file.path.string().c_str(), message);
+                ++skipped;
+                continue;
+            }
+            const std::string name = file.path.stem().string();
+            if (!writer.add(name, params, file.tags)) {
+                std::fprintf(stderr, "jx11_library: skipping %s: there is already a preset called %s\n",
+                             file.path.string().c_str(), name.c_str());
+                ++skipped;
+            }
+        }
+    }
+
+    std::string error;
+    const uint64_t size = writer.write(options.libraryPath, error);
+    if (size == 0) {
+        std::fprintf(stderr, "jx11_library: %s\n", error.c_str());
+        return 1;
+    }
+    std::printf("jx11_library: %zu presets with %zu tags, %llu bytes, in %.2f s\n", writer.size(),
+                writer.getTagCount(), (unsigned long long)size, timer.elapsedNanoseconds() * 1e-9);
+    if (skipped > 0) {
+        std::printf("  %zu files skipped\n", skipped);
+    }
+    return 0;
+}
+
+std::string joinTags(const Tools::PresetLibrary& library, size_t index)
+{
+    std::string text;
+    for (uint32_t tag : library.getTags(index)) {
+        text += text.empty() ? "" : ", ";
+        text += library.getTagName(tag);
+    }
+    return text;
+}
+
+int list(const Tools::PresetLibrary& library, const Options& options)
+{
+    std::optional<uint32_t> tag;
+    if (!options.tag.empty()) {
+        tag = library.findTag(options.tag);
+        if (!tag) {
+            return 0;
+        }
+    }
+    for (size_t index = 0; index < library.size(); ++index) {
+        if (tag) {
+            const auto tags = library.getTags(index);
+            if (std::find(tags.begin(), tags.end(), *tag) == tags.end()) {
+                continue;
+            }
+        }
+        const std::string name(library.getName(index));
+        std::printf("%6zu  %s", index, name.c_str());
+        const std::string tags = joinTags(library, index);
+        if (!tags.empty()) {
+            std::printf("  [%s]", tags.c_str());
+        }
+        std::printf("\n");
+    }
+    return 0;
+}
+
+int show(const Tools::PresetLibrary& library, const std::string& query)
+{
+    // A name first, so that presets can be called "12".
+    auto index = library.find(query);
+    if (!index && !query.empty() && query.find_first_not_of("0123456789") == std::string::npos) {
+        const size_t number = std::strtoull(query.c_str(), nullptr, 10);
+        if (number < library.size()) {
+            index = number;
+        }
+    }
+    if (!index) {
+        std::fprintf(stderr, "jx11_library: no preset %s\n", query.c_str());
+        return 1;
+    }
+
+    const std::string name(library.getName(*index));
+    std::printf("%s (%zu)\n", name.c_str(), *index);
+    const std::string tags = joinTags(library, *index);
+    if (!tags.empty()) {
+        std::printf("  tags: %s\n", tags.c_str());
+    }
+    const Parameters params = library.getParameters(*index);
+    for (const auto& info : PARAMETER_INFOS) {
+        std::printf("  %-16s %g\n", info.id, double(info.get(params)));
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 1;
+    }
+    if (options.command == "build") {
+        return build(options);
+    }
+
+    Tools::PresetLibrary library;
+    std::string error;
+    if (!library.open(options.libraryPath, error)) {
+        std::fprintf(stderr, "jx11_library: %s\n", error.c_str());
+        return 1;
+    }
+    if (options.command == "list") {
+        return list(library, options);
+    }
+    return show(library, options.inputs[1]);
+}
@@ -0,0 +1,327 @@
+// jx11_plughost: times JX11AudioProcessor::processBlock like a host would.
+//
+// jx11_bench only measures the engine. This also includes the work that the
+// processor does around it on every call: ScopedNoDenormals, clearing the
+// extra channels, checking parametersChanged, update(), going through the
+// MIDI buffer and clearing it.
+//
+// The same performance (MIDI plus parameter automation) is played at buffer
+// sizes from 16 to 2048 samples. The average time per call is then split into
+// a fixed cost per call and a cost per sample, with a least-squares fit of
+//
+//     time per call = fixed + perSample * bufferSize
+//
+// With small buffers the fixed cost is a large part of the total.
+//
+// processBlock runs under the real-time checker from rtcheck/RtCheck.h, which
+// reports every allocation and lock inside it, like the listener callbacks
+// of setValueNotifyingHost.
+
+#include "common/Json.h"
+#include "common/Timer.h"
+#include "processor/PluginProcessor.h"
+#include "rtcheck/RtCheck.h"
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <juce_events/juce_events.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace JX11;
+
+namespace
+{
+
+struct Options
+{
+    double sampleRate = 48000.0;
+
+    // Length of the performance in seconds.
+    double seconds = 10.0;
+
+    // Standard MIDI file to play instead of the built-in performance.
+    juce::String midiPath;
+
+    // Seconds between parameter changes, 0 for no automation.
+    double automationInterval = 0.01;
+
+    juce::String jsonPath;
+
+    // Report allocations and locks inside processBlock.
+    bool rtCheck = true;
+};
+
+// A MIDI message or a parameter change at a sample position.
+struct TimedEvent
+{
+    int64_t samplePosition;
+    juce::MidiMessage message;
+    int parameterIndex = -1; // >= 0 for a parameter change
+    float parameterValue = 0.0f;
+};
+
+// Chords, a bass line and controller moves, repeated for the whole duration.
+std::vector<TimedEvent> makeBuiltinPerformance(const Options& options)
+{
+    std::vector<TimedEvent> events;
+    const auto totalSamples = int64_t(options.seconds * options.sampleRate);
+    const auto beat = int64_t(0.25 * options.sampleRate);
+    const int chords[4][3] = {{60, 64, 67}, {57, 60, 64}, {53, 57, 60}, {55, 59, 62}};
+
+    for (int64_t start = 0, bar = 0; start < totalSamples; start += 4 * beat, ++bar) {
+        const auto& chord = chords[bar % 4];
+        for (int note : chord) {
+            events.push_back({start, juce::MidiMessage::noteOn(1, note, uint8_t(100))});
+            events.push_back({start + 4 * beat - 1, juce::MidiMessage::noteOff(1, note)});
+        }
+        for (int step = 0; step < 4; ++step) {
+            int note = chord[0] - 24 + 12 * (step % 2);
+            events.push_back({start + step * beat, juce::MidiMessage::noteOn(1, note, uint8_t(90))});
+            events.push_back({start + (step + 1) * beat - 1, juce::MidiMessage::noteOff(1, note)});
+        }
+        for (int step = 0; step < 16; ++step) {
+            events.push_back({start + step * beat / 4, juce::MidiMessage::controllerEvent(1, 1, step * 8)});
+        }
+    }
+    return events;
+}
+
+bool loadMidiFile(const Options& options, std::vector<TimedEvent>& events)
+{
+    juce::File file(options.midiPath);
+    juce::FileInputStream stream(file);
+    juce::MidiFile midiFile;
+    if (!stream.openedOk() || !midiFile.readFrom(stream)) {
+        return false;
+    }
+    midiFile.convertTimestampTicksToSeconds();
+
+    for (int track = 0; track < midiFile.getNumTracks(); ++track) {
+        for (const auto* holder : *midiFile.getTrack(track)) {
+            const auto& message = holder->message;
+            if (message.isMetaEvent() || message.isSysEx()) {
+                continue;
+            }
+            auto position = int64_t(message.getTimeStamp() * options.sampleRate);
+            events.push_back({position, message});
+        }
+    }
+    return true;
+}
+
+// Moves the parameters one after the other, like a host playing back
+// automation. The output level is left alone.
+void addAutomation(const Options& options, const juce::AudioProcessor& processor, std::vector<TimedEvent>& events)
+{
+    if (options.automationInterval <= 0.0) {
+        return;
+    }
+    const auto& params = processor.getParameters();
+    const auto totalSamples = int64_t(options.seconds * options.sampleRate);
+    const auto interval = std::max(int64_t(1), int64_t(options.automationInterval * options.sampleRate));
+
+    int step = 0;
+    for (int64_t position = 0; position < totalSamples; position += interval, ++step) {
+        int index = step % params.size();
+        if (params[index]->getName(64) == "Output Level") {
+            continue;
+        }
+        float value = 0.5f + 0.4f * std::sin(0.05f * float(step));
+        events.push_back({position, juce::MidiMessage(), index, value});
+    }
+}
+
+struct Measurement
+{
+    int bufferSize;
+    int calls;
+    double meanNanoseconds;
+    double p99Nanoseconds;
+    double maxNanoseconds;
+};
+
+Measurement measure(JX11::Processor::JX11AudioProcessor& processor, const Options& options,
+                    const std::vector<TimedEvent>& events, int bufferSize)
+{
+    processor.setPlayConfigDetails(0, 2, options.sampleRate, bufferSize);
+    processor.prepareToPlay(options.sampleRate, bufferSize);
+
+    juce::AudioBuffer<float> buffer(2, bufferSize);
+    juce::MidiBuffer midi;
+    midi.ensureSize(4096);
+
+    const auto& params = processor.getParameters();
+    const auto totalSamples = int64_t(options.seconds * options.sampleRate);
+
+    std::vector<double> times;
+    times.reserve(size_t(totalSamples / bufferSize + 1));
+
+    size_t next = 0;
+    for (int64_t position = 0; position < totalSamples; position += bufferSize) {
+        // Give the processor this block's MIDI and parameter changes. Like a
+        // host, the parameters are set before processBlock is called.
+        midi.clear();
+        while (next < events.size() && events[next].samplePosition < position + bufferSize) {
+            const auto& event = events[next++];
+            if (event.parameterIndex >= 0) {
+                params[event.parameterIndex]->setValueNotifyingHost(event.parameterValue);
+            } else {
+                midi.addEvent(event.message, int(event.samplePosition - position));
+            }
+        }
+
+        Tools::Timer timer;
+        {
+            Tools::RtCheck::AudioThreadScope audioThread;
+            processor.processBlock(buffer, midi);
+        }
+        times.push_back(timer.elapsedNanoseconds());
+    }
+
+    processor.releaseResources();
+
+    Measurement m;
+    m.bufferSize = bufferSize;
+    m.calls = int(times.size());
+    m.meanNanoseconds = 0.0;
+    for (double time : times) {
+        m.meanNanoseconds += time;
+    }
+    m.meanNanoseconds /= double(times.size());
+    m.p99Nanoseconds = Tools::percentile(times, 0.99);
+    m.maxNanoseconds = times.back();
+    return m;
+}
+
+void printUsage()
+{
+    std::fputs("usage: jx11_plughost [options]\n"
+               "  --sample-rate <hz>   sample rate (default 48000)\n"
+               "  --seconds <s>        length of the performance (default 10)\n"
+               "  --midi <file>        play this MIDI file instead of the built-in performance\n"
+               "  --automation <s>     seconds between parameter changes, 0 for none (default 0.01)\n"
+               "  --json <file>        also write the results as JSON\n"
+               "  --no-rt-check        don't check for allocations and locks in processBlock\n",
+               stderr);
+}
+
+bool parseOptions(const juce::StringArray& args, Options& options)
+{
+    for (int i = 1; i < args.size(); ++i) {
+        const auto& arg = args[i];
+        bool hasValue = i + 1 < args.size();
+        if (arg == "--sample-rate" && hasValue) {
+            options.sampleRate = args[++i].getDoubleValue();
+        } else if (arg == "--seconds" && hasValue) {
+            options.seconds = args[++i].getDoubleValue();
+        } else if (arg == "--midi" && hasValue) {
+            options.midiPath = args[++i];
+        } else if (arg == "--automation" && hasValue) {
+            options.automationInterval = args[++i].getDoubleValue();
+        } else if (arg == "--json" && hasValue) {
+            options.jsonPath = args[++i];
+        } else if (arg == "--no-rt-check") {
+            options.rtCheck = false;
+        } else {
+            return false;
+        }
+    }
+    return options.sampleRate > 0.0 && options.seconds > 0.0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    Options options;
+    if (!parseOptions(juce::StringArray(argv, argc), options)) {
+        printUsage();
+        return 1;
+    }
+
+    JX11::Processor::JX11AudioProcessor processor;
+    Tools::RtCheck::setEnabled(options.rtCheck);
+
+    std::vector<TimedEvent> events;
+    if (options.midiPath.isNotEmpty()) {
+        if (!loadMidiFile(options, events)) {
+            std::fprintf(stderr, "cannot read %s\n", options.midiPath.toRawUTF8());
+            return 1;
+        }
+    } else {
+        events = makeBuiltinPerformance(options);
+    }
+    addAutomation(options, processor, events);
+    std::stable_sort(events.begin(), events.end(), [](const TimedEvent& a, const TimedEvent& b) {
+        return a.samplePosition < b.samplePosition;
+    });
+
+    std::printf("jx11_plughost: %g s at %g Hz, %d events\n", options.seconds, options.sampleRate, int(events.size()));
+    std::printf("  %8s %8s %12s %12s %12s %12s\n", "buffer", "calls", "mean us", "p99 us", "max us", "ns/sample");
+
+    std::vector<Measurement> measurements;
+    for (int bufferSize = 16; bufferSize <= 2048; bufferSize *= 2) {
+        auto m = measure(processor, options, events, bufferSize);
+        std::printf("  %8d %8d %12.2f %12.2f %12.2f %12.2f\n", m.bufferSize, m.calls, m.meanNanoseconds / 1000.0,
+                    m.p99Nanoseconds / 1000.0, m.maxNanoseconds / 1000.0, m.meanNanoseconds / m.bufferSize);
+        measurements.push_back(m);
+    }
+
+    // Least-squares fit of the mean time per call against the buffer size.
+    double n = double(measurements.size());
+    double sumX = 0.0, sumY = 0.0, sumXX = 0.0, sumXY = 0.0;
+    for (const auto& m : measurements) {
+        double x = m.bufferSize;
+        sumX += x;
+        sumY += m.meanNanoseconds;
+        sumXX += x * x;
+        sumXY += x * m.meanNanoseconds;
+    }
+    double perSample = (n * sumXY - sumX * sumY) / (n * sumXX - sumX * sumX);
+    double fixed = (sumY - perSample * sumX) / n;
+
+    std::printf("fixed cost per call: %.2f us\n", fixed / 1000.0);
+    std::printf("cost per sample:     %.2f ns\n", perSample);
+    for (const auto& m : measurements) {
+        if (m.bufferSize == 32) {
+            std::printf("fixed share at 32 samples: %.1f%%\n", 100.0 * fixed / m.meanNanoseconds);
+        }
+    }
+
+    if (options.jsonPath.isNotEmpty()) {
+        FILE* file = std::fopen(options.jsonPath.toRawUTF8(), "w");
+        if (file == nullptr) {
+            std::fprintf(stderr, "cannot write %s\n", options.jsonPath.toRawUTF8());
+            return 1;
+        }
+        Tools::JsonWriter json(file);
+        json.beginObject();
+        json.member("benchmark", "jx11_plughost");
+        json.member("version", JX11_VERSION);
+        json.member("sample_rate", options.sampleRate);
+        json.member("seconds", options.seconds);
+        json.member("fixed_ns_per_call", fixed);
+        json.member("ns_per_sample", perSample);
+        json.member("rt_violations", static_cast<long long>(Tools::RtCheck::getViolationCount()));
+        json.key("buffer_sizes");
+        json.beginArray();
+        for (const auto& m : measurements) {
+            json.beginObject();
+            json.member("buffer_size", m.bufferSize);
+            json.member("calls", m.calls);
+            json.member("mean_ns", m.meanNanoseconds);
+            json.member("p99_ns", m.p99Nanoseconds);
+            json.member("max_ns", m.maxNanoseconds);
+            json.endObject();
+        }
+        json.endArray();
+        json.endObject();
+        json.finish();
+        std::fclose(file);
+    }
+
+    Tools::RtCheck::printSummary();
+    return Tools::RtCheck::getViolationCount() > 0 ? 1 : 0;
+}
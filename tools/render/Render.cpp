@@ -0,0 +1,857 @@
+// jx11_render: renders a preset and a MIDI file to a WAV file, offline.
+//
+// The preset is the state that BaseProcessor::getStateInformation saves, see
+// common/Preset.h. The MIDI file is played like the plugin would in a host:
+// the synth renders in blocks, the audio is split at the MIDI events, and a
+// volume controller (CC 7) changes the Output Level parameter, which takes
+// effect at the start of the next block. After the last event, rendering goes
+// on until all voices are silent, or --max-tail seconds at most.
+//
+// It runs as fast as it can and reports the real-time factor: how many
+// seconds of audio it renders per second of wall-clock time. Writing the file
+// is not included in that.
+//
+// A long performance is rendered on several cores by cutting it up at the
+// points where all voices are silent. The segments are rendered in parallel
+// and written in order, and the output is the same, sample for sample, as
+// rendering everything in one go. That only works if every segment starts with
+// exactly the state the synth would have at that point. Most of that state,
+// like the LFO phase, the noise generator, the output level smoother and the
+// MIDI controllers, does not depend on the voices. But a voice that has gone
+// silent keeps the phases of its oscillators and its filter envelope, and the
+// next note that uses the voice starts from them. So a quick pass over the
+// whole performance with Synth::advance, which runs the envelopes and the
+// oscillators but not the filters and skips the output, finds the silent
+// points and the state of the synth at each of them.
+//
+// With --cache, finished renders are kept in a directory, under a hash of
+// everything that affects the output. Rendering the same thing again copies the
+// file from the cache instead, see common/RenderCache.h.
+//
+// Given several MIDI files, it renders them as variations of one performance,
+// for instance the same intro with different endings. The part that they have
+// in common is rendered once. Then the synth is forked with a snapshot, and
+// the rest of the variations are rendered from there in parallel. Every file
+// is the same as when its MIDI file is rendered on its own.
+
+#include "common/Json.h"
+#include "common/MidiEvents.h"
+#include "common/MidiFile.h"
+#include "common/Preset.h"
+#include "common/RenderCache.h"
+#include "common/Timer.h"
+#include "common/WavWriter.h"
+#include "common/WorkStealingPool.h"
+#include "engine/Synth.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <future>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace JX11;
+using namespace JX11::Engine;
+using Tools::MidiEvent;
+
+namespace
+{
+
+struct Options
+{
+    double sampleRate = 48000.0;
+    int blockSize = 512;
+    Tools::SampleFormat format = Tools::SampleFormat::pcm24;
+
+    // Longest time to keep rendering after the last MIDI event.
+    double maxTail = 10.0;
+
+    int threads = 0; // 0 = one per core
+
+    // The shortest part of the performance that is rendered on its own core.
+    double minSegment = 1.0;
+
+    std::optional<uint32_t> seed;
+
+    // The render cache, and its size limit in bytes.
+    std::string cachePath;
+    uint64_t cacheSize = 4096ull << 20;
+
+    std::string presetPath;
+
+    // The MIDI files, and the WAV files to render them to.
+    std::vector<std::string> midiPaths;
+    std::vector<std::string> outputPaths;
+    std::string jsonPath;
+};
+
+// Plays the MIDI messages on the synth, one block at a time, like the plugin
+// would in a host. A copy of this is a snapshot of the whole performance at
+// the start of a block.
+struct OfflineSynth
+{
+    Synth synth;
+    Parameters params;
+    bool parametersChanged = false;
+
+    // The next MIDI message to play, and the first frame of the next block.
+    size_t next = 0;
+    uint64_t frame = 0;
+
+    // Uses Synth::advance instead of rendering audio.
+    bool stateOnly = false;
+
+    void render(float** outputBuffers, int sampleCount)
+    {
+        if (stateOnly) {
+            synth.advance(sampleCount);
+        } else {
+            synth.render(outputBuffers, sampleCount);
+        }
+    }
+
+    void midiMessage(uint8_t data0, uint8_t data1, uint8_t data2)
+    {
+        // Same as JX11AudioProcessor::handleMIDI.
+        if ((data0 & 0xF0) == 0xB0 && data1 == 0x07) {
+            const auto* info = findParameterInfo("outputLevel");
+            info->set(params, info->fromNormalized(float(data2) / 127.0f));
+            parametersChanged = true;
+        }
+        synth.midiMessage(data0, data1, data2);
+    }
+
+    // Renders the next block with the MIDI messages that fall in it.
+    void playBlock(const Options& options, const std::vector<Tools::TimedMidiMessage>& messages,
+                   std::vector<MidiEvent>& events, float** outputBuffers)
+    {
+        const uint64_t blockEnd = frame + uint64_t(options.blockSize);
+
+        events.clear();
+        for (; next < messages.size(); ++next) {
+            const auto position = uint64_t(std::llround(messages[next].seconds * options.sampleRate));
+            if (position >= blockEnd) {
+                break;
+            }
+            const auto& m = messages[next];
+            events.push_back({int(position > frame ? position - frame : 0), m.data0, m.data1, m.data2});
+        }
+
+        if (parametersChanged) {
+            parametersChanged = false;
+            synth.applyParameters(params);
+        }
+        Tools::renderWithEvents(*this, outputBuffers, options.blockSize, events);
+        frame = blockEnd;
+    }
+};
+
+OfflineSynth prepare(const Options& options, const Parameters& params)
+{
+    OfflineSynth offline;
+    offline.params = params;
+
+    Synth& synth = offline.synth;
+    synth.allocateResources(options.sampleRate, options.blockSize);
+    synth.setSeed(options.seed);
+
+    // Like JX11AudioProcessor::prepareToPlay and the first processBlock.
+    synth.reset();
+    synth.outputLevelSmoother.setCurrentAndTargetValue(std::pow(10.0f, params.outputLevel * 0.05f));
+    synth.applyParameters(params);
+    return offline;
+}
+
+// Keeps track of when to stop: once all voices are silent after the last MIDI
+// message, or after --max-tail seconds.
+struct TailCounter
+{
+    uint64_t tailFrames;
+    uint64_t framesAfterLastEvent = 0;
+
+    bool isFinished(const Options& options, const OfflineSynth& offline, size_t messageCount)
+    {
+        if (offline.next < messageCount) {
+            return false;
+        }
+        framesAfterLastEvent += uint64_t(options.blockSize);
+        return offline.synth.getActiveVoiceCount() == 0 || framesAfterLastEvent >= tailFrames;
+    }
+};
+
+struct Result
+{
+    uint64_t frames = 0;
+    double renderSeconds = 0.0;
+    double peak = 0.0;
+
+    // For parallel rendering: the number of segments, and the time taken by
+    // the pass that looks for the silent points.
+    size_t segments = 1;
+    double stateSeconds = 0.0;
+};
+
+double getPeak(const float* left, const float* right, size_t frames)
+{
+    double peak = 0.0;
+    for (size_t i = 0; i < frames; ++i) {
+        peak = std::max(peak, double(std::max(std::abs(left[i]), std::abs(right[i]))));
+    }
+    return peak;
+}
+
+Result render(const Options& options, const Parameters& params, const std::vector<Tools::TimedMidiMessage>& messages,
+              Tools::WavWriter& writer)
+{
+    OfflineSynth offline = prepare(options, params);
+
+    std::vector<float> left(size_t(options.blockSize));
+    std::vector<float> right(size_t(options.blockSize));
+    float* outputBuffers[2] = {left.data(), right.data()};
+    std::vector<MidiEvent> events;
+    events.reserve(256);
+
+    TailCounter tail {uint64_t(options.maxTail * options.sampleRate)};
+    Result result;
+
+    while (true) {
+        Tools::Timer timer;
+        offline.playBlock(options, messages, events, outputBuffers);
+        result.renderSeconds += timer.elapsedNanoseconds() * 1e-9;
+
+        result.peak = std::max(result.peak, getPeak(left.data(), right.data(), left.size()));
+        writer.write(left.data(), right.data(), options.blockSize);
+
+        if (tail.isFinished(options, offline, messages.size())) {
+            break;
+        }
+    }
+    result.frames = offline.frame;
+    return result;
+}
+
+// A part of the performance that starts and ends with all voices silent.
+struct Segment
+{
+    OfflineSynth start;
+    uint64_t endFrame = 0;
+
+    std::vector<float> left, right;
+    double peak = 0.0;
+
+    std::promise<void> rendered;
+};
+
+void renderSegment(const Options& options, const std::vector<Tools::TimedMidiMessage>& messages, Segment& segment)
+{
+    OfflineSynth& offline = segment.start;
+    offline.stateOnly = false;
+
+    const auto frames = size_t(segment.endFrame - offline.frame);
+    segment.left.resize(frames);
+    segment.right.resize(frames);
+    std::vector<MidiEvent> events;
+    events.reserve(256);
+
+    for (size_t offset = 0; offset < frames; offset += size_t(options.blockSize)) {
+        float* outputBuffers[2] = {segment.left.data() + offset, segment.right.data() + offset};
+        offline.playBlock(options, messages, events, outputBuffers);
+    }
+    segment.peak = getPeak(segment.left.data(), segment.right.data(), frames);
+}
+
+// Renders the segments on a thread pool while the state pass goes on finding
+// the next ones. The segments are written as soon as they and all the ones
+// before them are done. At most a few segments per thread are kept in memory.
+Result renderParallel(const Options& options, int threadCount, const Parameters& params,
+                      const std::vector<Tools::TimedMidiMessage>& messages, Tools::WavWriter& writer)
+{
+    Tools::WorkStealingPool pool(threadCount);
+    const size_t maxSegments = 2 * size_t(threadCount);
+    const auto minSegmentFrames = uint64_t(options.minSegment * options.sampleRate);
+
+    std::deque<std::unique_ptr<Segment>> segments;
+    std::deque<std::future<void>> futures;
+    Result result;
+    result.segments = 0;
+    double writeSeconds = 0.0;
+
+    const auto writeSegment = [&] {
+        futures.front().wait();
+        Segment& segment = *segments.front();
+        Tools::Timer timer;
+        writer.write(segment.left.data(), segment.right.data(), int(segment.left.size()));
+        writeSeconds += timer.elapsedNanoseconds() * 1e-9;
+        result.peak = std::max(result.peak, segment.peak);
+        segments.pop_front();
+        futures.pop_front();
+    };
+
+    const auto submitSegment = [&](const OfflineSynth& start, uint64_t endFrame) {
+        if (segments.size() == maxSegments) {
+            writeSegment();
+        }
+        auto segment = std::make_unique<Segment>();
+        segment->start = start;
+        segment->endFrame = endFrame;
+        futures.push_back(segment->rendered.get_future());
+        pool.submit([&options, &messages, s = segment.get()](int) {
+            renderSegment(options, messages, *s);
+            s->rendered.set_value();
+        });
+        segments.push_back(std::move(segment));
+        ++result.segments;
+    };
+
+    Tools::Timer total;
+
+    OfflineSynth offline = prepare(options, params);
+    offline.stateOnly = true;
+    OfflineSynth segmentStart = offline;
+
+    // Synth::advance doesn't write to these.
+    std::vector<float> unused(size_t(options.blockSize));
+    float* outputBuffers[2] = {unused.data(), unused.data()};
+    std::vector<MidiEvent> events;
+    events.reserve(256);
+    TailCounter tail {uint64_t(options.maxTail * options.sampleRate)};
+
+    while (true) {
+        Tools::Timer timer;
+        offline.playBlock(options, messages, events, outputBuffers);
+        bool finished = tail.isFinished(options, offline, messages.size());
+        result.stateSeconds += timer.elapsedNanoseconds() * 1e-9;
+
+        if (finished) {
+            break;
+        }
+        if (offline.frame - segmentStart.frame >= minSegmentFrames && offline.synth.getActiveVoiceCount() == 0) {
+            submitSegment(segmentStart, offline.frame);
+            segmentStart = offline;
+        }
+
+        // Write what is done already, to keep the memory use down.
+        while (!futures.empty() && futures.front().wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            writeSegment();
+        }
+    }
+    submitSegment(segmentStart, offline.frame);
+
+    while (!segments.empty()) {
+        writeSegment();
+    }
+
+    result.frames = offline.frame;
+    result.renderSeconds = total.elapsedNanoseconds() * 1e-9 - writeSeconds;
+    return result;
+}
+
+// Everything that affects the output file. The number of threads doesn't, as
+// rendering in parallel gives the same output. The engine's output may only
+// change with a new version number.
+std::string makeCacheKey(const Options& options, const Parameters& params,
+                         const std::vector<Tools::TimedMidiMessage>& messages)
+{
+    Tools::CacheKey key;
+    key.add("jx11_render");
+    key.add(JX11_VERSION);
+
+    for (const auto& info : PARAMETER_INFOS) {
+        key.add(info.id);
+        key.add(info.get(params));
+    }
+
+    key.add(options.sampleRate);
+    key.add(options.blockSize);
+    key.add(int(options.format));
+    key.add(options.maxTail);
+    key.add(options.seed.has_value());
+    key.add(options.seed.value_or(0));
+
+    key.add(uint64_t(messages.size()));
+    for (const auto& m : messages) {
+        key.add(m.seconds);
+        key.add(m.data0);
+        key.add(m.data1);
+        key.add(m.data2);
+    }
+    return key.toString();
+}
+
+// One of the performances for renderVariations.
+struct Variation
+{
+    std::string outputPath;
+    std::vector<Tools::TimedMidiMessage> messages;
+    Tools::WavWriter writer;
+    Result result;
+
+    // With --cache: the size of the file if it came from the cache.
+    std::string cacheKey;
+    std::optional<uint64_t> cached;
+};
+
+uint64_t getPosition(const Options& options, const Tools::TimedMidiMessage& message)
+{
+    return uint64_t(std::llround(message.seconds * options.sampleRate));
+}
+
+// The start of the block where the variations start to differ: the block with
+// the first MIDI message that is not the same in all of them, or with the last
+// message of a variation, as it may stop after that one.
+uint64_t findForkFrame(const Options& options, const std::vector<Variation*>& variations)
+{
+    const auto& first = variations.front()->messages;
+    const auto isShared = [&](size_t i) {
+        return std::all_of(variations.begin(), variations.end(), [&](const auto& variation) {
+            if (i >= variation->messages.size()) {
+                return false;
+            }
+            const auto& m = variation->messages[i];
+            return getPosition(options, m) == getPosition(options, first[i]) && m.data0 == first[i].data0 &&
+                   m.data1 == first[i].data1 && m.data2 == first[i].data2;
+        });
+    };
+    size_t shared = 0;
+    while (isShared(shared)) {
+        ++shared;
+    }
+
+    uint64_t fork = UINT64_MAX;
+    for (const auto& variation : variations) {
+        const auto& messages = variation->messages;
+        if (messages.empty()) {
+            return 0;
+        }
+        fork = std::min(fork, getPosition(options, messages[std::min(shared, messages.size() - 1)]));
+    }
+    return fork - fork % uint64_t(options.blockSize);
+}
+
+// Renders the rest of a variation from the snapshot taken at the fork. The
+// snapshot has the state of the synth, but the synth that restores it needs
+// its own resources for the sample rate.
+void renderFork(const Options& options, const OfflineSynth& shared, const Synth::Snapshot& snapshot,
+                Variation& variation)
+{
+    OfflineSynth offline = prepare(options, shared.params);
+    offline.synth.restoreSnapshot(snapshot);
+    offline.parametersChanged = shared.parametersChanged;
+    offline.next = shared.next;
+    offline.frame = shared.frame;
+
+    std::vector<float> left(size_t(options.blockSize));
+    std::vector<float> right(size_t(options.blockSize));
+    float* outputBuffers[2] = {left.data(), right.data()};
+    std::vector<MidiEvent> events;
+    events.reserve(256);
+
+    TailCounter tail {uint64_t(options.maxTail * options.sampleRate)};
+    Result& result = variation.result;
+
+    while (true) {
+        Tools::Timer timer;
+        offline.playBlock(options, variation.messages, events, outputBuffers);
+        result.renderSeconds += timer.elapsedNanoseconds() * 1e-9;
+
+        result.peak = std::max(result.peak, getPeak(left.data(), right.data(), left.size()));
+        variation.writer.write(left.data(), right.data(), options.blockSize);
+
+        if (tail.isFinished(options, offline, variation.messages.size())) {
+            break;
+        }
+    }
+    result.frames = offline.frame;
+}
+
+// Renders the part that the variations have in common once, and writes it to
+// all of the files. Then the synth is forked, and the rest of every variation
+// is rendered on its own thread. Returns the result of the shared part.
+Result renderForked(const Options& options, int threadCount, const Parameters& params,
+                    const std::vector<Variation*>& variations)
+{
+    const uint64_t forkFrame = findForkFrame(options, variations);
+    OfflineSynth offline = prepare(options, params);
+
+    std::vector<float> left(size_t(options.blockSize));
+    std::vector<float> right(size_t(options.blockSize));
+    float* outputBuffers[2] = {left.data(), right.data()};
+    std::vector<MidiEvent> events;
+    events.reserve(256);
+    Result shared;
+
+    while (offline.frame < forkFrame) {
+        Tools::Timer timer;
+        offline.playBlock(options, variations.front()->messages, events, outputBuffers);
+        shared.renderSeconds += timer.elapsedNanoseconds() * 1e-9;
+
+        shared.peak = std::max(shared.peak, getPeak(left.data(), right.data(), left.size()));
+        for (auto& variation : variations) {
+            variation->writer.write(left.data(), right.data(), options.blockSize);
+        }
+    }
+    shared.frames = offline.frame;
+
+    Synth::Snapshot snapshot;
+    offline.synth.saveSnapshot(snapshot);
+
+    Tools::WorkStealingPool pool(threadCount);
+    for (auto& variation : variations) {
+        variation->result.peak = shared.peak;
+        pool.submit([&, v = variation](int) { renderFork(options, offline, snapshot, *v); });
+    }
+    pool.wait();
+    return shared;
+}
+
+int renderVariations(const Options& options, int threadCount, const Parameters& params)
+{
+    std::optional<Tools::RenderCache> cache;
+    if (!options.cachePath.empty()) {
+        cache.emplace(options.cachePath, options.cacheSize);
+    }
+
+    // Every variation is cached under its own key, as if it had been
+    // rendered on its own. Only the ones that are not in the cache are
+    // rendered, and they still fork from their common part.
+    Tools::Timer total;
+    std::vector<std::unique_ptr<Variation>> variations;
+    std::vector<Variation*> rendered;
+    for (size_t i = 0; i < options.midiPaths.size(); ++i) {
+        auto variation = std::make_unique<Variation>();
+        std::string error;
+        Tools::MidiFileReader reader;
+        if (!reader.read(options.midiPaths[i], variation->messages, error)) {
+            std::fprintf(stderr, "%s: %s\n", options.midiPaths[i].c_str(), error.c_str());
+            return 1;
+        }
+        variation->outputPath = options.outputPaths[i];
+        if (cache) {
+            variation->cacheKey = makeCacheKey(options, params, variation->messages);
+            variation->cached = cache->find(variation->cacheKey, variation->outputPath);
+        }
+        if (!variation->cached) {
+            if (!variation->writer.open(variation->outputPath, int(options.sampleRate), options.format)) {
+                std::fprintf(stderr, "cannot write %s\n", variation->outputPath.c_str());
+                return 1;
+            }
+            rendered.push_back(variation.get());
+        }
+        variations.push_back(std::move(variation));
+    }
+
+    Result shared;
+    if (!rendered.empty()) {
+        shared = renderForked(options, threadCount, params, rendered);
+    }
+    for (auto* variation : rendered) {
+        if (!variation->writer.close()) {
+            std::fprintf(stderr, "cannot write %s\n", variation->outputPath.c_str());
+            return 1;
+        }
+        if (cache && !cache->insert(variation->cacheKey, variation->outputPath)) {
+            std::fprintf(stderr, "warning: cannot add %s to the cache\n", variation->outputPath.c_str());
+        }
+    }
+    const double totalSeconds = total.elapsedNanoseconds() * 1e-9;
+
+    // All of the audio, as if every file had been rendered from the start.
+    double audioSeconds = 0.0;
+    for (const auto& variation : variations) {
+        audioSeconds += double(variation->result.frames) / options.sampleRate;
+    }
+    const double sharedSeconds = double(shared.frames) / options.sampleRate;
+
+    std::printf("jx11_render: %zu variations at %g Hz, %d-sample blocks, %d threads, %s kernels\n",
+                variations.size(), options.sampleRate, options.blockSize, threadCount,
+                getKernelName(selectKernels().level));
+    if (!rendered.empty()) {
+        std::printf("  shared part  %10.2f s of audio, rendered once in %.3f s\n", sharedSeconds,
+                    shared.renderSeconds);
+    }
+    for (const auto& variation : variations) {
+        const Result& result = variation->result;
+        if (variation->cached) {
+            std::printf("  %s: %s from the cache, %llu bytes\n", variation->outputPath.c_str(),
+                        variation->cacheKey.c_str(), (unsigned long long)*variation->cached);
+            continue;
+        }
+        std::printf("  %s: %.2f s of audio, %.3f s after the fork, %.1f dBFS peak\n", variation->outputPath.c_str(),
+                    double(result.frames) / options.sampleRate, result.renderSeconds,
+                    result.peak > 0.0 ? 20.0 * std::log10(result.peak) : -100.0);
+    }
+    if (!rendered.empty()) {
+        std::printf("  with writing %10.3f s  (%.1fx real time for the rendered files)\n", totalSeconds,
+                    audioSeconds / totalSeconds);
+    }
+
+    Tools::RenderCache::Stats cacheStats;
+    if (cache) {
+        cacheStats = cache->getStats();
+        std::printf("  cache        %.1f %% hits of %llu renders, %.1f MB saved, %.1f MB in use\n",
+                    100.0 * cacheStats.getHitRate(), (unsigned long long)(cacheStats.hits + cacheStats.misses),
+                    double(cacheStats.bytesSaved) / 1048576.0, double(cache->getSize()) / 1048576.0);
+    }
+
+    if (!options.jsonPath.empty()) {
+        FILE* file = std::fopen(options.jsonPath.c_str(), "w");
+        if (file == nullptr) {
+            std::fprintf(stderr, "cannot write %s\n", options.jsonPath.c_str());
+            return 1;
+        }
+        Tools::JsonWriter json(file);
+        json.beginObject();
+        json.member("tool", "jx11_render");
+        json.member("version", JX11_VERSION);
+        json.member("total_seconds", totalSeconds);
+        json.member("kernel", getKernelName(selectKernels().level));
+        json.member("sample_rate", options.sampleRate);
+        json.member("block_size", options.blockSize);
+        json.member("threads", threadCount);
+        json.member("shared_audio_seconds", sharedSeconds);
+        json.member("shared_render_seconds", shared.renderSeconds);
+        json.member("realtime_factor", audioSeconds / totalSeconds);
+        json.key("variations");
+        json.beginArray();
+        for (const auto& variation : variations) {
+            const Result& result = variation->result;
+            json.beginObject();
+            json.member("output", variation->outputPath);
+            if (cache) {
+                json.member("cache_key", variation->cacheKey);
+                json.member("cache_hit", variation->cached.has_value());
+            }
+            json.member("midi_events", static_cast<long long>(variation->messages.size()));
+            json.member("frames", static_cast<long long>(result.frames));
+            json.member("render_seconds", result.renderSeconds);
+            json.member("peak_dbfs", result.peak > 0.0 ? 20.0 * std::log10(result.peak) : -100.0);
+            json.endObject();
+        }
+        json.endArray();
+        if (cache) {
+            json.key("cache");
+            json.beginObject();
+            json.member("hits", static_cast<long long>(cacheStats.hits));
+            json.member("misses", static_cast<long long>(cacheStats.misses));
+            json.member("hit_rate", cacheStats.getHitRate());
+            json.member("bytes_saved", static_cast<long long>(cacheStats.bytesSaved));
+            json.endObject();
+        }
+        json.endObject();
+        json.finish();
+        std::fclose(file);
+    }
+    return 0;
+}
+
+void printUsage()
+{
+    std::fputs("usage: jx11_render [options] <preset> <midi file> <output.wav> [<midi file> <output.wav> ...]\n"
+               "  --sample-rate <hz>   sample rate (default 48000)\n"
+               "  --block-size <n>     samples per block (default 512)\n"
+               "  --format <format>    16, 24 or float (default 24)\n"
+               "  --max-tail <s>       max seconds to render after the last MIDI event (default 10)\n"
+               "  --threads <n>        threads for rendering the silent-separated parts of the\n"
+               "                       performance in parallel (default: one per core). With\n"
+               "                       several MIDI files, the variations run in parallel instead\n"
+               "  --min-segment <s>    shortest part to render on its own thread (default 1)\n"
+               "  --seed <n>           deterministic mode with this seed, see Synth::setSeed\n"
+               "  --cache <dir>        reuse earlier renders of the same preset, MIDI and options,\n"
+               "                       with one entry per MIDI file\n"
+               "  --cache-size <MB>    size limit of the cache (default 4096)\n"
+               "  --json <file>        also write the stats as JSON\n",
+               stderr);
+}
+
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--sample-rate" && hasValue) {
+            options.sampleRate = std::atof(argv[++i]);
+        } else if (arg == "--block-size" && hasValue) {
+            options.blockSize = std::atoi(argv[++i]);
+        } else if (arg == "--format" && hasValue) {
+            std::string format = argv[++i];
+            if (format == "16") {
+                options.format = Tools::SampleFormat::pcm16;
+            } else if (format == "24") {
+                options.format = Tools::SampleFormat::pcm24;
+            } else if (format == "float") {
+                options.format = Tools::SampleFormat::float32;
+            } else {
+                return false;
+            }
+        } else if (arg == "--max-tail" && hasValue) {
+            options.maxTail = std::atof(argv[++i]);
+        } else if (arg == "--threads" && hasValue) {
+            options.threads = std::atoi(argv[++i]);
+        } else if (arg == "--min-segment" && hasValue) {
+            options.minSegment = std::atof(argv[++i]);
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = uint32_t(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--cache" && hasValue) {
+            options.cachePath = argv[++i];
+        } else if (arg == "--cache-size" && hasValue) {
+            options.cacheSize = uint64_t(std::atof(argv[++i]) * 1048576.0);
+        } else if (arg == "--json" && hasValue) {
+            options.jsonPath = argv[++i];
+        } else if (!arg.empty() && arg[0] != '-') {
+            paths.push_back(arg);
+        } else {
+            return false;
+        }
+    }
+    if (paths.size() < 3 || paths.size() % 2 != 1) {
+        return false;
+    }
+    options.presetPath = paths[0];
+    for (size_t i = 1; i < paths.size(); i += 2) {
+        options.midiPaths.push_back(paths[i]);
+        options.outputPaths.push_back(paths[i + 1]);
+    }
+    return options.sampleRate > 0.0 && options.blockSize > 0 && options.maxTail >= 0.0 && options.threads >= 0 &&
+           options.minSegment >= 0.0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 1;
+    }
+
+    std::string error;
+    Parameters params;
+    if (!Tools::loadPreset(options.presetPath, params, error)) {
+        std::fprintf(stderr, "%s: %s\n", options.presetPath.c_str(), error.c_str());
+        return 1;
+    }
+
+    int threadCount = options.threads;
+    if (threadCount == 0) {
+        threadCount = int(std::max(1u, std::thread::hardware_concurrency()));
+    }
+
+    if (options.midiPaths.size() > 1) {
+        return renderVariations(options, threadCount, params);
+    }
+    const std::string& outputPath = options.outputPaths[0];
+
+    std::vector<Tools::TimedMidiMessage> messages;
+    Tools::MidiFileReader reader;
+    if (!reader.read(options.midiPaths[0], messages, error)) {
+        std::fprintf(stderr, "%s: %s\n", options.midiPaths[0].c_str(), error.c_str());
+        return 1;
+    }
+
+    Tools::Timer total;
+    Result result;
+
+    std::optional<Tools::RenderCache> cache;
+    std::string cacheKey;
+    std::optional<uint64_t> cached;
+    if (!options.cachePath.empty()) {
+        cache.emplace(options.cachePath, options.cacheSize);
+        cacheKey = makeCacheKey(options, params, messages);
+        cached = cache->find(cacheKey, outputPath);
+    }
+
+    if (!cached) {
+        Tools::WavWriter writer;
+        if (!writer.open(outputPath, int(options.sampleRate), options.format)) {
+            std::fprintf(stderr, "cannot write %s\n", outputPath.c_str());
+            return 1;
+        }
+        result = (threadCount == 1) ? render(options, params, messages, writer)
+                                    : renderParallel(options, threadCount, params, messages, writer);
+        if (!writer.close()) {
+            std::fprintf(stderr, "cannot write %s\n", outputPath.c_str());
+            return 1;
+        }
+        if (cache && !cache->insert(cacheKey, outputPath)) {
+            std::fprintf(stderr, "warning: cannot add %s to the cache\n", outputPath.c_str());
+        }
+    }
+    const double totalSeconds = total.elapsedNanoseconds() * 1e-9;
+
+    const double audioSeconds = double(result.frames) / options.sampleRate;
+    const double realtime = audioSeconds / result.renderSeconds;
+    const double peakDecibels = result.peak > 0.0 ? 20.0 * std::log10(result.peak) : -100.0;
+
+    if (cached) {
+        std::printf("jx11_render: %s from the cache, %llu bytes in %.3f s\n", cacheKey.c_str(),
+                    (unsigned long long)*cached, totalSeconds);
+    } else {
+        std::printf("jx11_render: %zu MIDI events, %.2f s of audio at %g Hz, %d-sample blocks, %s kernels\n",
+                    messages.size(), audioSeconds, options.sampleRate, options.blockSize,
+                    getKernelName(selectKernels().level));
+        if (threadCount > 1) {
+            std::printf("  %zu segments on %d threads, silence search %.3f s\n", result.segments, threadCount,
+                        result.stateSeconds);
+        }
+        std::printf("  render time  %10.3f s  (%.1fx real time)\n", result.renderSeconds, realtime);
+        std::printf("  with writing %10.3f s  (%.1fx real time)\n", totalSeconds, audioSeconds / totalSeconds);
+        std::printf("  peak level   %10.1f dBFS\n", peakDecibels);
+    }
+
+    Tools::RenderCache::Stats cacheStats;
+    if (cache) {
+        cacheStats = cache->getStats();
+        std::printf("  cache        %.1f %% hits of %llu renders, %.1f MB saved, %.1f MB in use\n",
+                    100.0 * cacheStats.getHitRate(), (unsigned long long)(cacheStats.hits + cacheStats.misses),
+                    double(cacheStats.bytesSaved) / 1048576.0, double(cache->getSize()) / 1048576.0);
+    }
+
+    if (!options.jsonPath.empty()) {
+        FILE* file = std::fopen(options.jsonPath.c_str(), "w");
+        if (file == nullptr) {
+            std::fprintf(stderr, "cannot write %s\n", options.jsonPath.c_str());
+            return 1;
+        }
+        Tools::JsonWriter json(file);
+        json.beginObject();
+        json.member("tool", "jx11_render");
+        json.member("version", JX11_VERSION);
+        json.member("total_seconds", totalSeconds);
+        if (!cached) {
+            json.member("kernel", getKernelName(selectKernels().level));
+            json.member("sample_rate", options.sampleRate);
+            json.member("block_size", options.blockSize);
+            json.member("threads", threadCount);
+            json.member("segments", static_cast<long long>(result.segments));
+            json.member("silence_search_seconds", result.stateSeconds);
+            json.member("midi_events", static_cast<long long>(messages.size()));
+            json.member("frames", static_cast<long long>(result.frames));
+            json.member("audio_seconds", audioSeconds);
+            json.member("render_seconds", result.renderSeconds);
+            json.member("realtime_factor", realtime);
+            json.member("peak_dbfs", peakDecibels);
+        }
+        if (cache) {
+            json.key("cache");
+            json.beginObject();
+            json.member("key", cacheKey);
+            json.member("hit", cached.has_value());
+            json.member("hits", static_cast<long long>(cacheStats.hits));
+            json.member("misses", static_cast<long long>(cacheStats.misses));
+            json.member("hit_rate", cacheStats.getHitRate());
+            json.member("bytes_saved", static_cast<long long>(cacheStats.bytesSaved));
+            json.endObject();
+        }
+        json.endObject();
+        json.finish();
+        std::fclose(file);
+    }
+    return 0;
+}
@@ -0,0 +1,393 @@
+#include "RtCheck.h"
+#include <atomic>
+#include <cstdio>
+
+#if defined(__linux__) && defined(__GLIBC__)
+#define JX11_RTCHECK_INTERPOSE 1
+#else
+#define JX11_RTCHECK_INTERPOSE 0
+#endif
+
+#if JX11_RTCHECK_INTERPOSE
+#include <cerrno>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <new>
+#include <pthread.h>
+#include <unistd.h>
+
+// The allocator in glibc under its internal names. The replacements below
+// call these directly, so they don't have to look up the real malloc with
+// dlsym, which itself allocates.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* pointer);
+}
+#endif
+
+namespace JX11::Tools::RtCheck
+{
+
+namespace
+{
+
+std::atomic<bool> enabled {false};
+std::atomic<uint64_t> violationCount {0};
+
+// Nesting depth of AudioThreadScope on this thread.
+thread_local int audioDepth = 0;
+
+// Set while a violation is being reported, so that the allocations and locks
+// of the reporting code itself are let through.
+thread_local bool reporting = false;
+
+#if JX11_RTCHECK_INTERPOSE
+
+// Hashes of the stacks that have been printed already. Fixed size, so that
+// reporting doesn't allocate. Once it is full, new stacks are only counted.
+constexpr int MAX_STACKS = 256;
+constexpr int MAX_FRAMES = 48;
+
+std::atomic<uint64_t> printedStacks[MAX_STACKS];
+
+bool isNewStack(void* const* frames, int frameCount)
+{
+    uint64_t hash = 14695981039346656037ull; // FNV-1a
+    for (int i = 0; i < frameCount; ++i) {
+        hash = (hash ^ reinterpret_cast<uintptr_t>(frames[i])) * 1099511628211ull;
+    }
+    hash |= 1; // 0 means the entry is free
+
+    for (auto& entry : printedStacks) {
+        uint64_t expected = 0;
+        if (entry.compare_exchange_strong(expected, hash) || expected == hash) {
+            return expected == 0;
+        }
+    }
+    return false;
+}
+
+void report(const char* function)
+{
+    violationCount.fetch_add(1, std::memory_order_relaxed);
+
+    void* frames[MAX_FRAMES];
+    int frameCount = backtrace(frames, MAX_FRAMES);
+
+    // Leave out report() and the replaced function.
+    const int skip = 2;
+    if (frameCount <= skip || !isNewStack(frames + skip, frameCount - skip)) {
+        return;
+    }
+
+    std::fprintf(stderr, "rt-check: %s called on the audio thread\n", function);
+    backtrace_symbols_fd(frames + skip, frameCount - skip, STDERR_FILENO);
+    std::fputc('\n', stderr);
+}
+
+// Called at the start of every replaced function.
+inline void check(const char* function)
+{
+    if (audioDepth > 0 && !reporting && enabled.load(std::memory_order_relaxed)) {
+        reporting = true;
+        report(function);
+        reporting = false;
+    }
+}
+
+// Looks up the next definition of a libc function, the one that this file
+// replaces. This doesn't use a function-local static, because its guard
+// variable can take a lock and so call right back into the replacement.
+template <typename Function>
+Function findNext(std::atomic<Function>& cache, const char* name)
+{
+    Function function = cache.load(std::memory_order_relaxed);
+    if (function == nullptr) {
+        function = reinterpret_cast<Function>(dlsym(RTLD_NEXT, name));
+        cache.store(function, std::memory_order_relaxed);
+    }
+    return function;
+}
+
+#endif
+
+} // namespace
+
+bool isAvailable()
+{
+    return JX11_RTCHECK_INTERPOSE != 0;
+}
+
+void setEnabled(bool enabled_)
+{
+#if JX11_RTCHECK_INTERPOSE
+    // backtrace loads libgcc the first time it is called, so do that now
+    // rather than in the middle of a report.
+    void* frame;
+    backtrace(&frame, 1);
+#endif
+    enabled.store(enabled_);
+}
+
+uint64_t getViolationCount()
+{
+    return violationCount.load();
+}
+
+void printSummary()
+{
+    if (uint64_t count = getViolationCount(); count > 0) {
+        std::fprintf(stderr, "rt-check: %llu allocation or lock calls on the audio thread\n",
+                     static_cast<unsigned long long>(count));
+    }
+}
+
+AudioThreadScope::AudioThreadScope()
+{
+    ++audioDepth;
+}
+
+AudioThreadScope::~AudioThreadScope()
+{
+    --audioDepth;
+}
+
+} // namespace JX11::Tools::RtCheck
+
+#if JX11_RTCHECK_INTERPOSE
+
+using JX11::Tools::RtCheck::check;
+using JX11::Tools::RtCheck::findNext;
+
+// === Allocation ===
+
+extern "C" {
+
+void* malloc(size_t size) noexcept
+{
+    check("malloc");
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) noexcept
+{
+    check("calloc");
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size) noexcept
+{
+    check("realloc");
+    return __libc_realloc(pointer, size);
+}
+
+void free(void* pointer) noexcept
+{
+    if (pointer != nullptr) {
+        check("free");
+    }
+    __libc_free(pointer);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) noexcept
+{
+    check("aligned_alloc");
+    return __libc_memalign(alignment, size);
+}
+
+void* memalign(size_t alignment, size_t size) noexcept
+{
+    check("memalign");
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** pointer, size_t alignment, size_t size) noexcept
+{
+    check("posix_memalign");
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    void* memory = __libc_memalign(alignment, size);
+    if (memory == nullptr) {
+        return ENOMEM;
+    }
+    *pointer = memory;
+    return 0;
+}
+
+} // extern "C"
+
+namespace
+{
+
+void* allocate(const char* function, size_t size)
+{
+    check(function);
+    if (void* memory = __libc_malloc(size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* allocateAligned(const char* function, size_t size, std::align_val_t alignment)
+{
+    check(function);
+    if (void* memory = __libc_memalign(static_cast<size_t>(alignment), size == 0 ? 1 : size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void deallocate(const char* function, void* pointer)
+{
+    if (pointer != nullptr) {
+        check(function);
+    }
+    __libc_free(pointer);
+}
+
+} // namespace
+
+void* operator new(size_t size)
+{
+    return allocate("operator new", size);
+}
+
+void* operator new[](size_t size)
+{
+    return allocate("operator new[]", size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    return allocateAligned("operator new", size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return allocateAligned("operator new[]", size, alignment);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    check("operator new");
+    return __libc_malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    check("operator new[]");
+    return __libc_malloc(size == 0 ? 1 : size);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    deallocate("operator delete", pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    deallocate("operator delete[]", pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    deallocate("operator delete", pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept
+{
+    deallocate("operator delete[]", pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+    deallocate("operator delete", pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept
+{
+    deallocate("operator delete[]", pointer);
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept
+{
+    deallocate("operator delete", pointer);
+}
+
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept
+{
+    deallocate("operator delete[]", pointer);
+}
+
+// === Locks ===
+
+namespace
+{
+
+using MutexFunction = int (*)(pthread_mutex_t*);
+using CondFunction = int (*)(pthread_cond_t*);
+using CondWaitFunction = int (*)(pthread_cond_t*, pthread_mutex_t*);
+using CondTimedWaitFunction = int (*)(pthread_cond_t*, pthread_mutex_t*, const struct timespec*);
+
+std::atomic<MutexFunction> nextMutexLock {nullptr};
+std::atomic<MutexFunction> nextMutexTryLock {nullptr};
+std::atomic<MutexFunction> nextMutexUnlock {nullptr};
+std::atomic<CondFunction> nextCondSignal {nullptr};
+std::atomic<CondFunction> nextCondBroadcast {nullptr};
+std::atomic<CondWaitFunction> nextCondWait {nullptr};
+std::atomic<CondTimedWaitFunction> nextCondTimedWait {nullptr};
+
+} // namespace
+
+extern "C" {
+
+int pthread_mutex_lock(pthread_mutex_t* mutex) noexcept
+{
+    check("pthread_mutex_lock");
+    return findNext(nextMutexLock, "pthread_mutex_lock")(mutex);
+}
+
+int pthread_mutex_trylock(pthread_mutex_t* mutex) noexcept
+{
+    check("pthread_mutex_trylock");
+    return findNext(nextMutexTryLock, "pthread_mutex_trylock")(mutex);
+}
+
+// Not a violation by itself: every unlock follows a lock that was reported.
+int pthread_mutex_unlock(pthread_mutex_t* mutex) noexcept
+{
+    return findNext(nextMutexUnlock, "pthread_mutex_unlock")(mutex);
+}
+
+int pthread_cond_signal(pthread_cond_t* cond) noexcept
+{
+    check("pthread_cond_signal");
+    return findNext(nextCondSignal, "pthread_cond_signal")(cond);
+}
+
+int pthread_cond_broadcast(pthread_cond_t* cond) noexcept
+{
+    check("pthread_cond_broadcast");
+    return findNext(nextCondBroadcast, "pthread_cond_broadcast")(cond);
+}
+
+int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex)
+{
+    check("pthread_cond_wait");
+    return findNext(nextCondWait, "pthread_cond_wait")(cond, mutex);
+}
+
+int pthread_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex, const struct timespec* time)
+{
+    check("pthread_cond_timedwait");
+    return findNext(nextCondTimedWait, "pthread_cond_timedwait")(cond, mutex, time);
+}
+
+} // extern "C"
+
+#endif
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+namespace JX11::Tools::RtCheck
+{
+
+// Finds code that isn't real-time safe on the audio thread.
+//
+// A tool that links this in replaces malloc, free and the other allocation
+// functions, the global operator new and delete, and the pthread mutex and
+// condition variable functions with versions that check whether the calling
+// thread is inside an AudioThreadScope. If it is, the call is a violation: it
+// is reported on stderr with a stack trace, and then passed on to the real
+// function as usual. Each distinct stack is printed once, but all violations
+// are counted.
+//
+// Only works on Linux with glibc. Elsewhere the functions below do nothing and
+// isAvailable() returns false. The checks are off until setEnabled(true).
+
+bool isAvailable();
+
+void setEnabled(bool enabled);
+
+// Number of violations since the start of the process.
+uint64_t getViolationCount();
+
+// Prints the number of violations to stderr, if there were any.
+void printSummary();
+
+// Marks the current thread as the audio thread for the lifetime of the
+// object. Put one around every call that must be real-time safe, like
+// processBlock or Synth::render. Scopes can be nested.
+class AudioThreadScope
+{
+public:
+    AudioThreadScope();
+    ~AudioThreadScope();
+
+    AudioThreadScope(const AudioThreadScope&) = delete;
+    AudioThreadScope& operator=(const AudioThreadScope&) = delete;
+};
+
+} // namespace JX11::Tools::RtCheck
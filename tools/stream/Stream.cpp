@@ -0,0 +1,624 @@
+// jx11_stream: plays timestamped MIDI from stdin, or from a local socket, and
+// writes the audio to stdout as raw PCM, like a Unix filter.
+//
+// The input is a stream of 8-byte records:
+//
+//     bytes 0-3   frames since the previous record, unsigned, little-endian
+//     bytes 4-6   a MIDI message: status, data 1, data 2
+//     byte  7     unused, should be 0
+//
+// Messages shorter than three bytes are padded with zeros. A record with a
+// status byte of 0 is only a timestamp: it tells the synth that no MIDI comes
+// before that frame, so it can render up to there without waiting.
+//
+// The output is stereo, interleaved, in the same little-endian formats as the
+// WAV files of jx11_render, without a header. After the end of the input, it
+// goes on until all voices are silent, or --max-tail seconds at most.
+//
+// Three threads share the work, so that reading and writing never hold up the
+// synth. A reader thread parses the input into its own batch of events, which
+// the render loop takes over between blocks. The render loop renders a block
+// as soon as all of its MIDI has arrived: when a record at or after the end of
+// the block has been read, or at the end of the input. It encodes the block
+// into a ring of output buffers, two by default, which a writer thread writes
+// to stdout. The render loop only waits for the writer when all buffers are
+// full, and then the process that reads stdout sets the pace anyway.
+//
+// By default, the render loop waits as long as it takes for the MIDI, so the
+// output is exactly the same as rendering the whole stream at once. With
+// --latency, a block is rendered at most that long after it is due in real
+// time, counting from the start of the input, even if its MIDI hasn't all
+// arrived. MIDI that arrives after its block has been rendered is played at
+// the start of the next block, and counted as late. The audio then reaches
+// stdout at most --latency plus the output buffers after it is due.
+
+#include "common/Json.h"
+#include "common/MidiEvents.h"
+#include "common/Preset.h"
+#include "common/Timer.h"
+#include "common/WavWriter.h"
+#include "engine/Synth.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace JX11;
+using namespace JX11::Engine;
+using Tools::MidiEvent;
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+    double sampleRate = 48000.0;
+    int blockSize = 256;
+    Tools::SampleFormat format = Tools::SampleFormat::pcm16;
+
+    // Longest time to keep rendering after the end of the input.
+    double maxTail = 10.0;
+
+    // Longest time in seconds to wait for the MIDI of a block after it is
+    // due. No value = wait for the MIDI.
+    std::optional<double> latency;
+
+    // Output buffers of one block each between the synth and the writer.
+    int buffers = 2;
+
+    std::optional<uint32_t> seed;
+
+    std::string presetPath;
+    std::string socketPath;
+    std::string jsonPath;
+};
+
+// A MIDI message at a frame of the whole stream.
+struct StreamEvent
+{
+    uint64_t frame;
+    uint8_t data0;
+    uint8_t data1;
+    uint8_t data2;
+};
+
+// Reads the input on its own thread. The events are parsed into a batch that
+// only the reader touches, and handed over in one go, so the lock is never
+// held while reading.
+class MidiInput
+{
+public:
+    static constexpr size_t RECORD_SIZE = 8;
+
+    explicit MidiInput(int fd_) : fd(fd_), thread([this] { run(); }) {}
+
+    ~MidiInput() { thread.join(); }
+
+    MidiInput(const MidiInput&) = delete;
+    MidiInput& operator=(const MidiInput&) = delete;
+
+    // Waits until all the MIDI before `frame` has arrived, the input has
+    // ended, or the deadline has passed. Moves the events that have arrived
+    // to the back of `events`. Returns true once the input has ended and all
+    // of its events have been taken.
+    bool take(uint64_t frame, std::optional<Clock::time_point> deadline, std::deque<StreamEvent>& events)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        const auto isReady = [&] { return knownFrame >= frame || ended; };
+        if (deadline) {
+            arrived.wait_until(lock, *deadline, isReady);
+        } else {
+            arrived.wait(lock, isReady);
+        }
+        events.insert(events.end(), incoming.begin(), incoming.end());
+        incoming.clear();
+        return ended;
+    }
+
+    uint64_t getRecordCount() const { return records; }
+
+private:
+    void run()
+    {
+        std::vector<uint8_t> buffer(64 * RECORD_SIZE);
+        std::vector<StreamEvent> batch;
+        size_t used = 0;
+        uint64_t frame = 0;
+
+        while (true) {
+            const auto count = readSome(buffer.data() + used, buffer.size() - used);
+            if (count <= 0) {
+                break;
+            }
+            used += size_t(count);
+
+            size_t position = 0;
+            for (; position + RECORD_SIZE <= used; position += RECORD_SIZE) {
+                const uint8_t* record = buffer.data() + position;
+                frame += uint64_t(record[0]) | uint64_t(record[1]) << 8 | uint64_t(record[2]) << 16 |
+                         uint64_t(record[3]) << 24;
+                if (record[4] != 0) {
+                    batch.push_back({frame, record[4], record[5], record[6]});
+                }
+                ++records;
+            }
+            std::memmove(buffer.data(), buffer.data() + position, used - position);
+            used -= position;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                incoming.insert(incoming.end(), batch.begin(), batch.end());
+                knownFrame = frame;
+            }
+            arrived.notify_one();
+            batch.clear();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ended = true;
+        }
+        arrived.notify_one();
+    }
+
+    long readSome(uint8_t* data, size_t size)
+    {
+#ifdef _WIN32
+        return _read(fd, data, unsigned(size));
+#else
+        while (true) {
+            const auto count = ::read(fd, data, size);
+            if (count >= 0 || errno != EINTR) {
+                return long(count);
+            }
+        }
+#endif
+    }
+
+    int fd;
+
+    std::mutex mutex;
+    std::condition_variable arrived;
+    std::vector<StreamEvent> incoming;
+    uint64_t knownFrame = 0; // all MIDI before this frame has been read
+    bool ended = false;
+
+    // Only used by the reader, and read after it has ended.
+    uint64_t records = 0;
+
+    std::thread thread;
+};
+
+// A ring of output buffers of one block each. The render loop fills them in
+// turn, and a writer thread writes them to stdout.
+class PcmOutput
+{
+public:
+    PcmOutput(size_t bufferCount, size_t bufferSize_) :
+        buffers(bufferCount, std::vector<uint8_t>(bufferSize_)), thread([this] { run(); })
+    {
+    }
+
+    ~PcmOutput() { finish(); }
+
+    PcmOutput(const PcmOutput&) = delete;
+    PcmOutput& operator=(const PcmOutput&) = delete;
+
+    // The next buffer to fill. Waits if the writer hasn't written it yet.
+    uint8_t* acquire()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (filled == buffers.size()) {
+            Tools::Timer timer;
+            notFull.wait(lock, [this] { return filled < buffers.size() || failed; });
+            waitSeconds += timer.elapsedNanoseconds() * 1e-9;
+        }
+        return buffers[(first + filled) % buffers.size()].data();
+    }
+
+    // Hands the buffer from acquire to the writer.
+    void publish()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++filled;
+        }
+        notEmpty.notify_one();
+    }
+
+    // Writes what is left and stops the thread.
+    void finish()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (finishing) {
+                return;
+            }
+            finishing = true;
+        }
+        notEmpty.notify_one();
+        thread.join();
+    }
+
+    bool hasFailed()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return failed;
+    }
+
+    // Time that the render loop spent waiting for a free buffer.
+    double getWaitSeconds() const { return waitSeconds; }
+
+private:
+    void run()
+    {
+        while (true) {
+            const std::vector<uint8_t>* buffer;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                notEmpty.wait(lock, [this] { return filled > 0 || finishing; });
+                if (filled == 0) {
+                    return;
+                }
+                buffer = &buffers[first];
+            }
+
+            bool ok = std::fwrite(buffer->data(), 1, buffer->size(), stdout) == buffer->size();
+            ok = (std::fflush(stdout) == 0) && ok;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                first = (first + 1) % buffers.size();
+                --filled;
+                if (!ok) {
+                    // Nothing more can be written. Drop the rest, so that the
+                    // render loop doesn't wait forever.
+                    failed = true;
+                    first = 0;
+                    filled = 0;
+                }
+            }
+            notFull.notify_one();
+        }
+    }
+
+    std::vector<std::vector<uint8_t>> buffers;
+
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    size_t first = 0;  // the oldest buffer that hasn't been written
+    size_t filled = 0; // buffers waiting for the writer
+    bool finishing = false;
+    bool failed = false;
+
+    double waitSeconds = 0.0;
+
+    std::thread thread;
+};
+
+// The synth, with the parameters that MIDI can change.
+struct StreamSynth
+{
+    Synth synth;
+    Parameters params;
+    bool parametersChanged = false;
+
+    void render(float** outputBuffers, int sampleCount) { synth.render(outputBuffers, sampleCount); }
+
+    void midiMessage(uint8_t data0, uint8_t data1, uint8_t data2)
+    {
+        // Same as JX11AudioProcessor::handleMIDI.
+        if ((data0 & 0xF0) == 0xB0 && data1 == 0x07) {
+            const auto* info = findParameterInfo("outputLevel");
+            info->set(params, info->fromNormalized(float(data2) / 127.0f));
+            parametersChanged = true;
+        }
+        synth.midiMessage(data0, data1, data2);
+    }
+};
+
+struct Stats
+{
+    uint64_t frames = 0;
+    uint64_t midiEvents = 0;
+    uint64_t lateEvents = 0;
+    double renderSeconds = 0.0;
+    double midiWaitSeconds = 0.0;
+    double outputWaitSeconds = 0.0;
+};
+
+// Renders blocks until the input has ended and the voices are silent.
+Stats play(const Options& options, StreamSynth& stream, MidiInput& input, PcmOutput& output)
+{
+    const auto blockSize = size_t(options.blockSize);
+    std::vector<float> left(blockSize);
+    std::vector<float> right(blockSize);
+    float* outputBuffers[2] = {left.data(), right.data()};
+    std::vector<MidiEvent> events;
+    events.reserve(256);
+    std::deque<StreamEvent> pending;
+
+    const auto tailFrames = uint64_t(options.maxTail * options.sampleRate);
+    uint64_t framesAfterEnd = 0;
+    const auto start = Clock::now();
+    Stats stats;
+
+    while (!output.hasFailed()) {
+        const uint64_t frame = stats.frames;
+        const uint64_t blockEnd = frame + blockSize;
+
+        std::optional<Clock::time_point> deadline;
+        if (options.latency) {
+            const double due = double(blockEnd) / options.sampleRate + *options.latency;
+            deadline = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(due));
+        }
+        Tools::Timer waitTimer;
+        const bool ended = input.take(blockEnd, deadline, pending);
+        stats.midiWaitSeconds += waitTimer.elapsedNanoseconds() * 1e-9;
+
+        Tools::Timer renderTimer;
+        events.clear();
+        while (!pending.empty() && pending.front().frame < blockEnd) {
+            const auto& e = pending.front();
+            if (e.frame < frame) {
+                ++stats.lateEvents;
+            }
+            events.push_back({int(e.frame > frame ? e.frame - frame : 0), e.data0, e.data1, e.data2});
+            pending.pop_front();
+        }
+        stats.midiEvents += events.size();
+
+        if (stream.parametersChanged) {
+            stream.parametersChanged = false;
+            stream.synth.applyParameters(stream.params);
+        }
+        Tools::renderWithEvents(stream, outputBuffers, options.blockSize, events);
+        stats.renderSeconds += renderTimer.elapsedNanoseconds() * 1e-9;
+
+        uint8_t* out = output.acquire();
+        for (size_t i = 0; i < blockSize; ++i) {
+            out = Tools::writeSample(out, left[i], options.format);
+            out = Tools::writeSample(out, right[i], options.format);
+        }
+        output.publish();
+        stats.frames = blockEnd;
+
+        if (ended && pending.empty()) {
+            framesAfterEnd += blockSize;
+            if (stream.synth.getActiveVoiceCount() == 0 || framesAfterEnd >= tailFrames) {
+                break;
+            }
+        }
+    }
+    output.finish();
+    stats.outputWaitSeconds = output.getWaitSeconds();
+    return stats;
+}
+
+#ifndef _WIN32
+// Listens on a Unix domain socket and waits for one client. Returns the
+// connection, or -1.
+int acceptConnection(const std::string& path)
+{
+    sockaddr_un address {};
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::fprintf(stderr, "%s: socket path too long\n", path.c_str());
+        return -1;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        std::perror("socket");
+        return -1;
+    }
+    unlink(path.c_str());
+    if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listener, 1) != 0) {
+        std::perror(path.c_str());
+        close(listener);
+        return -1;
+    }
+    std::fprintf(stderr, "jx11_stream: waiting for a connection on %s\n", path.c_str());
+    int connection = accept(listener, nullptr, nullptr);
+    if (connection < 0) {
+        std::perror("accept");
+    }
+    close(listener);
+    unlink(path.c_str());
+    return connection;
+}
+#endif
+
+void printUsage()
+{
+    std::fputs("usage: jx11_stream [options] <preset>  < midi records  > pcm\n"
+               "  --sample-rate <hz>   sample rate (default 48000)\n"
+               "  --block-size <n>     samples per block (default 256)\n"
+               "  --format <format>    16, 24 or float (default 16)\n"
+               "  --latency <ms>       render a block at most this late if its MIDI hasn't all\n"
+               "                       arrived (default: wait for the MIDI)\n"
+               "  --buffers <n>        output buffers of one block (default 2)\n"
+               "  --max-tail <s>       max seconds to render after the end of the input (default 10)\n"
+               "  --seed <n>           deterministic mode with this seed, see Synth::setSeed\n"
+               "  --socket <path>      read the MIDI from a client of this Unix socket instead of stdin\n"
+               "  --json <file>        also write the stats as JSON\n",
+               stderr);
+}
+
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--sample-rate" && hasValue) {
+            options.sampleRate = std::atof(argv[++i]);
+        } else if (arg == "--block-size" && hasValue) {
+            options.blockSize = std::atoi(argv[++i]);
+        } else if (arg == "--format" && hasValue) {
+            std::string format = argv[++i];
+            if (format == "16") {
+                options.format = Tools::SampleFormat::pcm16;
+            } else if (format == "24") {
+                options.format = Tools::SampleFormat::pcm24;
+            } else if (format == "float") {
+                options.format = Tools::SampleFormat::float32;
+            } else {
+                return false;
+            }
+        } else if (arg == "--latency" && hasValue) {
+            options.latency = std::atof(argv[++i]) * 0.001;
+        } else if (arg == "--buffers" && hasValue) {
+            options.buffers = std::atoi(argv[++i]);
+        } else if (arg == "--max-tail" && hasValue) {
+            options.maxTail = std::atof(argv[++i]);
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = uint32_t(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--socket" && hasValue) {
+            options.socketPath = argv[++i];
+        } else if (arg == "--json" && hasValue) {
+            options.jsonPath = argv[++i];
+        } else if (!arg.empty() && arg[0] != '-' && options.presetPath.empty()) {
+            options.presetPath = arg;
+        } else {
+            return false;
+        }
+    }
+    return !options.presetPath.empty() && options.sampleRate > 0.0 && options.blockSize > 0 &&
+           options.maxTail >= 0.0 && options.buffers > 0 && options.latency.value_or(0.0) >= 0.0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 1;
+    }
+
+    std::string error;
+    StreamSynth stream;
+    if (!Tools::loadPreset(options.presetPath, stream.params, error)) {
+        std::fprintf(stderr, "%s: %s\n", options.presetPath.c_str(), error.c_str());
+        return 1;
+    }
+
+    // Like JX11AudioProcessor::prepareToPlay and the first processBlock.
+    Synth& synth = stream.synth;
+    synth.allocateResources(options.sampleRate, options.blockSize);
+    synth.setSeed(options.seed);
+    synth.reset();
+    synth.outputLevelSmoother.setCurrentAndTargetValue(std::pow(10.0f, stream.params.outputLevel * 0.05f));
+    synth.applyParameters(stream.params);
+
+#ifdef _WIN32
+    if (!options.socketPath.empty()) {
+        std::fputs("--socket needs Unix domain sockets\n", stderr);
+        return 1;
+    }
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+    int fd = _fileno(stdin);
+#else
+    int fd = STDIN_FILENO;
+    if (!options.socketPath.empty()) {
+        fd = acceptConnection(options.socketPath);
+        if (fd < 0) {
+            return 1;
+        }
+    }
+#endif
+
+    Tools::Timer wallClock;
+    Stats stats;
+    uint64_t records = 0;
+    bool failed = false;
+    {
+        const auto bufferSize = size_t(options.blockSize) * 2 * size_t(Tools::getBytesPerSample(options.format));
+        PcmOutput output(size_t(options.buffers), bufferSize);
+        MidiInput input(fd);
+        stats = play(options, stream, input, output);
+        failed = output.hasFailed();
+
+        // The input must have ended for the reader thread to stop. It has,
+        // unless writing failed.
+        if (failed) {
+            std::fputs("jx11_stream: cannot write the output\n", stderr);
+            std::fflush(stderr);
+            std::_Exit(1);
+        }
+        records = input.getRecordCount();
+    }
+    const double wallSeconds = wallClock.elapsedNanoseconds() * 1e-9;
+#ifndef _WIN32
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+#endif
+
+    // stdout has the audio, so the stats go to stderr.
+    const double audioSeconds = double(stats.frames) / options.sampleRate;
+    std::fprintf(stderr, "jx11_stream: %llu MIDI events (%llu late), %.2f s of audio, %s kernels\n",
+                 (unsigned long long)stats.midiEvents, (unsigned long long)stats.lateEvents, audioSeconds,
+                 getKernelName(selectKernels().level));
+    std::fprintf(stderr, "  render time  %10.3f s  (%.1fx real time)\n", stats.renderSeconds,
+                 audioSeconds / stats.renderSeconds);
+    std::fprintf(stderr, "  wall clock   %10.3f s  (%.1fx real time)\n", wallSeconds, audioSeconds / wallSeconds);
+    std::fprintf(stderr, "  waiting for MIDI %6.3f s, for the output %.3f s\n", stats.midiWaitSeconds,
+                 stats.outputWaitSeconds);
+
+    if (!options.jsonPath.empty()) {
+        FILE* file = std::fopen(options.jsonPath.c_str(), "w");
+        if (file == nullptr) {
+            std::fprintf(stderr, "cannot write %s\n", options.jsonPath.c_str());
+            return 1;
+        }
+        Tools::JsonWriter json(file);
+        json.beginObject();
+        json.member("tool", "jx11_stream");
+        json.member("version", JX11_VERSION);
+        json.member("kernel", getKernelName(selectKernels().level));
+        json.member("sample_rate", options.sampleRate);
+        json.member("block_size", options.blockSize);
+        json.member("buffers", options.buffers);
+        json.member("latency_ms", options.latency ? *options.latency * 1000.0 : -1.0);
+        json.member("records", static_cast<long long>(records));
+        json.member("midi_events", static_cast<long long>(stats.midiEvents));
+        json.member("late_events", static_cast<long long>(stats.lateEvents));
+        json.member("frames", static_cast<long long>(stats.frames));
+        json.member("audio_seconds", audioSeconds);
+        json.member("render_seconds", stats.renderSeconds);
+        json.member("wall_seconds", wallSeconds);
+        json.member("midi_wait_seconds", stats.midiWaitSeconds);
+        json.member("output_wait_seconds", stats.outputWaitSeconds);
+        json.endObject();
+        json.finish();
+        std::fclose(file);
+    }
+    return 0;
+}
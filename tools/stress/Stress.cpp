@@ -0,0 +1,458 @@
+// jx11_stress: measures the worst-case render time per block.
+//
+// Dropouts happen when a single block takes too long, so the average speed
+// from jx11_bench doesn't tell the whole story. This harness plays MIDI and
+// parameter automation that make some blocks much more expensive than others:
+//
+//   chord_retrigger   all 8 voices restart at once, which runs exp/pow/sin
+//                     in startVoice for every voice
+//   sustain_release   the sustain pedal is let go with 8 sustained voices
+//   all_notes_off     a full chord is cut off by an all-notes-off message
+//   cc_flood          controller messages every few samples, which splits
+//                     the block into many tiny render calls
+//   param_automation  all parameters change on every block, so the synth
+//                     recalculates its values each time
+//   mixed             a random mix of all of the above
+//
+// The blocks are rendered like the plugin does: parameters are applied at the
+// start of the block and the audio is split at the MIDI events. It reports the
+// p50 / p99 / p99.9 / max render time per block and fails when a block takes
+// longer than the deadline, a fraction of the time the block lasts.
+//
+// It also fails when the synth allocates memory or takes a lock while it
+// renders a block, see rtcheck/RtCheck.h.
+
+#include "common/Json.h"
+#include "common/MidiEvents.h"
+#include "common/Timer.h"
+#include "engine/Synth.h"
+#include "rtcheck/RtCheck.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace JX11;
+using namespace JX11::Engine;
+using Tools::MidiEvent;
+
+namespace
+{
+
+struct Options
+{
+    double sampleRate = 48000.0;
+    int blockSize = 256;
+    int blocks = 20000;
+
+    // Fraction of the block period that rendering a block may take.
+    double deadline = 0.5;
+
+    // Fraction of blocks that may miss the deadline before the run fails.
+    double tolerance = 0.0;
+
+    // Only run the scenario with this name.
+    std::string scenario;
+
+    // Report allocations and locks inside the timed part of a block.
+    bool rtCheck = true;
+
+    std::string jsonPath;
+};
+
+// What happens in one block: MIDI events and, optionally, new parameters.
+struct Block
+{
+    std::vector<MidiEvent> events;
+    bool parametersChanged = false;
+};
+
+// Generates the contents of a block.
+class Scenario
+{
+public:
+    explicit Scenario(int blockSize_) : blockSize(blockSize_) {}
+    virtual ~Scenario() = default;
+
+    virtual const char* name() const = 0;
+    virtual void generate(int index, Block& block, Parameters& params) = 0;
+
+protected:
+    void playChord(Block& block, int offset, uint8_t root)
+    {
+        for (uint8_t i = 0; i < Synth::MAX_VOICES; ++i) {
+            block.events.push_back({offset, 0x90, uint8_t(root + 4 * i), 100});
+        }
+    }
+
+    void releaseChord(Block& block, int offset, uint8_t root)
+    {
+        for (uint8_t i = 0; i < Synth::MAX_VOICES; ++i) {
+            block.events.push_back({offset, 0x80, uint8_t(root + 4 * i), 0});
+        }
+    }
+
+    int blockSize;
+    std::mt19937 random {1234};
+};
+
+class ChordRetrigger : public Scenario
+{
+public:
+    using Scenario::Scenario;
+    const char* name() const override { return "chord_retrigger"; }
+
+    void generate(int index, Block& block, Parameters&) override
+    {
+        // A new chord every 4 blocks, while the previous one still plays.
+        if (index % 4 == 0) {
+            releaseChord(block, 0, root);
+            root = uint8_t(36 + random() % 12);
+            playChord(block, 0, root);
+        }
+    }
+
+private:
+    uint8_t root = 36;
+};
+
+class SustainRelease : public Scenario
+{
+public:
+    using Scenario::Scenario;
+    const char* name() const override { return "sustain_release"; }
+
+    void generate(int index, Block& block, Parameters&) override
+    {
+        switch (index % 16) {
+        case 0:
+            block.events.push_back({0, 0xB0, 0x40, 127});
+            playChord(block, 0, 48);
+            break;
+        case 2:
+            releaseChord(block, 0, 48);
+            break;
+        case 8:
+            // Every voice goes into its release stage at once.
+            block.events.push_back({0, 0xB0, 0x40, 0});
+            break;
+        }
+    }
+};
+
+class AllNotesOff : public Scenario
+{
+public:
+    using Scenario::Scenario;
+    const char* name() const override { return "all_notes_off"; }
+
+    void generate(int index, Block& block, Parameters&) override
+    {
+        switch (index % 8) {
+        case 0:
+            playChord(block, 0, 48);
+            break;
+        case 4:
+            block.events.push_back({blockSize / 2, 0xB0, 0x7B, 0});
+            break;
+        }
+    }
+};
+
+class ControllerFlood : public Scenario
+{
+public:
+    using Scenario::Scenario;
+    const char* name() const override { return "cc_flood"; }
+
+    void generate(int index, Block& block, Parameters&) override
+    {
+        if (index == 0) {
+            playChord(block, 0, 48);
+        }
+
+        // A controller message every 4 samples: mod wheel, filter,
+        // resonance, pitch bend and aftertouch.
+        for (int offset = 0; offset < blockSize; offset += 4) {
+            auto value = uint8_t(random() % 128);
+            switch ((offset / 4) % 5) {
+            case 0:
+                block.events.push_back({offset, 0xB0, 0x01, value});
+                break;
+            case 1:
+                block.events.push_back({offset, 0xB0, 0x4A, value});
+                break;
+            case 2:
+                block.events.push_back({offset, 0xB0, 0x47, value});
+                break;
+            case 3:
+                block.events.push_back({offset, 0xE0, uint8_t(random() % 128), value});
+                break;
+            case 4:
+                block.events.push_back({offset, 0xD0, value, 0});
+                break;
+            }
+        }
+    }
+};
+
+class ParameterAutomation : public Scenario
+{
+public:
+    using Scenario::Scenario;
+    const char* name() const override { return "param_automation"; }
+
+    void generate(int index, Block& block, Parameters& params) override
+    {
+        if (index % 64 == 0) {
+            releaseChord(block, 0, 48);
+            playChord(block, 0, 48);
+        }
+
+        // Sweep the parameters that drive the most calculations.
+        float phase = float(index % 100) / 100.0f;
+        params.oscTune = -24.0f + 48.0f * phase;
+        params.oscFine = -50.0f + 100.0f * phase;
+        params.filterFreq = 100.0f * phase;
+        params.filterReso = 100.0f * (1.0f - phase);
+        params.envAttack = 50.0f * phase;
+        params.envRelease = 100.0f * phase;
+        params.filterAttack = 100.0f * phase;
+        params.lfoRate = phase;
+        params.vibrato = -100.0f + 200.0f * phase;
+        params.glideRate = 100.0f * phase;
+        params.outputLevel = -24.0f + 30.0f * phase;
+        block.parametersChanged = true;
+    }
+};
+
+class Mixed : public Scenario
+{
+public:
+    explicit Mixed(int blockSize_)
+        : Scenario(blockSize_), retrigger(blockSize_), sustain(blockSize_), allNotesOff(blockSize_),
+          flood(blockSize_), automation(blockSize_)
+    {
+    }
+
+    const char* name() const override { return "mixed"; }
+
+    void generate(int /*index*/, Block& block, Parameters& params) override
+    {
+        Scenario* scenarios[] = {&retrigger, &sustain, &allNotesOff, &flood, &automation};
+        for (auto* scenario : scenarios) {
+            if (random() % 4 == 0) {
+                scenario->generate(int(random() % 64), block, params);
+            }
+        }
+        std::stable_sort(block.events.begin(), block.events.end(),
+                         [](const MidiEvent& a, const MidiEvent& b) { return a.offset < b.offset; });
+    }
+
+private:
+    ChordRetrigger retrigger;
+    SustainRelease sustain;
+    AllNotesOff allNotesOff;
+    ControllerFlood flood;
+    ParameterAutomation automation;
+};
+
+struct Report
+{
+    std::string name;
+    double p50 = 0.0;
+    double p99 = 0.0;
+    double p999 = 0.0;
+    double max = 0.0;
+    int overruns = 0;
+    bool passed = true;
+};
+
+Report runScenario(Scenario& scenario, const Options& options, double deadlineNanoseconds)
+{
+    Synth synth;
+    synth.allocateResources(options.sampleRate, options.blockSize);
+    Parameters params;
+    synth.applyParameters(params);
+    synth.reset();
+
+    std::vector<float> left(size_t(options.blockSize));
+    std::vector<float> right(size_t(options.blockSize));
+    float* outputBuffers[2] = {left.data(), right.data()};
+
+    std::vector<double> times;
+    times.reserve(size_t(options.blocks));
+
+    // The events are generated up front, so that only the rendering is timed.
+    Block block;
+    block.events.reserve(1024);
+
+    for (int i = 0; i < options.blocks; ++i) {
+        block.events.clear();
+        block.parametersChanged = false;
+        scenario.generate(i, block, params);
+
+        Tools::Timer timer;
+        {
+            Tools::RtCheck::AudioThreadScope audioThread;
+            if (block.parametersChanged) {
+                synth.applyParameters(params);
+            }
+            Tools::renderWithEvents(synth, outputBuffers, options.blockSize, block.events);
+        }
+        times.push_back(timer.elapsedNanoseconds());
+        Tools::doNotOptimize(left[0]);
+    }
+
+    Report report;
+    report.name = scenario.name();
+    for (double time : times) {
+        if (time > deadlineNanoseconds) {
+            report.overruns += 1;
+        }
+    }
+    report.p50 = Tools::percentile(times, 0.5);
+    report.p99 = Tools::percentile(times, 0.99);
+    report.p999 = Tools::percentile(times, 0.999);
+    report.max = times.back();
+    report.passed = double(report.overruns) <= options.tolerance * double(options.blocks);
+    return report;
+}
+
+void printUsage()
+{
+    std::fputs("usage: jx11_stress [options]\n"
+               "  --sample-rate <hz>     sample rate (default 48000)\n"
+               "  --block-size <n>       samples per block (default 256)\n"
+               "  --blocks <n>           blocks per scenario (default 20000)\n"
+               "  --deadline <fraction>  max render time as a fraction of the block period (default 0.5)\n"
+               "  --tolerance <fraction> fraction of blocks that may miss the deadline (default 0)\n"
+               "  --scenario <name>      only run this scenario\n"
+               "  --no-rt-check          don't check for allocations and locks while rendering\n"
+               "  --json <file>          also write the results as JSON\n",
+               stderr);
+}
+
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--sample-rate" && hasValue) {
+            options.sampleRate = std::atof(argv[++i]);
+        } else if (arg == "--block-size" && hasValue) {
+            options.blockSize = std::atoi(argv[++i]);
+        } else if (arg == "--blocks" && hasValue) {
+            options.blocks = std::atoi(argv[++i]);
+        } else if (arg == "--deadline" && hasValue) {
+            options.deadline = std::atof(argv[++i]);
+        } else if (arg == "--tolerance" && hasValue) {
+            options.tolerance = std::atof(argv[++i]);
+        } else if (arg == "--scenario" && hasValue) {
+            options.scenario = argv[++i];
+        } else if (arg == "--no-rt-check") {
+            options.rtCheck = false;
+        } else if (arg == "--json" && hasValue) {
+            options.jsonPath = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return options.sampleRate > 0.0 && options.blockSize > 0 && options.blocks > 0 && options.deadline > 0.0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 1;
+    }
+
+    Tools::RtCheck::setEnabled(options.rtCheck);
+
+    const double blockPeriod = 1e9 * options.blockSize / options.sampleRate;
+    const double deadline = options.deadline * blockPeriod;
+
+    std::printf("jx11_stress: %d-sample blocks at %g Hz, deadline %.1f us (%.0f%% of %.1f us), %s kernels\n",
+                options.blockSize, options.sampleRate, deadline / 1000.0, options.deadline * 100.0,
+                blockPeriod / 1000.0, getKernelName(selectKernels().level));
+    std::printf("  %-18s %10s %10s %10s %10s %9s\n", "scenario", "p50 us", "p99 us", "p99.9 us", "max us", "overruns");
+
+    std::vector<std::unique_ptr<Scenario>> scenarios;
+    scenarios.push_back(std::make_unique<ChordRetrigger>(options.blockSize));
+    scenarios.push_back(std::make_unique<SustainRelease>(options.blockSize));
+    scenarios.push_back(std::make_unique<AllNotesOff>(options.blockSize));
+    scenarios.push_back(std::make_unique<ControllerFlood>(options.blockSize));
+    scenarios.push_back(std::make_unique<ParameterAutomation>(options.blockSize));
+    scenarios.push_back(std::make_unique<Mixed>(options.blockSize));
+
+    std::vector<Report> reports;
+    for (auto& scenario : scenarios) {
+        if (!options.scenario.empty() && options.scenario != scenario->name()) {
+            continue;
+        }
+        Report report = runScenario(*scenario, options, deadline);
+        std::printf("  %-18s %10.2f %10.2f %10.2f %10.2f %9d %s\n", report.name.c_str(), report.p50 / 1000.0,
+                    report.p99 / 1000.0, report.p999 / 1000.0, report.max / 1000.0, report.overruns,
+                    report.passed ? "" : "FAILED");
+        reports.push_back(report);
+    }
+
+    if (reports.empty()) {
+        std::fprintf(stderr, "unknown scenario: %s\n", options.scenario.c_str());
+        return 1;
+    }
+
+    if (!options.jsonPath.empty()) {
+        FILE* file = std::fopen(options.jsonPath.c_str(), "w");
+        if (file == nullptr) {
+            std::fprintf(stderr, "cannot write %s\n", options.jsonPath.c_str());
+            return 1;
+        }
+        Tools::JsonWriter json(file);
+        json.beginObject();
+        json.member("benchmark", "jx11_stress");
+        json.member("version", JX11_VERSION);
+        json.member("kernel", getKernelName(selectKernels().level));
+        json.member("sample_rate", options.sampleRate);
+        json.member("block_size", options.blockSize);
+        json.member("blocks", options.blocks);
+        json.member("deadline_ns", deadline);
+        json.member("rt_violations", static_cast<long long>(Tools::RtCheck::getViolationCount()));
+        json.key("scenarios");
+        json.beginArray();
+        for (const auto& report : reports) {
+            json.beginObject();
+            json.member("name", report.name);
+            json.member("p50_ns", report.p50);
+            json.member("p99_ns", report.p99);
+            json.member("p999_ns", report.p999);
+            json.member("max_ns", report.max);
+            json.member("max_deadline_fraction", report.max / blockPeriod);
+            json.member("overruns", report.overruns);
+            json.member("passed", report.passed);
+            json.endObject();
+        }
+        json.endArray();
+        json.endObject();
+        json.finish();
+        std::fclose(file);
+    }
+
+    Tools::RtCheck::printSummary();
+    if (Tools::RtCheck::getViolationCount() > 0) {
+        return 1;
+    }
+    for (const auto& report : reports) {
+        if (!report.passed) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,257 @@
+// jx11_telemetry: shows the runtime telemetry of the running plugin instances.
+//
+// Every process that has the plugin loaded exports per-instance stats to a
+// POSIX shared-memory segment, see src/processor/Telemetry.h. This tool is an
+// example of a sidecar that reads them: it finds the segments in /dev/shm, or
+// opens the one for --pid, and prints a line per instance with the DSP load,
+// the worst block, voices, stolen voices, MIDI events, the peak level and the
+// quality level of the CPU governor.
+
+#include "common/Json.h"
+#include "processor/TelemetrySegment.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace JX11;
+using Processor::TelemetrySegment;
+using Processor::TelemetrySlot;
+
+namespace
+{
+
+struct Options
+{
+    long pid = 0; // 0 = all processes
+    bool watch = false;
+    std::string jsonPath;
+};
+
+// A copy of one slot, taken under its sequence lock.
+struct Instance
+{
+    long pid;
+    TelemetrySlot slot;
+};
+
+// The segment names for all processes that export telemetry. POSIX has no way
+// to list shared-memory objects, but on Linux they are files in /dev/shm.
+std::vector<std::string> findSegments()
+{
+    std::vector<std::string> names;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator("/dev/shm", error)) {
+        std::string name = entry.path().filename().string();
+        if (name.rfind("jx11-telemetry-", 0) == 0) {
+            names.push_back("/" + name);
+        }
+    }
+    return names;
+}
+
+bool readSlot(const TelemetrySlot& shared, TelemetrySlot& copy)
+{
+    // The segment is mapped read-only, but atomic_ref needs a non-const
+    // reference. Loads don't write to it.
+    std::atomic_ref<uint32_t> sequence(const_cast<uint32_t&>(shared.sequence));
+
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        uint32_t before = sequence.load(std::memory_order_acquire);
+        if ((before & 1) != 0) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // The writer may change the fields while they are copied. That's
+        // detected by the sequence number below, and the copy is thrown away.
+        std::memcpy(&copy, &shared, sizeof(TelemetrySlot));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == before) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Adds the instances from one segment. Returns false if it can't be read.
+bool readSegment(const std::string& name, std::vector<Instance>& instances)
+{
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info {};
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(TelemetrySegment)) {
+        close(fd);
+        return false;
+    }
+
+    void* memory = mmap(nullptr, sizeof(TelemetrySegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+
+    const auto* segment = static_cast<const TelemetrySegment*>(memory);
+    bool valid = segment->magic == TelemetrySegment::MAGIC && segment->version == TelemetrySegment::VERSION;
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (valid) {
+        uint32_t slotCount = std::min(segment->slotCount, TelemetrySegment::MAX_INSTANCES);
+        for (uint32_t i = 0; i < slotCount; ++i) {
+            Instance instance {static_cast<long>(segment->processId), {}};
+            if (readSlot(segment->slots[i], instance.slot) && instance.slot.instanceId != 0) {
+                instances.push_back(instance);
+            }
+        }
+    }
+
+    munmap(memory, sizeof(TelemetrySegment));
+    return valid;
+}
+
+void printTable(const std::vector<Instance>& instances)
+{
+    std::printf("%8s %8s %7s %9s %7s %7s %8s %8s %5s %8s\n", "pid", "instance", "load %", "max us", "voices",
+                "stolen", "events", "peak dB", "level", "dropped");
+    for (const auto& instance : instances) {
+        const TelemetrySlot& slot = instance.slot;
+        double peak = slot.peakLevel > 0.0f ? 20.0 * std::log10(slot.peakLevel) : -100.0;
+        std::printf("%8ld %8u %7.2f %9.1f %3u/%-3u %7llu %8llu %8.1f %2u/%-2u %8llu\n", instance.pid,
+                    slot.instanceId, 100.0 * slot.load, slot.maxRenderNanoseconds / 1000.0, slot.activeVoices,
+                    slot.maxActiveVoices, static_cast<unsigned long long>(slot.stolenVoices),
+                    static_cast<unsigned long long>(slot.events), peak, slot.qualityLevel, slot.maxQualityLevel,
+                    static_cast<unsigned long long>(slot.droppedBlocks));
+    }
+    if (instances.empty()) {
+        std::printf("no running instances\n");
+    }
+}
+
+void writeJson(FILE* file, const std::vector<Instance>& instances)
+{
+    Tools::JsonWriter json(file);
+    json.beginObject();
+    json.member("tool", "jx11_telemetry");
+    json.member("version", JX11_VERSION);
+    json.key("instances");
+    json.beginArray();
+    for (const auto& instance : instances) {
+        const TelemetrySlot& slot = instance.slot;
+        json.beginObject();
+        json.member("pid", static_cast<long long>(instance.pid));
+        json.member("instance", static_cast<long long>(slot.instanceId));
+        json.member("update_time_ns", static_cast<long long>(slot.updateTime));
+        json.member("sample_rate", slot.sampleRate);
+        json.member("blocks", static_cast<long long>(slot.blocks));
+        json.member("samples", static_cast<long long>(slot.samples));
+        json.member("render_ns", static_cast<long long>(slot.renderNanoseconds));
+        json.member("stolen_voices", static_cast<long long>(slot.stolenVoices));
+        json.member("events", static_cast<long long>(slot.events));
+        json.member("dropped_blocks", static_cast<long long>(slot.droppedBlocks));
+        json.member("interval_blocks", static_cast<long long>(slot.intervalBlocks));
+        json.member("max_render_ns", static_cast<long long>(slot.maxRenderNanoseconds));
+        json.member("load", slot.load);
+        json.member("peak_level", slot.peakLevel);
+        json.member("active_voices", static_cast<long long>(slot.activeVoices));
+        json.member("max_active_voices", static_cast<long long>(slot.maxActiveVoices));
+        json.member("quality_level", static_cast<long long>(slot.qualityLevel));
+        json.member("max_quality_level", static_cast<long long>(slot.maxQualityLevel));
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+    json.finish();
+}
+
+void printUsage()
+{
+    std::fputs("usage: jx11_telemetry [options]\n"
+               "  --pid <pid>        only show the instances in this process\n"
+               "  --watch            refresh every second until interrupted\n"
+               "  --json <path>      write the stats as JSON, - for stdout\n",
+               stderr);
+}
+
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--pid" && hasValue) {
+            options.pid = std::atol(argv[++i]);
+        } else if (arg == "--watch") {
+            options.watch = true;
+        } else if (arg == "--json" && hasValue) {
+            options.jsonPath = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 1;
+    }
+
+    while (true) {
+        std::vector<std::string> names;
+        if (options.pid != 0) {
+            char name[Processor::TELEMETRY_NAME_SIZE];
+            Processor::getTelemetrySegmentName(name, options.pid);
+            names.push_back(name);
+        } else {
+            names = findSegments();
+        }
+
+        std::vector<Instance> instances;
+        for (const auto& name : names) {
+            if (!readSegment(name, instances) && options.pid != 0) {
+                std::fprintf(stderr, "cannot read %s\n", name.c_str());
+                return 1;
+            }
+        }
+
+        if (options.jsonPath.empty()) {
+            printTable(instances);
+        } else if (options.jsonPath == "-") {
+            writeJson(stdout, instances);
+        } else {
+            FILE* file = std::fopen(options.jsonPath.c_str(), "w");
+            if (file == nullptr) {
+                std::fprintf(stderr, "cannot write %s\n", options.jsonPath.c_str());
+                return 1;
+            }
+            writeJson(file, instances);
+            std::fclose(file);
+        }
+
+        if (!options.watch) {
+            return 0;
+        }
+        std::fflush(stdout);
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+}